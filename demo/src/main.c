@@ -117,6 +117,21 @@ static void setup_demo_scene(ecs_world_t* world, resmngr rmgr)
         .intensity = 120000,
     });
 
+    /* Create reflection probe entities */
+    const vec3 probe_positions[] = {{{-4.0, 2.0, 0.0}}, {{0.0, 2.0, 0.0}}, {{4.0, 2.0, 0.0}}};
+    for (size_t i = 0; i < sizeof(probe_positions) / sizeof(probe_positions[0]); ++i) {
+        ecs_entity_t pe = ecs_new_entity(world, 0, 0, 0);
+        ecs_set(world, pe, transform, {
+            .pose = {
+                .translation = probe_positions[i],
+                .scale = (vec3){{1.0, 1.0, 1.0}},
+                .rotation = quat_id()
+            },
+            .dirty = 1
+        });
+        ecs_set(world, pe, probe, { .radius = 10.0f });
+    }
+
     /* Create camera entity */
     ECS_ENTITY(world, c, camera);
     camera* cam = ecs_get_mut(world, c, camera, 0);
@@ -132,10 +147,13 @@ int main(int argc, char* argv[])
     /* Initialize internal library structures */
     carbon_setup();
 
-    /* Create engine instance with given params */
+    /* Create engine instance with given params, optionally rendering on a dedicated thread */
+    const char* render_snapshots = getenv("CARBON_RENDER_SNAPSHOTS");
     engine_params params = (engine_params){
         .width  = 1280,
         .height = 720,
+        .quantize_vertices = true,
+        .render_snapshots = render_snapshots ? atoi(render_snapshots) : 0,
     };
     engine engine = engine_create(&params);
 
@@ -147,9 +165,20 @@ int main(int argc, char* argv[])
 
     /* Populate scene */
     const char* scene_file = getenv("CARBON_SCENE");
+    char pipeline_file[1024] = {0};
     if (scene_file) {
         /* Load scene from file */
         carbon_load_scene_file(world, rmgr, scene_file);
+        /* Baked probes live next to the scene, rebake them when asked to */
+        char probe_file[1024];
+        snprintf(probe_file, sizeof(probe_file), "%s.probes", scene_file);
+        if (getenv("CARBON_BAKE_PROBES"))
+            engine_bake_probes(engine, probe_file);
+        else
+            engine_load_probes(engine, probe_file);
+        /* So do the shader permutations the scene used last time */
+        snprintf(pipeline_file, sizeof(pipeline_file), "%s.pipelines", scene_file);
+        engine_load_pipeline_manifest(engine, pipeline_file);
     } else {
         /* Fallback to demo scene */
         setup_demo_scene(world, rmgr);
@@ -157,6 +186,8 @@ int main(int argc, char* argv[])
 
     /* Run */
     engine_run(engine);
+    if (pipeline_file[0])
+        engine_save_pipeline_manifest(engine, pipeline_file);
 
     /* Cleanup allocated resources */
     engine_destroy(engine);
@@ -45,6 +45,8 @@ typedef struct transform {
     } pose;
     /* Indicates that cached matrices should be refreshed */
     int dirty;
+    /* Transform generation in which world matrix was last changed */
+    uint32_t generation;
     /* Cached combined matrices */
     mat4 local_mat;
     mat4 world_mat;
@@ -60,8 +62,15 @@ typedef struct light {
     vec3 color;
     /* Intensity value, later multiplied with color */
     float intensity;
+    /* Range of influence, non zero for point lights */
+    float radius;
 } light;
 
+typedef struct probe {
+    /* Range around the probe where content changes trigger a recapture */
+    float radius;
+} probe;
+
 #define IMPORT_COMPONENT(world, component) \
     ecs_entity_t ecs_entity(component) = ecs_lookup(world, #component); \
     (void)ecs_entity(component);
@@ -70,6 +79,7 @@ typedef struct light {
     IMPORT_COMPONENT(world, transform) \
     IMPORT_COMPONENT(world, model)     \
     IMPORT_COMPONENT(world, light)     \
+    IMPORT_COMPONENT(world, probe)     \
     IMPORT_COMPONENT(world, camera)
 
 #endif /* ! _COMPONENTS_H_ */
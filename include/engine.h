@@ -38,6 +38,8 @@
 typedef struct engine_params {
     int width;
     int height;
+    bool quantize_vertices; /* Import models with 16 bit quantized vertices */
+    int render_snapshots;   /* 2 or 3 renders on a dedicated thread, that many frames of inputs in flight. 0 renders in place */
 } engine_params;
 
 /* Engine opaque type */
@@ -59,8 +61,33 @@ ecs_world_t* engine_world(engine e);
  */
 resmngr engine_resmngr(engine e);
 
+/*
+ * Loads baked reflection probes from given file, skipping their runtime capture.
+ * Returns 0 on success
+ */
+int engine_load_probes(engine e, const char* fpath);
+
+/*
+ * Captures all reflection probes during the next frame and stores them to given file
+ */
+void engine_bake_probes(engine e, const char* fpath);
+
+/*
+ * Compiles the shader permutations listed in given manifest up front, avoiding hitches on their first use.
+ * Returns 0 on success
+ */
+int engine_load_pipeline_manifest(engine e, const char* fpath);
+
+/*
+ * Stores the shader permutations used so far to given manifest, for later runs to load.
+ * Returns 0 on success
+ */
+int engine_save_pipeline_manifest(engine e, const char* fpath);
+
 /*
  * Runs engine mainloop in current thread.
+ * With render snapshots enabled, frames are rendered on a dedicated thread owning the
+ * graphics context for the duration of the call, so models have to be loaded beforehand.
  * Can be stopped by calling engine_stop from any thread
  */
 void engine_run(engine e);
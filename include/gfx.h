@@ -405,4 +405,19 @@ typedef sg_desc                         gfx_desc;
 #define GFX_ACTION_LOAD                          SG_ACTION_LOAD
 #define GFX_ACTION_DONTCARE                      SG_ACTION_DONTCARE
 
+/* Timestamp queries, not covered by sokol, backed by the active GL context */
+typedef struct gfx_timer_query { uint32_t id; } gfx_timer_query;
+
+gfx_timer_query gfx_make_timer_query();
+void gfx_destroy_timer_query(gfx_timer_query q);
+/* Records the GPU time once all previously issued commands completed */
+void gfx_timestamp(gfx_timer_query q);
+/* Nonzero when the recorded timestamp can be read without stalling */
+int gfx_timer_query_available(gfx_timer_query q);
+/* Recorded timestamp in nanoseconds, blocks until it is available */
+uint64_t gfx_timer_query_result(gfx_timer_query q);
+
+/* Reads back a RGBA8 rectangle of the bound framebuffer into rows of given pitch */
+void gfx_read_pixels(int x, int y, int w, int h, void* dst, size_t pitch);
+
 #endif /* ! _GFX_H_ */
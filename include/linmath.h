@@ -32,6 +32,7 @@
 #define _LINMATH_H_
 
 #include <stdbool.h>
+#include <stddef.h>
 
 /* --------------------------------------------------
  * Floating point math
@@ -433,6 +434,11 @@ mat4 mat4_world(vec3 position, vec3 scale, quat rotation);
 mat4 mat4_lerp(mat4 m1, mat4 mat2, float amount);
 mat4 mat4_smoothstep(mat4 m1, mat4 mat2, float amount);
 
+/* Batch kernels, outputs must not alias inputs */
+void mat4_mul_mat4_batch(mat4* out, const mat4* m1, const mat4* m2, size_t count);
+void mat4_world_batch(mat4* out, const vec3* positions, const vec3* scales, const quat* rotations, size_t count);
+void mat4_mul_point_batch(vec3* out, mat4 m, const vec3* points, size_t count);
+
 /* --------------------------------------------------
  * Geometry
  * -------------------------------------------------- */
@@ -481,6 +487,23 @@ bool point_inside_box(vec3 point, box b);
 bool point_outside_box(vec3 point, box b);
 bool point_intersects_box(vec3 point, box b);
 
+/* Axis aligned bounding box */
+typedef struct {
+    vec3 lo;
+    vec3 hi;
+} aabb;
+
+aabb aabb_new(vec3 lo, vec3 hi);
+aabb aabb_empty();
+aabb aabb_merge(aabb a1, aabb a2);
+aabb aabb_merge_point(aabb a, vec3 point);
+aabb aabb_transform(aabb a, mat4 world);
+vec3 aabb_center(aabb a);
+vec3 aabb_extents(aabb a);
+
+/* Batch kernel, transforms each box by the matching world matrix */
+void aabb_transform_batch(aabb* out, const aabb* in, const mat4* world, size_t count);
+
 /* Frustum */
 typedef struct {
     vec3 ntr, ntl, nbr, nbl;
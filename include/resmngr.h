@@ -46,12 +46,18 @@ resmngr resmngr_create();
 int resmngr_handle_valid(rid r);
 void resmngr_process(resmngr rm);
 void resmngr_destroy(resmngr rm);
+/* Models imported from now on store their vertices in the compact quantized layout when precise enough */
+void resmngr_set_vertex_quantization(resmngr rm, int enabled);
 
 /* Model resources */
 rid resmngr_model_sample(resmngr rm);
 rid resmngr_model_from_gltf(resmngr rm, const char* fpath);
 void* resmngr_model_lookup(resmngr rm, rid r);
 void resmngr_model_delete(resmngr rm, rid r);
+/* Hands over the scenes of models deleted since the last call, frames built before the deletion may still draw them */
+void resmngr_take_deleted_models(resmngr rm, void*** scenes, size_t* count);
+/* Releases the resources of a scene handed over by resmngr_take_deleted_models */
+void resmngr_model_release(void* scene);
 
 /* Font resources */
 rid resmngr_font_from_ttf_file(resmngr rm, const char* fpath);
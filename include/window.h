@@ -97,6 +97,9 @@ void window_vsync_toggle(window wnd, int state);
 /* Swaps backbuffer with front buffer */
 void window_swap_buffers(window wnd);
 
+/* Makes the window context current on the calling thread, a null window releases the thread's context */
+void window_make_context_current(window wnd);
+
 /* Sets userdata pointer to be assosiated with given window */
 void window_set_userdata(window wnd, void* userdata);
 
@@ -147,4 +147,24 @@ void apply_directional_light(const material material, const pixel_params pixel,
     color += surface_shading(pixel, light, material.normal, view, visibility);
 }
 
+float distance_attenuation(float dist_sqrd, float inv_radius_sqrd)
+{
+    // Inverse square falloff windowed to reach zero at the light radius
+    // See Karis 2013, "Real Shading in Unreal Engine 4"
+    float factor = dist_sqrd * inv_radius_sqrd;
+    float smooth_factor = saturate(1.0 - factor * factor);
+    return (smooth_factor * smooth_factor) / max(dist_sqrd, 1e-4);
+}
+
+void apply_point_light(const material material, const pixel_params pixel, light light, vec3 light_vec, float inv_radius_sqrd, vec3 view, inout vec3 color)
+{
+    float dist_sqrd = dot(light_vec, light_vec);
+    light.direction = light_vec * inversesqrt(dist_sqrd);
+    light.attenuation = distance_attenuation(dist_sqrd, inv_radius_sqrd);
+    float NoL = saturate(dot(material.normal, light.direction));
+    if (NoL <= 0.0 || light.attenuation <= 0.0)
+        return;
+    color += surface_shading(pixel, light, material.normal, view, 1.0);
+}
+
 #endif
@@ -0,0 +1,35 @@
+//
+// vertex.glsl
+//
+#ifndef _VERTEX_GLSL_
+#define _VERTEX_GLSL_
+
+#include <octahedral>
+
+#ifdef VERTEX_QUANTIZED
+// Dequantization transform of the mesh being drawn
+uniform vec4 qpos_offset;    // Center of the mesh bounds
+uniform vec4 qpos_scale;     // Half extent of the mesh bounds
+uniform vec4 qtco_transform; // Center of the texture coordinate bounds in xy, half extent in zw
+
+// Position normalized to the mesh bounds
+vec3 decode_position(in vec3 p)
+{
+    return qpos_offset.xyz + qpos_scale.xyz * p;
+}
+
+// Texture coordinates normalized to their bounds
+vec2 decode_texcoord(in vec2 t)
+{
+    return qtco_transform.xy + qtco_transform.zw * t;
+}
+
+// Octahedral normal and tangent, handedness of the tangent frame given separately
+void decode_tangent_frame(in vec4 nt, in float handedness, out vec3 n, out vec4 t)
+{
+    n = oct_decode(nt.xy);
+    t = vec4(oct_decode(nt.zw), sign_not_zero(handedness));
+}
+#endif
+
+#endif
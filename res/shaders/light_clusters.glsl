@@ -0,0 +1,43 @@
+#include <inc/lighting>
+
+uniform mat4 cluster_view;
+uniform vec4 cluster_dims;       // Cluster grid size, w is zero when clustered lights are disabled
+uniform vec4 cluster_scale;      // Tile size in pixels, depth slice scale and bias over log depth
+uniform sampler2D light_data;    // Per light row: position and radius, color and pre-exposed intensity
+uniform sampler2D cluster_grid;  // Per cluster light list offset and count
+uniform sampler2D light_index;   // Light lists of all clusters
+
+ivec3 cluster_coords(vec3 vpos)
+{
+    float depth = -(cluster_view * vec4(vpos, 1.0)).z;
+    ivec3 dims = ivec3(cluster_dims.xyz);
+    ivec3 c;
+    c.xy = clamp(ivec2(gl_FragCoord.xy / cluster_scale.xy), ivec2(0), dims.xy - 1);
+    c.z = clamp(int(log(max(depth, 1e-4)) * cluster_scale.z + cluster_scale.w), 0, dims.z - 1);
+    return c;
+}
+
+void apply_clustered_lights(const material mat, const pixel_params pixel, vec3 vpos, vec3 view, inout vec3 color)
+{
+    if (cluster_dims.w == 0.0)
+        return;
+
+    // Fetch light list of the fragment's cluster
+    ivec3 c = cluster_coords(vpos);
+    vec2 list = texelFetch(cluster_grid, ivec2(c.y * int(cluster_dims.x) + c.x, c.z), 0).rg;
+    int offset = int(list.x);
+    int count = int(list.y);
+    int width = textureSize(light_index, 0).x;
+
+    // Accumulate every light of the list
+    for (int i = 0; i < count; ++i) {
+        int idx = offset + i;
+        int li = int(texelFetch(light_index, ivec2(idx % width, idx / width), 0).r);
+        vec4 pos_radius = texelFetch(light_data, ivec2(0, li), 0);
+        vec4 col_intensity = texelFetch(light_data, ivec2(1, li), 0);
+        light l;
+        l.color = col_intensity.rgb;
+        l.intensity = col_intensity.a;
+        apply_point_light(mat, pixel, l, pos_radius.xyz - vpos, 1.0 / (pos_radius.w * pos_radius.w), view, color);
+    }
+}
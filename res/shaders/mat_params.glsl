@@ -2,50 +2,62 @@
 #include <inc/color>
 #include <inc/shadow>
 
+// Per view uniforms
 uniform vec3 view_pos;
-
 uniform vec3 light_pos;
 uniform vec4 light_col;
 
+// Shadow cascades, must match SHADOW_NUM_CASCADES
+#define NUM_CASCADES 4
+uniform mat4 cascade_mats[NUM_CASCADES]; // World space to cascade tile uv and depth
+uniform vec4 cascade_atlas;              // Tile resolution, tile margin, atlas resolution and tiles per row
+
+// Per material uniforms
 uniform vec4 bcolor_val;
 uniform vec2 mtlrgn_val;
 
-uniform float has_bcolor_map;
+// Material maps, each one present in the permutations defining HAS_<NAME>
+#ifdef HAS_BCOLOR_MAP
 uniform sampler2D bcolor_map;
-uniform float has_normal_map;
+#endif
+#ifdef HAS_NORMAL_MAP
 uniform sampler2D normal_map;
-uniform float has_mtlrgn_map;
+#endif
+#ifdef HAS_MTLRGN_MAP
 uniform sampler2D mtlrgn_map;
+#endif
 
 uniform sampler2D shadow_map;
-uniform mat4 lightsp_mat;
 
 vec4 bcolor(vec2 vtco)
 {
+#ifdef HAS_BCOLOR_MAP
     vec4 tex_bcolor = texture(bcolor_map, vtco);
-    tex_bcolor = vec4(srgb_to_rgb(tex_bcolor.rgb), tex_bcolor.a);
-    return mix(vec4(1.0), tex_bcolor, has_bcolor_map);
+    return vec4(srgb_to_rgb(tex_bcolor.rgb), tex_bcolor.a);
+#else
+    return vec4(1.0);
+#endif
 }
 
 vec3 normal(vec2 vtco, mat3 vtbn)
 {
-    vec3 normal;
-    bool has_nm = bool(has_normal_map);
-    if (has_nm) {
-        normal = texture(normal_map, vtco).rgb;
-        normal = normal * 2.0 - 1.0;
-        normal = vtbn * normal;
-    } else {
-        normal = vtbn[2];
-    }
-    normal = normalize(normal);
-    return normal;
+#ifdef HAS_NORMAL_MAP
+    vec3 normal = texture(normal_map, vtco).rgb;
+    normal = normal * 2.0 - 1.0;
+    normal = vtbn * normal;
+#else
+    vec3 normal = vtbn[2];
+#endif
+    return normalize(normal);
 }
 
 vec2 mtlrgn(vec2 vtco)
 {
-    vec2 tex_mtlrgn = texture(mtlrgn_map, vtco).gb;
-    return mix(vec2(1.0), tex_mtlrgn, has_mtlrgn_map);
+#ifdef HAS_MTLRGN_MAP
+    return texture(mtlrgn_map, vtco).gb;
+#else
+    return vec2(1.0);
+#endif
 }
 
 bool is_vertex_in_shadow_map(vec3 coord)
@@ -57,18 +69,30 @@ bool is_vertex_in_shadow_map(vec3 coord)
         && coord.y <= 1.0;
 }
 
+vec2 cascade_atlas_coords(vec2 tile_coords, int cascade)
+{
+    float tiles_per_row = cascade_atlas.w;
+    vec2 tile = vec2(mod(float(cascade), tiles_per_row), floor(float(cascade) / tiles_per_row));
+    vec2 texels = tile * cascade_atlas.x + cascade_atlas.y + tile_coords * (cascade_atlas.x - 2.0 * cascade_atlas.y);
+    return texels / cascade_atlas.z;
+}
+
 float shadow(vec3 vpos)
 {
-    // Vertex in light space
-    vec4 ls_pos = lightsp_mat * vec4(vpos, 1.0);
-    // Perform perspective divide
-    vec3 proj_coords = (ls_pos.xyz / ls_pos.w);
-    // Transform to [0,1] range
-    proj_coords = proj_coords * 0.5 + 0.5;
-    // Check if vertex is captured by the shadow map
-    if (!is_vertex_in_shadow_map(proj_coords))
-        return 1.0;
-    // Calculate shadow coefficient
-    float shadow = shadow_visibility(shadow_map, proj_coords);
-    return shadow;
+    // Pick the first, most detailed, cascade capturing the vertex
+    int cascade = NUM_CASCADES;
+    vec3 tile_coords = vec3(0.0);
+    for (int i = 0; i < NUM_CASCADES; ++i) {
+        // Vertex in cascade tile space, orthographic so no perspective divide
+        vec3 coords = (cascade_mats[i] * vec4(vpos, 1.0)).xyz;
+        if (is_vertex_in_shadow_map(coords) && coords.z <= 1.0) {
+            cascade = i;
+            tile_coords = coords;
+            break;
+        }
+    }
+    // Sample outside of the branch, so that filtering derivatives stay defined
+    vec3 atlas_coords = vec3(cascade_atlas_coords(tile_coords.xy, min(cascade, NUM_CASCADES - 1)), tile_coords.z);
+    float shadow = shadow_visibility(shadow_map, atlas_coords);
+    return cascade < NUM_CASCADES ? shadow : 1.0;
 }
@@ -2,6 +2,7 @@
 #include <mat_params>
 #include <inc/tonemap>
 #include <inc/lighting>
+#include <light_clusters>
 
 out vec4 fcolor;
 in vec3 vpos;
@@ -39,9 +40,13 @@ void main()
     float shad = shadow(vpos) * 0.9 + 0.1;
     color = color * shad;
 
+    apply_clustered_lights(mat, pixel, vpos, view, color);
+
     color = tonemap(color);
     color = rgb_to_srgb(color);
-    color = mix(vpos, color, has_bcolor_map);
+#ifndef HAS_BCOLOR_MAP
+    color = vpos;
+#endif
 
     fcolor = vec4(color, 1.0);
 }
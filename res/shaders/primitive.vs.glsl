@@ -1,37 +1,63 @@
 #version 330 core
+#include <inc/vertex>
+#ifdef VERTEX_QUANTIZED
+layout (location = 0) in vec4 apos; // Position in the mesh bounds, tangent handedness in w
+layout (location = 1) in vec4 anrm; // Octahedral normal in xy, octahedral tangent in zw
+layout (location = 2) in vec2 atco; // Texture coordinates in their bounds
+#else
 layout (location = 0) in vec3 apos;
 layout (location = 1) in vec3 anrm;
 layout (location = 2) in vec2 atco;
 layout (location = 3) in vec4 atng;
+#endif
+layout (location = 4) in vec4 imdl0;
+layout (location = 5) in vec4 imdl1;
+layout (location = 6) in vec4 imdl2;
+layout (location = 7) in vec4 imdl3;
 
 out vec3 vpos;
 out vec2 vtco;
 out mat3 vtbn;
 
-uniform mat4 modl;
 uniform mat4 view;
 uniform mat4 proj;
 
 void main()
 {
+    // Unpack vertex attributes
+#ifdef VERTEX_QUANTIZED
+    vec3 pos = decode_position(apos.xyz);
+    vec2 tco = decode_texcoord(atco);
+    vec3 nrm; vec4 tng;
+    decode_tangent_frame(anrm, apos.w, nrm, tng);
+#else
+    vec3 pos = apos;
+    vec2 tco = atco;
+    vec3 nrm = anrm;
+    vec4 tng = atng;
+#endif
+
+    // Assemble per instance model matrix
+    mat4 modl = mat4(imdl0, imdl1, imdl2, imdl3);
+
     // Calculate vertex world position
-    vec3 wpos = vec3(modl * vec4(apos, 1.0));
+    vec3 wpos = vec3(modl * vec4(pos, 1.0));
 
     // Calculate the normal and tangent
-    vec3 n = normalize((modl * vec4(anrm, 0.0)).xyz);
-    vec3 t = normalize((modl * vec4(atng.xyz, 0.0)).xyz);
+    vec3 n = normalize((modl * vec4(nrm, 0.0)).xyz);
+    vec3 t = normalize((modl * vec4(tng.xyz, 0.0)).xyz);
 
     // Reconstruct the bitangent from the normal and tangent
-    vec3 b = normalize((modl * vec4(cross(anrm, atng.xyz) * sign(atng.w), 0.0)).xyz);
+    vec3 b = normalize((modl * vec4(cross(nrm, tng.xyz) * sign(tng.w), 0.0)).xyz);
 
     // Construct tbn matrix
     mat3 tbn = mat3(t, b, n);
 
     // Populate vertex outputs
     vpos = wpos;
-    vtco = atco;
+    vtco = tco;
     vtbn = tbn;
 
     // Fill output position
-    gl_Position = proj * view * modl * vec4(apos, 1.0);
+    gl_Position = proj * view * modl * vec4(pos, 1.0);
 }
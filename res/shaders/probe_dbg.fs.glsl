@@ -1,12 +1,16 @@
 #version 330
 
+#include <inc/octahedral>
+
 out vec4 fcolor;
 in vec3 vnrm;
 
-uniform samplerCube probe;
+uniform sampler2D probe_atlas;
+uniform vec4 probe_rect; // Probe tile offset and size in atlas uv space
 
 void main()
 {
-    vec3 color = texture(probe, vnrm).rgb;
+    vec2 uv = oct_encode(normalize(vnrm)) * 0.5 + 0.5;
+    vec3 color = texture(probe_atlas, probe_rect.xy + uv * probe_rect.zw).rgb;
     fcolor = vec4(color, 1.0);
 }
@@ -1,14 +1,28 @@
 #version 330 core
+#include <inc/vertex>
+#ifdef VERTEX_QUANTIZED
+layout (location = 0) in vec4 apos; // Position in the mesh bounds
+#else
 layout (location = 0) in vec3 apos;
+#endif
+layout (location = 1) in vec4 imdl0;
+layout (location = 2) in vec4 imdl1;
+layout (location = 3) in vec4 imdl2;
+layout (location = 4) in vec4 imdl3;
 
 out vec4 vpos;
 
-uniform mat4 modl;
 uniform mat4 view;
 uniform mat4 proj;
 
 void main()
 {
-    vpos = proj * view * modl * vec4(apos, 1.0);
+#ifdef VERTEX_QUANTIZED
+    vec3 pos = decode_position(apos.xyz);
+#else
+    vec3 pos = apos;
+#endif
+    mat4 modl = mat4(imdl0, imdl1, imdl2, imdl3);
+    vpos = proj * view * modl * vec4(pos, 1.0);
     gl_Position = vpos;
 }
@@ -0,0 +1,12 @@
+#version 330
+
+out vec4 fcolor;
+in vec2 uv;
+
+uniform sampler2D tex;
+uniform vec4 rect; // Source region offset and size in uv space
+
+void main()
+{
+    fcolor = texture(tex, rect.xy + uv * rect.zw);
+}
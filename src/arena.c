@@ -0,0 +1,80 @@
+#include "arena.h"
+#include <stdint.h>
+#include <string.h>
+
+#define ARENA_ALIGNMENT 16
+
+struct arena_block {
+    struct arena_block* next;
+    size_t size, used;
+    _Alignas(ARENA_ALIGNMENT) unsigned char data[];
+};
+
+static inline size_t align_up(size_t sz)
+{
+    return (sz + (ARENA_ALIGNMENT - 1)) & ~(size_t)(ARENA_ALIGNMENT - 1);
+}
+
+static struct arena_block* block_new(size_t size, struct arena_block* next)
+{
+    struct arena_block* b = malloc(sizeof(*b) + size);
+    b->next = next;
+    b->size = size;
+    b->used = 0;
+    return b;
+}
+
+void arena_init(struct arena* a, size_t block_size)
+{
+    a->block_size = align_up(block_size);
+    a->head = block_new(a->block_size, 0);
+}
+
+void arena_destroy(struct arena* a)
+{
+    struct arena_block* b = a->head;
+    while (b) {
+        struct arena_block* next = b->next;
+        free(b);
+        b = next;
+    }
+    a->head = 0;
+}
+
+void* arena_alloc(struct arena* a, size_t size)
+{
+    size = align_up(size);
+    struct arena_block* b = a->head;
+    if (b->size - b->used < size) {
+        /* Chain a new block, large enough for oversized requests */
+        size_t bsize = size > a->block_size ? size : a->block_size;
+        b = a->head = block_new(bsize, b);
+    }
+    void* p = b->data + b->used;
+    b->used += size;
+    return p;
+}
+
+void* arena_calloc(struct arena* a, size_t count, size_t size)
+{
+    void* p = arena_alloc(a, count * size);
+    memset(p, 0, count * size);
+    return p;
+}
+
+void arena_reset(struct arena* a)
+{
+    struct arena_block* b = a->head;
+    if (b->next) {
+        /* Collapse all blocks into one that fits the high watermark */
+        size_t total = 0;
+        for (struct arena_block* it = b; it; it = it->next)
+            total += it->size;
+        arena_destroy(a);
+        if (total > a->block_size)
+            a->block_size = total;
+        a->head = block_new(a->block_size, 0);
+    } else {
+        b->used = 0;
+    }
+}
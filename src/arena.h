@@ -0,0 +1,92 @@
+/*********************************************************************************************************************/
+/*                                                  /===-_---~~~~~~~~~------____                                     */
+/*                                                 |===-~___                _,-'                                     */
+/*                  -==\\                         `//~\\   ~~~~`---.___.-~~                                          */
+/*              ______-==|                         | |  \\           _-~`                                            */
+/*        __--~~~  ,-/-==\\                        | |   `\        ,'                                                */
+/*     _-~       /'    |  \\                      / /      \      /                                                  */
+/*   .'        /       |   \\                   /' /        \   /'                                                   */
+/*  /  ____  /         |    \`\.__/-~~ ~ \ _ _/'  /          \/'                                                     */
+/* /-'~    ~~~~~---__  |     ~-/~         ( )   /'        _--~`                                                      */
+/*                   \_|      /        _)   ;  ),   __--~~                                                           */
+/*                     '~~--_/      _-~/-  / \   '-~ \                                                               */
+/*                    {\__--_/}    / \\_>- )<__\      \                                                              */
+/*                    /'   (_/  _-~  | |__>--<__|      |                                                             */
+/*                   |0  0 _/) )-~     | |__>--<__|     |                                                            */
+/*                   / /~ ,_/       / /__>---<__/      |                                                             */
+/*                  o o _//        /-~_>---<__-~      /                                                              */
+/*                  (^(~          /~_>---<__-      _-~                                                               */
+/*                 ,/|           /__>--<__/     _-~                                                                  */
+/*              ,//('(          |__>--<__|     /                  .----_                                             */
+/*             ( ( '))          |__>--<__|    |                 /' _---_~\                                           */
+/*          `-)) )) (           |__>--<__|    |               /'  /     ~\`\                                         */
+/*         ,/,'//( (             \__>--<__\    \            /'  //        ||                                         */
+/*       ,( ( ((, ))              ~-__>--<_~-_  ~--____---~' _/'/        /'                                          */
+/*     `~/  )` ) ,/|                 ~-_~>--<_/-__       __-~ _/                                                     */
+/*   ._-~//( )/ )) `                    ~~-'_/_/ /~~~~~~~__--~                                                       */
+/*    ;'( ')/ ,)(                              ~~~~~~~~~~                                                            */
+/*   ' ') '( (/                                                                                                      */
+/*     '   '  `                                                                                                      */
+/*********************************************************************************************************************/
+#ifndef _ARENA_H_
+#define _ARENA_H_
+
+#include <stdlib.h>
+
+/*
+ * Arena (linear) allocator
+ *
+ * Allocations are served by bumping an offset into a memory block, and are
+ * all released together by resetting or destroying the arena. When a block
+ * runs out of space a new one is chained in front of it, so the arena grows
+ * on demand without any hard capacity limits.
+ *
+ * On reset, an arena that had to grow is collapsed into a single block that
+ * is large enough for everything allocated since the last reset, so that
+ * steady state per frame usage does not touch the system allocator.
+ */
+
+struct arena_block;
+
+struct arena {
+    /* Current block, older blocks are chained behind it */
+    struct arena_block* head;
+    /* Minimum size of newly allocated blocks */
+    size_t block_size;
+};
+
+/*
+ * arena_init - initialize the arena
+ * @a: the arena to initialize
+ * @block_size: the minimum size of each backing block
+ */
+void arena_init(struct arena* a, size_t block_size);
+
+/*
+ * arena_destroy - free all the memory held by the arena
+ * @a: the arena to free
+ */
+void arena_destroy(struct arena* a);
+
+/*
+ * arena_alloc - allocate uninitialized memory from the arena
+ * @a: the arena
+ * @size: the number of bytes to allocate
+ */
+void* arena_alloc(struct arena* a, size_t size);
+
+/*
+ * arena_calloc - allocate zero initialized memory for an array from the arena
+ * @a: the arena
+ * @count: the number of array elements
+ * @size: the size of each element
+ */
+void* arena_calloc(struct arena* a, size_t count, size_t size);
+
+/*
+ * arena_reset - release all allocations made from the arena
+ * @a: the arena
+ */
+void arena_reset(struct arena* a);
+
+#endif /* ! _ARENA_H_ */
@@ -71,7 +71,7 @@ static void parse_transform_component(struct json_object_s* jobj, float translat
     }
 }
 
-static void parse_light_component(struct json_object_s* jobj, float color[3], float* intensity)
+static void parse_light_component(struct json_object_s* jobj, float color[3], float* intensity, float* radius)
 {
     for (struct json_object_element_s* e = jobj->start; e; e = e->next) {
         if (strncmp(e->name->string, "color", e->name->string_size) == 0) {
@@ -87,6 +87,9 @@ static void parse_light_component(struct json_object_s* jobj, float color[3], fl
         } else if (strncmp(e->name->string, "intensity", e->name->string_size) == 0) {
             struct json_number_s* jnum = e->value->payload;
             *intensity = atof(jnum->number);
+        } else if (strncmp(e->name->string, "radius", e->name->string_size) == 0) {
+            struct json_number_s* jnum = e->value->payload;
+            *radius = atof(jnum->number);
         }
     }
 }
@@ -181,12 +184,22 @@ void carbon_load_scene_file(ecs_world_t* world, resmngr rmgr, const char* path)
                 light l = (light){
                     .color = vec3_zero(),
                     .intensity = 0,
+                    .radius = 0,
                 };
                 parse_light_component(
                     json_value_as_object(f->value),
-                    l.color.xyz, &l.intensity
+                    l.color.xyz, &l.intensity, &l.radius
                 );
                 ecs_set_ptr(world, entity, light, &l);
+            } else if (strncmp(f->name->string, "probe", f->name->string_size) == 0) {
+                probe p = (probe){ .radius = 0 };
+                for (struct json_object_element_s* g = json_value_as_object(f->value)->start; g; g = g->next) {
+                    if (strncmp(g->name->string, "radius", g->name->string_size) == 0) {
+                        struct json_number_s* jnum = g->value->payload;
+                        p.radius = atof(jnum->number);
+                    }
+                }
+                ecs_set_ptr(world, entity, probe, &p);
             } else if (strncmp(f->name->string, "camera", f->name->string_size) == 0) {
                 camera c;
                 camera_defaults(&c);
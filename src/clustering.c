@@ -0,0 +1,136 @@
+#include "clustering.h"
+#include <math.h>
+#include <float.h>
+
+typedef struct cluster_bin_job {
+    const cluster_params* cp;
+    const vec4* spheres;     /* View space centers, view depth grows along -z */
+    size_t num_lights;
+    uint16_t* bins;          /* [CLUSTER_COUNT][CLUSTER_MAX_LIGHTS_PER_CLUSTER] */
+    uint32_t* counts;
+} cluster_bin_job;
+
+void cluster_depth_scale_bias(const cluster_params* cp, float* scale, float* bias)
+{
+    /* slice = log(depth / near) / log(far / near) * num_slices */
+    float log_ratio = logf(cp->far_dist / cp->near_dist);
+    *scale = (float)CLUSTER_GRID_Z / log_ratio;
+    *bias  = -(float)CLUSTER_GRID_Z * logf(cp->near_dist) / log_ratio;
+}
+
+static float cluster_slice_depth(const cluster_params* cp, int slice)
+{
+    /* Outermost slices extend to cover everything in front of the camera */
+    if (slice <= 0)
+        return 0.0f;
+    if (slice >= CLUSTER_GRID_Z)
+        return FLT_MAX;
+    return cp->near_dist * powf(cp->far_dist / cp->near_dist, (float)slice / CLUSTER_GRID_Z);
+}
+
+static int sphere_overlaps_aabb(vec3 c, float r, vec3 lo, vec3 hi)
+{
+    float d2 = 0.0f;
+    for (int i = 0; i < 3; ++i) {
+        float v = c.xyz[i];
+        float e = v < lo.xyz[i] ? lo.xyz[i] - v : (v > hi.xyz[i] ? v - hi.xyz[i] : 0.0f);
+        d2 += e * e;
+    }
+    return d2 <= r * r;
+}
+
+static void cluster_bin_slices(void* arg, size_t first, size_t last)
+{
+    cluster_bin_job* job = arg;
+    const cluster_params* cp = job->cp;
+
+    /* Inverse projection scale, maps ndc to view space per unit of depth */
+    float sx = 1.0f / cp->proj.xx;
+    float sy = 1.0f / cp->proj.yy;
+
+    uint16_t candidates[CLUSTER_MAX_LIGHTS];
+    for (size_t z = first; z < last; ++z) {
+        float dn = cluster_slice_depth(cp, (int)z);
+        float df = cluster_slice_depth(cp, (int)z + 1);
+
+        /* Lights overlapping the slice depth range */
+        size_t num_candidates = 0;
+        for (size_t i = 0; i < job->num_lights; ++i) {
+            float depth = -job->spheres[i].z, r = job->spheres[i].w;
+            if (depth + r >= dn && depth - r <= df)
+                candidates[num_candidates++] = (uint16_t)i;
+        }
+        if (num_candidates == 0)
+            continue;
+
+        /* Bounding depth of the last slice is open, clamp it to the farthest candidate */
+        if (df == FLT_MAX) {
+            df = dn;
+            for (size_t k = 0; k < num_candidates; ++k) {
+                const vec4* s = &job->spheres[candidates[k]];
+                if (-s->z + s->w > df)
+                    df = -s->z + s->w;
+            }
+        }
+
+        for (int y = 0; y < CLUSTER_GRID_Y; ++y) {
+            float y0 = -1.0f + 2.0f * (float)y / CLUSTER_GRID_Y;
+            float y1 = -1.0f + 2.0f * (float)(y + 1) / CLUSTER_GRID_Y;
+            for (int x = 0; x < CLUSTER_GRID_X; ++x) {
+                float x0 = -1.0f + 2.0f * (float)x / CLUSTER_GRID_X;
+                float x1 = -1.0f + 2.0f * (float)(x + 1) / CLUSTER_GRID_X;
+                /* View space box around the tile's frustum section */
+                vec3 lo = vec3_new(fminf(x0 * dn, x0 * df) * sx, fminf(y0 * dn, y0 * df) * sy, -df);
+                vec3 hi = vec3_new(fmaxf(x1 * dn, x1 * df) * sx, fmaxf(y1 * dn, y1 * df) * sy, -dn);
+                size_t cluster = (z * CLUSTER_GRID_Y + y) * CLUSTER_GRID_X + x;
+                uint16_t* bin = job->bins + cluster * CLUSTER_MAX_LIGHTS_PER_CLUSTER;
+                uint32_t count = 0;
+                for (size_t k = 0; k < num_candidates && count < CLUSTER_MAX_LIGHTS_PER_CLUSTER; ++k) {
+                    const vec4* s = &job->spheres[candidates[k]];
+                    if (sphere_overlaps_aabb(vec3_new(s->x, s->y, s->z), s->w, lo, hi))
+                        bin[count++] = candidates[k];
+                }
+                job->counts[cluster] = count;
+            }
+        }
+    }
+}
+
+void cluster_bin_lights(cluster_bins* cb, const cluster_params* cp, const vec4* spheres, size_t num_lights, threadpool_t* workers, struct arena* mem)
+{
+    if (num_lights > CLUSTER_MAX_LIGHTS)
+        num_lights = CLUSTER_MAX_LIGHTS;
+
+    /* Move light spheres to view space */
+    vec4* vs_spheres = arena_alloc(mem, num_lights * sizeof(*vs_spheres));
+    for (size_t i = 0; i < num_lights; ++i) {
+        vec4 c = mat4_mul_vec4(cp->view, vec4_new(spheres[i].x, spheres[i].y, spheres[i].z, 1.0f));
+        vs_spheres[i] = vec4_new(c.x, c.y, c.z, spheres[i].w);
+    }
+
+    /* Bin every slice into fixed size per cluster lists */
+    cluster_bin_job job = {
+        .cp         = cp,
+        .spheres    = vs_spheres,
+        .num_lights = num_lights,
+        .bins       = arena_alloc(mem, CLUSTER_COUNT * CLUSTER_MAX_LIGHTS_PER_CLUSTER * sizeof(uint16_t)),
+        .counts     = arena_calloc(mem, CLUSTER_COUNT, sizeof(uint32_t)),
+    };
+    threadpool_parallel_for(workers, CLUSTER_GRID_Z, 1, cluster_bin_slices, &job);
+
+    /* Compact the lists into a single index list */
+    cb->offsets = arena_alloc(mem, CLUSTER_COUNT * sizeof(*cb->offsets));
+    cb->counts  = job.counts;
+    cb->indices = arena_alloc(mem, CLUSTER_MAX_INDICES * sizeof(*cb->indices));
+    size_t n = 0;
+    for (size_t c = 0; c < CLUSTER_COUNT; ++c) {
+        uint32_t count = job.counts[c];
+        if (n + count > CLUSTER_MAX_INDICES)
+            count = job.counts[c] = (uint32_t)(CLUSTER_MAX_INDICES - n);
+        const uint16_t* bin = job.bins + c * CLUSTER_MAX_LIGHTS_PER_CLUSTER;
+        cb->offsets[c] = (uint32_t)n;
+        for (uint32_t k = 0; k < count; ++k)
+            cb->indices[n++] = bin[k];
+    }
+    cb->num_indices = n;
+}
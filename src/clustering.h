@@ -0,0 +1,73 @@
+/*********************************************************************************************************************/
+/*                                                  /===-_---~~~~~~~~~------____                                     */
+/*                                                 |===-~___                _,-'                                     */
+/*                  -==\\                         `//~\\   ~~~~`---.___.-~~                                          */
+/*              ______-==|                         | |  \\           _-~`                                            */
+/*        __--~~~  ,-/-==\\                        | |   `\        ,'                                                */
+/*     _-~       /'    |  \\                      / /      \      /                                                  */
+/*   .'        /       |   \\                   /' /        \   /'                                                   */
+/*  /  ____  /         |    \`\.__/-~~ ~ \ _ _/'  /          \/'                                                     */
+/* /-'~    ~~~~~---__  |     ~-/~         ( )   /'        _--~`                                                      */
+/*                   \_|      /        _)   ;  ),   __--~~                                                           */
+/*                     '~~--_/      _-~/-  / \   '-~ \                                                               */
+/*                    {\__--_/}    / \\_>- )<__\      \                                                              */
+/*                    /'   (_/  _-~  | |__>--<__|      |                                                             */
+/*                   |0  0 _/) )-~     | |__>--<__|     |                                                            */
+/*                   / /~ ,_/       / /__>---<__/      |                                                             */
+/*                  o o _//        /-~_>---<__-~      /                                                              */
+/*                  (^(~          /~_>---<__-      _-~                                                               */
+/*                 ,/|           /__>--<__/     _-~                                                                  */
+/*              ,//('(          |__>--<__|     /                  .----_                                             */
+/*             ( ( '))          |__>--<__|    |                 /' _---_~\                                           */
+/*          `-)) )) (           |__>--<__|    |               /'  /     ~\`\                                         */
+/*         ,/,'//( (             \__>--<__\    \            /'  //        ||                                         */
+/*       ,( ( ((, ))              ~-__>--<_~-_  ~--____---~' _/'/        /'                                          */
+/*     `~/  )` ) ,/|                 ~-_~>--<_/-__       __-~ _/                                                     */
+/*   ._-~//( )/ )) `                    ~~-'_/_/ /~~~~~~~__--~                                                       */
+/*    ;'( ')/ ,)(                              ~~~~~~~~~~                                                            */
+/*   ' ') '( (/                                                                                                      */
+/*     '   '  `                                                                                                      */
+/*********************************************************************************************************************/
+#ifndef _CLUSTERING_H_
+#define _CLUSTERING_H_
+
+#include <stdint.h>
+#include <linmath.h>
+#include "arena.h"
+#include "thread_pool.h"
+
+/* View frustum subdivision, screen space tiles times exponential depth slices */
+#define CLUSTER_GRID_X (16)
+#define CLUSTER_GRID_Y (9)
+#define CLUSTER_GRID_Z (24)
+#define CLUSTER_COUNT (CLUSTER_GRID_X * CLUSTER_GRID_Y * CLUSTER_GRID_Z)
+
+#define CLUSTER_MAX_LIGHTS (1024)             /* Point lights considered per view      */
+#define CLUSTER_MAX_LIGHTS_PER_CLUSTER (128)  /* Lights beyond that are dropped        */
+#define CLUSTER_MAX_INDICES (32 * 1024)       /* Light index list capacity, all clusters */
+
+/* Depth range that is sliced, view depths outside it fall into the first or last slice */
+typedef struct cluster_params {
+    mat4 view;
+    mat4 proj;       /* Symmetric perspective projection */
+    float near_dist;
+    float far_dist;
+} cluster_params;
+
+/* Light index list, each cluster references a contiguous range of it.
+ * Clusters are laid out x fastest, then y, then z. */
+typedef struct cluster_bins {
+    uint32_t* offsets;   /* [CLUSTER_COUNT] */
+    uint32_t* counts;    /* [CLUSTER_COUNT] */
+    uint32_t* indices;   /* [num_indices]   */
+    size_t num_indices;
+} cluster_bins;
+
+/* Bins the given world space light spheres (position, radius) into the clusters of the view.
+ * Slices are binned in parallel on the workers, all allocations come from the given arena */
+void cluster_bin_lights(cluster_bins* cb, const cluster_params* cp, const vec4* spheres, size_t num_lights, threadpool_t* workers, struct arena* mem);
+
+/* Scale and bias turning log(view depth) into a slice index */
+void cluster_depth_scale_bias(const cluster_params* cp, float* scale, float* bias);
+
+#endif /* ! _CLUSTERING_H_ */
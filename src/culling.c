@@ -0,0 +1,130 @@
+#include "culling.h"
+#include <math.h>
+#include "simd.h"
+
+static void cull_volume_set_plane(cull_volume* cv, int i, float a, float b, float c, float d)
+{
+    /* Normalize so that distances are in world units */
+    float len = sqrtf(a * a + b * b + c * c);
+    float inv = len > 0.0f ? 1.0f / len : 0.0f;
+    cv->nx[i] = a * inv;
+    cv->ny[i] = b * inv;
+    cv->nz[i] = c * inv;
+    cv->d[i]  = d * inv;
+}
+
+void cull_volume_from_matrix(cull_volume* cv, mat4 m)
+{
+    /* Clip space planes combined from matrix rows (Gribb-Hartmann) */
+    cull_volume_set_plane(cv, 0, m.wx + m.xx, m.wy + m.xy, m.wz + m.xz, m.ww + m.xw); /* Left   */
+    cull_volume_set_plane(cv, 1, m.wx - m.xx, m.wy - m.xy, m.wz - m.xz, m.ww - m.xw); /* Right  */
+    cull_volume_set_plane(cv, 2, m.wx + m.yx, m.wy + m.yy, m.wz + m.yz, m.ww + m.yw); /* Bottom */
+    cull_volume_set_plane(cv, 3, m.wx - m.yx, m.wy - m.yy, m.wz - m.yz, m.ww - m.yw); /* Top    */
+    cull_volume_set_plane(cv, 4, m.wx + m.zx, m.wy + m.zy, m.wz + m.zz, m.ww + m.zw); /* Near   */
+    cull_volume_set_plane(cv, 5, m.wx - m.zx, m.wy - m.zy, m.wz - m.zz, m.ww - m.zw); /* Far    */
+
+    /* Unused slots never reject anything */
+    for (int i = 6; i < CULL_MAX_PLANES; ++i) {
+        cv->nx[i] = cv->ny[i] = cv->nz[i] = 0.0f;
+        cv->d[i] = 1.0f;
+    }
+}
+
+static int cull_volume_push_plane(cull_volume* cv, int n, vec3 nrm, float d)
+{
+    if (n >= CULL_MAX_PLANES)
+        return n;
+    cv->nx[n] = nrm.x;
+    cv->ny[n] = nrm.y;
+    cv->nz[n] = nrm.z;
+    cv->d[n]  = d;
+    return n + 1;
+}
+
+void cull_volume_shadow_casters(cull_volume* cv, mat4 camera_viewproj, mat4 light_viewproj, vec3 to_light)
+{
+    /* Casters must be rendered by the light */
+    cull_volume_from_matrix(cv, light_viewproj);
+    int n = 6;
+
+    /* Receivers sweep towards the light, so camera planes whose inside extends towards it keep bounding the swept volume */
+    cull_volume camera;
+    cull_volume_from_matrix(&camera, camera_viewproj);
+    vec3 nrm[6]; int facing[6];
+    for (int i = 0; i < 6; ++i) {
+        nrm[i] = vec3_new(camera.nx[i], camera.ny[i], camera.nz[i]);
+        facing[i] = vec3_dot(nrm[i], to_light) >= 0.0f;
+        if (facing[i])
+            n = cull_volume_push_plane(cv, n, nrm[i], camera.d[i]);
+    }
+
+    /* Silhouette edges, shared by a facing and a non facing plane, bound the sides of the sweep.
+     * Opposite planes (0-1, 2-3, 4-5) are the only pairs not sharing an edge */
+    for (int i = 0; i < 6; ++i) {
+        for (int j = i + 1; j < 6; ++j) {
+            if (j == (i ^ 1) || facing[i] == facing[j])
+                continue;
+            /* Plane through the edge containing the light direction */
+            vec3 edge = vec3_cross(nrm[i], nrm[j]);
+            vec3 m = vec3_cross(edge, to_light);
+            float len = vec3_length(m);
+            if (len < 1e-6f)
+                continue;
+            m = vec3_mul(m, 1.0f / len);
+            /* Express m in terms of the edge planes to find its offset along the edge */
+            float c = vec3_dot(nrm[i], nrm[j]);
+            float det = 1.0f - c * c;
+            if (det < 1e-6f)
+                continue;
+            float mi = vec3_dot(m, nrm[i]), mj = vec3_dot(m, nrm[j]);
+            float a = (mi - c * mj) / det;
+            float b = (mj - c * mi) / det;
+            float d = a * camera.d[i] + b * camera.d[j];
+            /* Keep the wedge between the two planes inside */
+            if (mi + mj < 0.0f) {
+                m = vec3_mul(m, -1.0f);
+                d = -d;
+            }
+            n = cull_volume_push_plane(cv, n, m, d);
+        }
+    }
+}
+
+size_t cull_boxes(const cull_volume* cv, const aabb* boxes, size_t count, uint8_t* visible)
+{
+    /* Planes are tested four at a time */
+    enum { NUM_GROUPS = CULL_MAX_PLANES / 4 };
+    simd4f nx[NUM_GROUPS], ny[NUM_GROUPS], nz[NUM_GROUPS], d[NUM_GROUPS], anx[NUM_GROUPS], any[NUM_GROUPS], anz[NUM_GROUPS];
+    for (int k = 0; k < NUM_GROUPS; ++k) {
+        nx[k]  = simd4f_load(cv->nx + 4 * k);
+        ny[k]  = simd4f_load(cv->ny + 4 * k);
+        nz[k]  = simd4f_load(cv->nz + 4 * k);
+        d[k]   = simd4f_load(cv->d  + 4 * k);
+        anx[k] = simd4f_abs(nx[k]);
+        any[k] = simd4f_abs(ny[k]);
+        anz[k] = simd4f_abs(nz[k]);
+    }
+    const simd4f zero = simd4f_splat(0.0f);
+
+    size_t num_visible = 0;
+    for (size_t i = 0; i < count; ++i) {
+        const aabb* b = &boxes[i];
+        simd4f cx = simd4f_splat(0.5f * (b->lo.x + b->hi.x));
+        simd4f cy = simd4f_splat(0.5f * (b->lo.y + b->hi.y));
+        simd4f cz = simd4f_splat(0.5f * (b->lo.z + b->hi.z));
+        simd4f ex = simd4f_splat(0.5f * (b->hi.x - b->lo.x));
+        simd4f ey = simd4f_splat(0.5f * (b->hi.y - b->lo.y));
+        simd4f ez = simd4f_splat(0.5f * (b->hi.z - b->lo.z));
+
+        /* Box is outside when its center lies further behind a plane than its projected radius */
+        int outside = 0;
+        for (int k = 0; k < NUM_GROUPS; ++k) {
+            simd4f dist = simd4f_madd(nx[k], cx, simd4f_madd(ny[k], cy, simd4f_madd(nz[k], cz, d[k])));
+            simd4f rad  = simd4f_madd(anx[k], ex, simd4f_madd(any[k], ey, simd4f_mul(anz[k], ez)));
+            outside |= simd4f_movemask_gt(zero, simd4f_add(dist, rad));
+        }
+        visible[i] = !outside;
+        num_visible += !outside;
+    }
+    return num_visible;
+}
@@ -0,0 +1,63 @@
+/*********************************************************************************************************************/
+/*                                                  /===-_---~~~~~~~~~------____                                     */
+/*                                                 |===-~___                _,-'                                     */
+/*                  -==\\                         `//~\\   ~~~~`---.___.-~~                                          */
+/*              ______-==|                         | |  \\           _-~`                                            */
+/*        __--~~~  ,-/-==\\                        | |   `\        ,'                                                */
+/*     _-~       /'    |  \\                      / /      \      /                                                  */
+/*   .'        /       |   \\                   /' /        \   /'                                                   */
+/*  /  ____  /         |    \`\.__/-~~ ~ \ _ _/'  /          \/'                                                     */
+/* /-'~    ~~~~~---__  |     ~-/~         ( )   /'        _--~`                                                      */
+/*                   \_|      /        _)   ;  ),   __--~~                                                           */
+/*                     '~~--_/      _-~/-  / \   '-~ \                                                               */
+/*                    {\__--_/}    / \\_>- )<__\      \                                                              */
+/*                    /'   (_/  _-~  | |__>--<__|      |                                                             */
+/*                   |0  0 _/) )-~     | |__>--<__|     |                                                            */
+/*                   / /~ ,_/       / /__>---<__/      |                                                             */
+/*                  o o _//        /-~_>---<__-~      /                                                              */
+/*                  (^(~          /~_>---<__-      _-~                                                               */
+/*                 ,/|           /__>--<__/     _-~                                                                  */
+/*              ,//('(          |__>--<__|     /                  .----_                                             */
+/*             ( ( '))          |__>--<__|    |                 /' _---_~\                                           */
+/*          `-)) )) (           |__>--<__|    |               /'  /     ~\`\                                         */
+/*         ,/,'//( (             \__>--<__\    \            /'  //        ||                                         */
+/*       ,( ( ((, ))              ~-__>--<_~-_  ~--____---~' _/'/        /'                                          */
+/*     `~/  )` ) ,/|                 ~-_~>--<_/-__       __-~ _/                                                     */
+/*   ._-~//( )/ )) `                    ~~-'_/_/ /~~~~~~~__--~                                                       */
+/*    ;'( ')/ ,)(                              ~~~~~~~~~~                                                            */
+/*   ' ') '( (/                                                                                                      */
+/*     '   '  `                                                                                                      */
+/*********************************************************************************************************************/
+#ifndef _CULLING_H_
+#define _CULLING_H_
+
+#include <stdint.h>
+#include <linmath.h>
+
+/* View volume as inward facing planes, stored as separate component arrays.
+ * Each plane satisfies dot(n, p) + d >= 0 for points inside the volume.
+ * Planes are tested in groups of four, so the maximum is kept a multiple of it. */
+#define CULL_MAX_PLANES (16)
+
+typedef struct cull_volume {
+    float nx[CULL_MAX_PLANES];
+    float ny[CULL_MAX_PLANES];
+    float nz[CULL_MAX_PLANES];
+    float d[CULL_MAX_PLANES];
+} cull_volume;
+
+/* Extracts the six clip planes of the given view projection matrix */
+void cull_volume_from_matrix(cull_volume* cv, mat4 viewproj);
+
+/* Builds the volume of shadow casters for a directional light. Casters must lie in the light's
+ * view volume and be able to project, along the light direction, onto the part of the camera
+ * view volume that the light covers. The camera volume is extruded towards the light, bounded by
+ * the camera planes facing it and by planes through its silhouette edges. Planes not fitting the
+ * volume are left out, which only makes the result more conservative. */
+void cull_volume_shadow_casters(cull_volume* cv, mat4 camera_viewproj, mat4 light_viewproj, vec3 to_light);
+
+/* Tests world space boxes against the volume, writes 1 for each box that
+ * (conservatively) intersects it and 0 otherwise. Returns number of visible boxes */
+size_t cull_boxes(const cull_volume* cv, const aabb* boxes, size_t count, uint8_t* visible);
+
+#endif /* ! _CULLING_H_ */
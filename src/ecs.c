@@ -1,11 +1,67 @@
 #include "ecs.h"
 #include <components.h>
 #include <string.h>
+#include <assert.h>
+#include "hashmap.h"
+
+/* Number of transforms processed by a single worker task */
+#define TRANSFORM_UPDATE_GRAIN (1024)
+/* Number of transforms fed at once to the batch math kernels */
+#define TRANSFORM_BATCH_SIZE (64)
+
+/* Set of render proxies, densely stored and keyed by owning entity */
+typedef struct proxy_set {
+    struct slot_map data;
+    hashmap_t* keys;
+} proxy_set;
+
+/* Transform hierarchy flattened in depth order, parents always precede their children.
+ * Kept across ticks and only rebuilt when the layout of the transform storage changes */
+typedef struct transform_hierarchy {
+    /* Per node data */
+    transform** transforms; /* Component storage holding local pose and world matrix */
+    ecs_entity_t* entities;
+    int32_t* parents;       /* Index of parent node, -1 for roots */
+    int32_t* child_spans;   /* Index of first span holding children of the node, -1 for leaves */
+    size_t num_nodes;
+    size_t cap_nodes;
+    /* Nodes whose world matrix changed during the last tick, in level order */
+    size_t* changes;
+    ecs_entity_t* changed_entities;
+    size_t num_changes;
+    /* Offsets of each depth level, with an extra entry marking the end */
+    size_t* levels;
+    size_t num_levels;
+    size_t cap_levels;
+    /* Contiguous component storage ranges, used to resolve parent indices */
+    struct transform_span {
+        ecs_table_t* table;
+        transform* base;
+        int32_t count;
+        size_t first;
+        size_t depth;
+        int32_t next;       /* Next span of children sharing the same parent, -1 for the last one */
+    }* spans;
+    size_t num_spans;
+    size_t cap_spans;
+    uint32_t structure;     /* Structure counter the hierarchy was built at */
+} transform_hierarchy;
 
 static struct {
-    ecs_query_t* prm_query;
-    ecs_query_t* prl_query;
     ecs_query_t* prc_query;
+    ecs_query_t* trs_query;
+    transform_hierarchy hierarchy;
+    uint32_t structure;     /* Bumped whenever transforms are added to or removed from entities */
+    uint32_t generation;
+    threadpool_t* workers;
+    proxy_set instances;
+    proxy_set lights;
+    proxy_set probes;
+    resmngr rm;
+    /* Proxy data released since it was last handed over, renderer inputs in flight may still reference it */
+    void** retired;
+    size_t num_retired;
+    size_t cap_retired;
 } ecs_internal;
 
 ECS_CTOR(transform, ptr, {
@@ -27,235 +83,545 @@ ECS_CTOR(camera, ptr, {
     camera_defaults(ptr);
 });
 
-static void transform_update_subtree(ecs_world_t* world, ecs_entity_t ecs_entity(transform), ecs_entity_t e, transform* t, transform* tpar)
+static void proxy_set_init(proxy_set* ps, size_t esz)
 {
-    /* Parent matrix */
-    mat4 pm = tpar ? tpar->world_mat : mat4_id();
+    slot_map_init(&ps->data, esz);
+    ps->keys = hashmap_create(0, 0);
+}
 
-    /* Update entity */
-    if (t->dirty) {
-        t->local_mat = mat4_world(
-            t->pose.translation,
-            t->pose.scale,
-            t->pose.rotation
-        );
+static void proxy_set_destroy(proxy_set* ps)
+{
+    void* k = 0; sm_key* pk;
+    uintmax_t iter = HM_WALK_BEGIN;
+    while ((k = hashmap_walk(ps->keys, &iter, 0, (void**)&pk)) != 0) {
+        free(pk);
     }
-    t->world_mat = mat4_mul_mat4(pm, t->local_mat);
-    t->dirty = 0;
-
-    /* Update children */
-    ecs_iter_t it = ecs_scope_iter(world, e);
-    while (ecs_scope_next(&it)) {
-        int32_t t_index = ecs_table_component_index(&it, ecs_entity(transform));
-        transform* tarr = ecs_table_column(&it, t_index);
-
-        /* Recursively update subtrees */
-        for (int32_t i = 0; i < it.count; i++) {
-            transform* tc = &tarr[i];
-            transform_update_subtree(world, ecs_entity(transform), it.entities[i], tc, t);
-        }
+    hashmap_destroy(ps->keys);
+    slot_map_destroy(&ps->data);
+}
+
+static void* proxy_fetch(proxy_set* ps, ecs_entity_t e, int create)
+{
+    sm_key* pk = hashmap_get(ps->keys, &e, sizeof(e));
+    if (!pk) {
+        if (!create)
+            return 0;
+        pk = calloc(1, sizeof(*pk));
+        *pk = slot_map_insert(&ps->data, 0);
+        hashmap_put(ps->keys, &e, sizeof(e), pk);
+        /* New proxies start out zeroed */
+        void* p = slot_map_lookup(&ps->data, *pk);
+        memset(p, 0, ps->data.esz);
+        return p;
     }
+    return slot_map_lookup(&ps->data, *pk);
 }
 
-static void transform_system(ecs_iter_t* it)
+static void proxy_remove(proxy_set* ps, ecs_entity_t e)
 {
-    ecs_entity_t ecs_entity(transform) = ecs_column_entity(it, 1);
-    transform* tarr = ecs_column(it, transform, 1);
-    transform* parent = ecs_column(it, transform, 2);
+    sm_key* pk = hashmap_del(ps->keys, &e, sizeof(e));
+    if (pk) {
+        slot_map_remove(&ps->data, *pk);
+        free(pk);
+    }
+}
 
-    for (int32_t i = 0; i < it->count; ++i) {
-        transform* t = &tarr[i];
-        if (t->dirty) {
-            ecs_entity_t e = it->entities[i];
-            transform_update_subtree(it->world, ecs_entity(transform), e, t, parent);
-        }
+/* Defers freeing of data referenced by renderer inputs until they are done with it */
+static void retire_render_data(void* ptr)
+{
+    if (!ptr)
+        return;
+    if (ecs_internal.num_retired == ecs_internal.cap_retired) {
+        ecs_internal.cap_retired = ecs_internal.cap_retired ? 2 * ecs_internal.cap_retired : 64;
+        ecs_internal.retired = realloc(ecs_internal.retired, ecs_internal.cap_retired * sizeof(*ecs_internal.retired));
     }
+    ecs_internal.retired[ecs_internal.num_retired++] = ptr;
 }
 
-static void camera_system(ecs_iter_t* it)
+static void instance_proxy_remove(ecs_entity_t e)
 {
-    camera* carr = ecs_column(it, camera, 1);
+    renderer_instance* ri = proxy_fetch(&ecs_internal.instances, e, 0);
+    if (ri)
+        retire_render_data(ri->lods);
+    proxy_remove(&ecs_internal.instances, e);
+}
 
-    for (int32_t i = 0; i < it->count; ++i) {
-        camera* c = &carr[i];
-        camera_update(c, it->delta_time);
+static void probes_invalidate_near(vec3 pos)
+{
+    /* Content moved within the range of probes */
+    if (ecs_internal.probes.data.size == 0)
+        return;
+    renderer_probe* probes = slot_map_data(&ecs_internal.probes.data, 0);
+    for (size_t i = 0; i < ecs_internal.probes.data.size; ++i) {
+        renderer_probe* rp = &probes[i];
+        if (vec3_dist(rp->position, pos) <= rp->radius)
+            ++rp->version;
     }
 }
 
-static void merge_renderer_scenes(renderer_scene* tgt_scn, renderer_scene* src_scn, mat4 ptransform)
+static void probes_invalidate_all()
 {
-    size_t offs_buffers    = tgt_scn->num_buffers;
-    size_t offs_images     = tgt_scn->num_images;
-    size_t offs_materials  = tgt_scn->num_materials;
-    size_t offs_primitives = tgt_scn->num_primitives;
-    size_t offs_meshes     = tgt_scn->num_meshes;
-    size_t offs_nodes      = tgt_scn->num_nodes;
-    size_t offs_lights     = tgt_scn->num_lights;
+    if (ecs_internal.probes.data.size == 0)
+        return;
+    renderer_probe* probes = slot_map_data(&ecs_internal.probes.data, 0);
+    for (size_t i = 0; i < ecs_internal.probes.data.size; ++i)
+        ++probes[i].version;
+}
 
-    assert(offs_buffers + src_scn->num_buffers < RENDERER_SCENE_MAX_BUFFERS);
-    for (size_t i = 0; i < src_scn->num_buffers; ++i) {
-        tgt_scn->buffers[offs_buffers + i] = src_scn->buffers[i];
-        ++tgt_scn->num_buffers;
+static vec3 world_position(mat4 world)
+{
+    return vec3_new(world.xw, world.yw, world.zw);
+}
+
+/* Returns nonzero when a light moved, lighting then changed for every probe */
+static int proxy_sync_transform(ecs_entity_t e, transform* t)
+{
+    renderer_instance* ri = proxy_fetch(&ecs_internal.instances, e, 0);
+    if (ri) {
+        probes_invalidate_near(world_position(ri->transform));
+        ri->transform = t->world_mat;
+        probes_invalidate_near(world_position(ri->transform));
     }
+    renderer_light* rl = proxy_fetch(&ecs_internal.lights, e, 0);
+    if (rl) {
+        rl->position = world_position(t->world_mat);
+    }
+    renderer_probe* rp = proxy_fetch(&ecs_internal.probes, e, 0);
+    if (rp) {
+        rp->position = world_position(t->world_mat);
+        ++rp->version;
+    }
+    return rl != 0;
+}
+
+static void* grow_array(void* arr, size_t* cap, size_t count, size_t esz)
+{
+    if (count <= *cap)
+        return arr;
+    size_t ncap = *cap ? *cap : 64;
+    while (ncap < count)
+        ncap *= 2;
+    *cap = ncap;
+    return realloc(arr, ncap * esz);
+}
 
-    assert(offs_images + src_scn->num_images < RENDERER_SCENE_MAX_IMAGES);
-    for (size_t i = 0; i < src_scn->num_images; ++i) {
-        tgt_scn->images[offs_images + i] = src_scn->images[i];
-        ++tgt_scn->num_images;
+static void transform_hierarchy_reserve(transform_hierarchy* h, size_t count)
+{
+    size_t cap = h->cap_nodes;
+    h->transforms = grow_array(h->transforms, &cap, count, sizeof(*h->transforms));
+    cap = h->cap_nodes;
+    h->entities = grow_array(h->entities, &cap, count, sizeof(*h->entities));
+    cap = h->cap_nodes;
+    h->parents = grow_array(h->parents, &cap, count, sizeof(*h->parents));
+    cap = h->cap_nodes;
+    h->child_spans = grow_array(h->child_spans, &cap, count, sizeof(*h->child_spans));
+    cap = h->cap_nodes;
+    h->changes = grow_array(h->changes, &cap, count, sizeof(*h->changes));
+    cap = h->cap_nodes;
+    h->changed_entities = grow_array(h->changed_entities, &cap, count, sizeof(*h->changed_entities));
+    h->cap_nodes = cap;
+}
+
+static void transform_hierarchy_free(transform_hierarchy* h)
+{
+    free(h->transforms);
+    free(h->entities);
+    free(h->parents);
+    free(h->child_spans);
+    free(h->changes);
+    free(h->changed_entities);
+    free(h->levels);
+    free(h->spans);
+    memset(h, 0, sizeof(*h));
+}
+
+static struct transform_span* transform_hierarchy_find_span(transform_hierarchy* h, transform* t)
+{
+    /* Parents usually live in the most recently added levels, search backwards */
+    for (size_t i = h->num_spans; i-- > 0;) {
+        struct transform_span* sp = &h->spans[i];
+        if (t >= sp->base && t < sp->base + sp->count)
+            return sp;
     }
+    return 0;
+}
 
-    assert(offs_materials + src_scn->num_materials < RENDERER_SCENE_MAX_MATERIALS);
-    for (size_t i = 0; i < src_scn->num_materials; ++i) {
-        renderer_material* rmat = &tgt_scn->materials[offs_materials + i];
-        *rmat = src_scn->materials[i];
-
-        /* Update texture indices */
-        if (rmat->type == RENDERER_MATERIAL_TYPE_METALLIC) {
-            size_t* index_ptrs[] = {
-                &rmat->data.metallic.images.base_color,
-                &rmat->data.metallic.images.metallic_roughness,
-                &rmat->data.metallic.images.normal,
-                &rmat->data.metallic.images.occlusion,
-                &rmat->data.metallic.images.emissive,
-            };
+static void transform_hierarchy_build(transform_hierarchy* h, ecs_query_t* q)
+{
+    h->num_nodes = 0;
+    h->num_levels = 0;
+    h->num_spans = 0;
+    h->num_changes = 0;
+    h->structure = ecs_internal.structure;
+
+    /* Cascade queries iterate tables ordered by depth, so a linear walk yields level order */
+    ecs_iter_t it = ecs_query_iter(q);
+    while (ecs_query_next(&it)) {
+        transform* tarr = ecs_column(&it, transform, 1);
+        transform* parent = ecs_column(&it, transform, 2);
+
+        /* All entities of a table share the same parent */
+        int32_t pidx = -1; size_t depth = 0;
+        if (parent) {
+            struct transform_span* psp = transform_hierarchy_find_span(h, parent);
+            assert(psp);
+            pidx = psp->first + (parent - psp->base);
+            depth = psp->depth + 1;
+        }
 
-            size_t num_index_ptrs = sizeof(index_ptrs) / sizeof(index_ptrs[0]);
-            for (size_t k = 0; k < num_index_ptrs; ++k) {
-                size_t* idxp = index_ptrs[k];
-                if (*idxp != RENDERER_SCENE_INVALID_INDEX)
-                    *idxp += offs_images;
-            }
-        } else if (rmat->type == RENDERER_MATERIAL_TYPE_SPECULAR) {
-            size_t* index_ptrs[] = {
-                &rmat->data.specular.images.diffuse,
-                &rmat->data.specular.images.specular_glossiness,
-                &rmat->data.specular.images.normal,
-                &rmat->data.specular.images.occlusion,
-                &rmat->data.specular.images.emissive,
-            };
+        /* Open a new level on depth change */
+        if (h->num_levels == 0 || depth != h->num_levels - 1) {
+            assert(depth == h->num_levels);
+            h->levels = grow_array(h->levels, &h->cap_levels, h->num_levels + 2, sizeof(*h->levels));
+            h->levels[h->num_levels++] = h->num_nodes;
+        }
 
-            size_t num_index_ptrs = sizeof(index_ptrs) / sizeof(index_ptrs[0]);
-            for (size_t k = 0; k < num_index_ptrs; ++k) {
-                size_t* idxp = index_ptrs[k];
-                if (*idxp != RENDERER_SCENE_INVALID_INDEX)
-                    *idxp += offs_images;
-            }
+        /* Record storage range and link it to the children of its parent */
+        h->spans = grow_array(h->spans, &h->cap_spans, h->num_spans + 1, sizeof(*h->spans));
+        h->spans[h->num_spans] = (struct transform_span){
+            .table      = it.table,
+            .base       = tarr,
+            .count      = it.count,
+            .first      = h->num_nodes,
+            .depth      = depth,
+            .next       = pidx >= 0 ? h->child_spans[pidx] : -1,
+        };
+        if (pidx >= 0)
+            h->child_spans[pidx] = (int32_t)h->num_spans;
+        ++h->num_spans;
+
+        /* Append nodes */
+        transform_hierarchy_reserve(h, h->num_nodes + it.count);
+        for (int32_t i = 0; i < it.count; ++i) {
+            size_t n = h->num_nodes++;
+            h->transforms[n] = &tarr[i];
+            h->entities[n] = it.entities[i];
+            h->parents[n] = pidx;
+            h->child_spans[n] = -1;
         }
-        ++tgt_scn->num_materials;
     }
+    if (h->num_levels)
+        h->levels[h->num_levels] = h->num_nodes;
+}
 
-    assert(offs_primitives + src_scn->num_primitives < RENDERER_SCENE_MAX_PRIMITIVES);
-    for (size_t i = 0; i < src_scn->num_primitives; ++i) {
-        renderer_primitive* p = &tgt_scn->primitives[offs_primitives + i];
-        *p = src_scn->primitives[i];
-        if (p->material != RENDERER_SCENE_INVALID_INDEX)
-            p->material += offs_materials;
-        if (p->vertex_buffer != RENDERER_SCENE_INVALID_INDEX)
-            p->vertex_buffer += offs_buffers;
-        if (p->index_buffer != RENDERER_SCENE_INVALID_INDEX)
-            p->index_buffer += offs_buffers;
-        ++tgt_scn->num_primitives;
+/* Transforms were added or removed since the hierarchy was built, or entities moved between the matched tables.
+ * Moves due to reparenting or other components changing only show in the table layout, compare it span by span */
+static int transform_hierarchy_stale(const transform_hierarchy* h, ecs_query_t* q)
+{
+    if (h->structure != ecs_internal.structure)
+        return 1;
+    size_t s = 0;
+    ecs_iter_t it = ecs_query_iter(q);
+    while (ecs_query_next(&it)) {
+        if (s == h->num_spans)
+            return 1;
+        const struct transform_span* sp = &h->spans[s++];
+        if (sp->table != it.table
+         || sp->count != it.count
+         || sp->base != ecs_column(&it, transform, 1))
+            return 1;
     }
+    return s != h->num_spans;
+}
+
+/* Changed nodes of a single depth level */
+typedef struct transform_level_job {
+    transform_hierarchy* h;
+    size_t offset;          /* Start of the level within the change list */
+    uint32_t generation;
+} transform_level_job;
 
-    assert(offs_meshes + src_scn->num_meshes < RENDERER_SCENE_MAX_MESHES);
-    for (size_t i = 0; i < src_scn->num_meshes; ++i) {
-        renderer_mesh* m = &tgt_scn->meshes[offs_meshes + i];
-        *m = src_scn->meshes[i];
-        if (m->first_primitive != RENDERER_SCENE_INVALID_INDEX)
-            m->first_primitive += offs_primitives;
-        ++tgt_scn->num_meshes;
+static void transform_update_batch(transform_hierarchy* h, const size_t* nodes, size_t count, uint32_t generation)
+{
+    vec3 positions[TRANSFORM_BATCH_SIZE], scales[TRANSFORM_BATCH_SIZE];
+    quat rotations[TRANSFORM_BATCH_SIZE];
+    mat4 parents[TRANSFORM_BATCH_SIZE], locals[TRANSFORM_BATCH_SIZE], results[TRANSFORM_BATCH_SIZE];
+    size_t dirty[TRANSFORM_BATCH_SIZE], num_dirty = 0;
+    assert(count > 0 && count <= TRANSFORM_BATCH_SIZE);
+
+    /* Local matrix only needs refreshing when own pose changed */
+    for (size_t k = 0; k < count; ++k) {
+        transform* t = h->transforms[nodes[k]];
+        if (t->dirty) {
+            positions[num_dirty] = t->pose.translation;
+            scales[num_dirty]    = t->pose.scale;
+            rotations[num_dirty] = t->pose.rotation;
+            dirty[num_dirty++]   = k;
+        }
+    }
+    if (num_dirty) {
+        mat4_world_batch(results, positions, scales, rotations, num_dirty);
+        for (size_t k = 0; k < num_dirty; ++k)
+            h->transforms[nodes[dirty[k]]]->local_mat = results[k];
     }
 
-    assert(offs_nodes + src_scn->num_nodes < RENDERER_SCENE_MAX_NODES);
-    for (size_t i = 0; i < src_scn->num_nodes; ++i) {
-        renderer_node* n = &tgt_scn->nodes[offs_nodes + i];
-        *n = src_scn->nodes[i];
-        if (n->mesh != RENDERER_SCENE_INVALID_INDEX)
-            n->mesh += offs_meshes;
-        n->transform = mat4_mul_mat4(ptransform, n->transform);
-        ++tgt_scn->num_nodes;
+    /* Compose with parent world matrices */
+    for (size_t k = 0; k < count; ++k) {
+        int32_t p = h->parents[nodes[k]];
+        parents[k] = p >= 0 ? h->transforms[p]->world_mat : mat4_id();
+        locals[k] = h->transforms[nodes[k]]->local_mat;
     }
+    mat4_mul_mat4_batch(results, parents, locals, count);
+    for (size_t k = 0; k < count; ++k) {
+        transform* t = h->transforms[nodes[k]];
+        t->world_mat = results[k];
+        t->dirty = 0;
+        t->generation = generation;
+    }
+}
+
+static void transform_update_range(void* arg, size_t first, size_t last)
+{
+    transform_level_job* job = arg;
+    const size_t* nodes = job->h->changes + job->offset;
 
-    assert(offs_lights + src_scn->num_lights < RENDERER_SCENE_MAX_LIGHTS);
-    for (size_t i = 0; i < src_scn->num_lights; ++i) {
-        tgt_scn->lights[offs_lights + i] = src_scn->lights[i];
-        ++tgt_scn->num_lights;
+    /* Ranges span several grains when run inline without workers, recompute them in fixed size batches */
+    for (size_t k = first; k < last; k += TRANSFORM_BATCH_SIZE) {
+        size_t count = last - k < TRANSFORM_BATCH_SIZE ? last - k : TRANSFORM_BATCH_SIZE;
+        transform_update_batch(job->h, nodes + k, count, job->generation);
     }
 }
 
-struct pri_params {
-    renderer_inputs* ri;
-    resmngr rm;
-};
+static void transform_queue(transform_hierarchy* h, size_t n, uint32_t generation)
+{
+    /* Stamping the generation up front keeps a node from being queued twice */
+    transform* t = h->transforms[n];
+    if (t->generation != generation) {
+        t->generation = generation;
+        h->changes[h->num_changes++] = n;
+    }
+}
 
-static void prepare_renderer_model_inputs_system(ecs_iter_t* it)
+static void transform_system(ecs_iter_t* it)
+{
+    (void) it;
+
+    /* Flatten hierarchy only when entities were added, removed or moved between tables */
+    transform_hierarchy* h = &ecs_internal.hierarchy;
+    if (transform_hierarchy_stale(h, ecs_internal.trs_query))
+        transform_hierarchy_build(h, ecs_internal.trs_query);
+
+    /* Begin a new generation, zero is reserved for never changed transforms */
+    if (++ecs_internal.generation == 0)
+        ++ecs_internal.generation;
+    h->num_changes = 0;
+
+    /* Update level by level, nodes within a level are independent of each other */
+    uint32_t generation = ecs_internal.generation;
+    size_t prev_begin = 0, prev_end = 0;
+    for (size_t l = 0; l < h->num_levels; ++l) {
+        size_t begin = h->num_changes;
+
+        /* Subtrees below nodes changed in the previous level follow them */
+        for (size_t k = prev_begin; k < prev_end; ++k) {
+            for (int32_t c = h->child_spans[h->changes[k]]; c >= 0; c = h->spans[c].next) {
+                const struct transform_span* sp = &h->spans[c];
+                for (int32_t i = 0; i < sp->count; ++i)
+                    transform_queue(h, sp->first + i, generation);
+            }
+        }
+
+        /* Poses are flagged in place by user systems, seed with the ones flagged within this level */
+        for (size_t i = h->levels[l]; i < h->levels[l + 1]; ++i)
+            if (h->transforms[i]->dirty)
+                transform_queue(h, i, generation);
+
+        /* Only changed nodes are dispatched, clean roots and unchanged subtrees are never visited */
+        if (h->num_changes > begin) {
+            transform_level_job job = {
+                .h          = h,
+                .offset     = begin,
+                .generation = generation,
+            };
+            threadpool_parallel_for(
+                ecs_internal.workers,
+                h->num_changes - begin,
+                TRANSFORM_UPDATE_GRAIN,
+                transform_update_range,
+                &job
+            );
+        }
+        prev_begin = begin;
+        prev_end = h->num_changes;
+    }
+
+    /* Resolve changed entities and propagate them to render proxies */
+    int lights_moved = 0;
+    for (size_t k = 0; k < h->num_changes; ++k) {
+        size_t i = h->changes[k];
+        h->changed_entities[k] = h->entities[i];
+        lights_moved |= proxy_sync_transform(h->entities[i], h->transforms[i]);
+    }
+    /* Invalidate probes once however many lights moved */
+    if (lights_moved)
+        probes_invalidate_all();
+}
+
+static void transform_added_system(ecs_iter_t* it)
+{
+    (void) it;
+    ++ecs_internal.structure;
+}
+
+static void transform_removed_system(ecs_iter_t* it)
+{
+    (void) it;
+    ++ecs_internal.structure;
+}
+
+static void camera_system(ecs_iter_t* it)
+{
+    camera* carr = ecs_column(it, camera, 1);
+
+    for (int32_t i = 0; i < it->count; ++i) {
+        camera* c = &carr[i];
+        camera_update(c, it->delta_time);
+    }
+}
+
+static void instance_proxy_set_system(ecs_iter_t* it)
 {
     ECS_COLUMN(it, transform, tarr, 1);
     ECS_COLUMN(it, model, marr, 2);
-    struct pri_params* pp = it->param;
 
-    /* Copy over data */
     for (int32_t i = 0; i < it->count; ++i) {
         /* Get component ptrs for current entity */
+        ecs_entity_t e = it->entities[i];
         transform* t = &tarr[i];
         model* m = &marr[i];
-        if (resmngr_handle_valid(m->resource)) {
-            /* Fetch scene for above model handle */
-            renderer_scene* entity_scn = resmngr_model_lookup(pp->rm, m->resource);
-            /* Merge given scene into render input scene */
-            merge_renderer_scenes(&pp->ri->scene, entity_scn, t->world_mat);
+        /* Fetch scene for model handle */
+        renderer_scene* scn = resmngr_handle_valid(m->resource)
+            ? resmngr_model_lookup(ecs_internal.rm, m->resource)
+            : 0;
+        if (!scn) {
+            instance_proxy_remove(e);
+            continue;
         }
+        /* Create or update instance proxy, level of detail history follows the scene nodes */
+        renderer_instance* ri = proxy_fetch(&ecs_internal.instances, e, 1);
+        if (!ri->lods || ri->model.index != m->resource.index || ri->model.generation != m->resource.generation) {
+            retire_render_data(ri->lods);
+            ri->lods = calloc(scn->num_nodes ? scn->num_nodes : 1, sizeof(*ri->lods));
+        }
+        /* Only the handle is kept, the model may be deleted while the entity lives on */
+        ri->model = m->resource;
+        ri->transform = t->world_mat;
+        probes_invalidate_near(world_position(ri->transform));
+    }
+}
+
+static void instance_proxy_unset_system(ecs_iter_t* it)
+{
+    for (int32_t i = 0; i < it->count; ++i) {
+        renderer_instance* ri = proxy_fetch(&ecs_internal.instances, it->entities[i], 0);
+        if (ri)
+            probes_invalidate_near(world_position(ri->transform));
+        instance_proxy_remove(it->entities[i]);
     }
 }
 
-static void prepare_renderer_light_inputs_system(ecs_iter_t* it)
+static void light_proxy_set_system(ecs_iter_t* it)
 {
     ECS_COLUMN(it, transform, tarr, 1);
     ECS_COLUMN(it, light, larr, 2);
-    struct pri_params* pp = it->param;
 
-    /* Copy over data */
     for (int32_t i = 0; i < it->count; ++i) {
         /* Get component ptrs for current entity */
         transform* t = &tarr[i];
         light* l = &larr[i];
-        /* Create empty scene with current light */
-        renderer_scene lscn = (renderer_scene){
-            .lights = {
-                [0] = (renderer_light){
-                    .color     = l->color,
-                    .intensity = l->intensity,
-                    .position  = t->pose.translation,
-                },
-            },
-            .num_lights = 1,
+        /* Create or update light proxy */
+        renderer_light* rl = proxy_fetch(&ecs_internal.lights, it->entities[i], 1);
+        *rl = (renderer_light){
+            .color     = l->color,
+            .intensity = l->intensity,
+            .radius    = l->radius,
+            .position  = world_position(t->world_mat),
+            .type      = l->radius > 0.0f ? RENDERER_LIGHT_TYPE_POINT : RENDERER_LIGHT_TYPE_DIRECTIONAL,
         };
-        /* Merge given scene into render input scene */
-        merge_renderer_scenes(&pp->ri->scene, &lscn, t->world_mat);
     }
+    /* Lighting changed everywhere */
+    probes_invalidate_all();
 }
 
-void ecs_prepare_renderer_inputs(ecs_world_t* world, renderer_inputs* ri, resmngr rm)
+static void light_proxy_unset_system(ecs_iter_t* it)
 {
-    (void)world;
+    for (int32_t i = 0; i < it->count; ++i)
+        proxy_remove(&ecs_internal.lights, it->entities[i]);
+    /* Lighting changed everywhere */
+    probes_invalidate_all();
+}
 
-    ecs_iter_t prm_it = ecs_query_iter(ecs_internal.prm_query);
-    prm_it.param = &(struct pri_params){ .ri = ri, .rm = rm };
-    while (ecs_query_next(&prm_it)) {
-        prepare_renderer_model_inputs_system(&prm_it);
-    }
+static void probe_proxy_set_system(ecs_iter_t* it)
+{
+    ECS_COLUMN(it, transform, tarr, 1);
+    ECS_COLUMN(it, probe, parr, 2);
 
-    ecs_iter_t prl_it = ecs_query_iter(ecs_internal.prl_query);
-    prl_it.param = &(struct pri_params){ .ri = ri, .rm = rm };
-    while (ecs_query_next(&prl_it)) {
-        prepare_renderer_light_inputs_system(&prl_it);
+    for (int32_t i = 0; i < it->count; ++i) {
+        /* Create or update probe proxy, forcing a recapture */
+        renderer_probe* rp = proxy_fetch(&ecs_internal.probes, it->entities[i], 1);
+        *rp = (renderer_probe){
+            .position = world_position(tarr[i].world_mat),
+            .radius   = parr[i].radius,
+            .id       = it->entities[i],
+            .version  = rp->version + 1,
+        };
     }
 }
 
+static void probe_proxy_unset_system(ecs_iter_t* it)
+{
+    for (int32_t i = 0; i < it->count; ++i)
+        proxy_remove(&ecs_internal.probes, it->entities[i]);
+}
+
+void ecs_prepare_renderer_inputs(ecs_world_t* world, renderer_inputs* ri)
+{
+    (void)world;
+
+    /* Proxies are kept up to date by the observers, just reference them */
+    ri->instances     = ecs_internal.instances.data.size ? slot_map_data(&ecs_internal.instances.data, 0) : 0;
+    ri->num_instances = ecs_internal.instances.data.size;
+    /* Resolve model scenes for this frame only, instances of deleted models resolve to null and are skipped */
+    for (size_t i = 0; i < ri->num_instances; ++i)
+        ri->instances[i].scene = resmngr_model_lookup(ecs_internal.rm, ri->instances[i].model);
+    ri->lights        = ecs_internal.lights.data.size ? slot_map_data(&ecs_internal.lights.data, 0) : 0;
+    ri->num_lights    = ecs_internal.lights.data.size;
+    ri->probes        = ecs_internal.probes.data.size ? slot_map_data(&ecs_internal.probes.data, 0) : 0;
+    ri->num_probes    = ecs_internal.probes.data.size;
+}
+
 void ecs_free_render_inputs(ecs_world_t* world, renderer_inputs* ri)
 {
     (void) world;
     (void) ri;
+
+    /* The frame is over, nothing references the retired proxy data anymore */
+    for (size_t i = 0; i < ecs_internal.num_retired; ++i)
+        free(ecs_internal.retired[i]);
+    ecs_internal.num_retired = 0;
+}
+
+void ecs_take_retired_render_data(ecs_world_t* world, void*** ptrs, size_t* count)
+{
+    (void) world;
+    *ptrs = ecs_internal.retired;
+    *count = ecs_internal.num_retired;
+    ecs_internal.retired = 0;
+    ecs_internal.num_retired = 0;
+    ecs_internal.cap_retired = 0;
+}
+
+uint32_t ecs_transform_generation(ecs_world_t* world)
+{
+    (void)world;
+    return ecs_internal.generation;
+}
+
+void ecs_fetch_transform_changes(ecs_world_t* world, const ecs_entity_t** entities, size_t* num_entities)
+{
+    (void)world;
+    *entities = ecs_internal.hierarchy.changed_entities;
+    *num_entities = ecs_internal.hierarchy.num_changes;
 }
 
 void ecs_fetch_cameras(ecs_world_t* world, void* cameras[ECS_MAX_CAMERAS], size_t* num_cameras)
@@ -275,12 +641,20 @@ void ecs_fetch_cameras(ecs_world_t* world, void* cameras[ECS_MAX_CAMERAS], size_
     }
 }
 
-void ecs_setup_internal(ecs_world_t* world)
+void ecs_setup_internal(ecs_world_t* world, resmngr rm, threadpool_t* workers)
 {
+    /* Initialize render proxy storage */
+    ecs_internal.rm = rm;
+    ecs_internal.workers = workers;
+    proxy_set_init(&ecs_internal.instances, sizeof(renderer_instance));
+    proxy_set_init(&ecs_internal.lights, sizeof(renderer_light));
+    proxy_set_init(&ecs_internal.probes, sizeof(renderer_probe));
+
     /* Register internal component types */
     ECS_COMPONENT(world, transform);
     ECS_COMPONENT(world, model);
     ECS_COMPONENT(world, light);
+    ECS_COMPONENT(world, probe);
     ECS_COMPONENT(world, camera);
 
     /* Register internal lifecycle callbacks */
@@ -289,14 +663,40 @@ void ecs_setup_internal(ecs_world_t* world)
     ecs_set_component_actions(world, camera, { .ctor = ecs_ctor(camera) });
 
     /* Register internal systems */
-    ECS_SYSTEM(world, transform_system, EcsOnUpdate, transform, CASCADE:transform);
+    ECS_SYSTEM(world, transform_system, EcsOnUpdate, 0);
     ECS_SYSTEM(world, camera_system, EcsOnUpdate, camera);
 
+    /* Register transform storage observers */
+    ECS_SYSTEM(world, transform_added_system, EcsOnAdd, transform);
+    ECS_SYSTEM(world, transform_removed_system, EcsOnRemove, transform);
+
+    /* Register render proxy observers */
+    ECS_SYSTEM(world, instance_proxy_set_system, EcsOnSet, transform, model);
+    ECS_SYSTEM(world, instance_proxy_unset_system, EcsUnSet, transform, model);
+    ECS_SYSTEM(world, light_proxy_set_system, EcsOnSet, transform, light);
+    ECS_SYSTEM(world, light_proxy_unset_system, EcsUnSet, transform, light);
+    ECS_SYSTEM(world, probe_proxy_set_system, EcsOnSet, transform, probe);
+    ECS_SYSTEM(world, probe_proxy_unset_system, EcsUnSet, transform, probe);
+
     /* Create queries */
-    ecs_query_t* prm_query = ecs_query_new(world, "transform, model");
-    ecs_query_t* prl_query = ecs_query_new(world, "transform, light");
     ecs_query_t* prc_query = ecs_query_new(world, "camera");
-    ecs_internal.prm_query = prm_query;
-    ecs_internal.prl_query = prl_query;
     ecs_internal.prc_query = prc_query;
+    ecs_query_t* trs_query = ecs_query_new(world, "transform, CASCADE:transform");
+    ecs_internal.trs_query = trs_query;
+}
+
+void ecs_free_internal()
+{
+    renderer_instance* instances = ecs_internal.instances.data.size ? slot_map_data(&ecs_internal.instances.data, 0) : 0;
+    for (size_t i = 0; i < ecs_internal.instances.data.size; ++i)
+        free(instances[i].lods);
+    for (size_t i = 0; i < ecs_internal.num_retired; ++i)
+        free(ecs_internal.retired[i]);
+    free(ecs_internal.retired);
+    ecs_internal.retired = 0;
+    ecs_internal.num_retired = ecs_internal.cap_retired = 0;
+    proxy_set_destroy(&ecs_internal.instances);
+    proxy_set_destroy(&ecs_internal.lights);
+    proxy_set_destroy(&ecs_internal.probes);
+    transform_hierarchy_free(&ecs_internal.hierarchy);
 }
@@ -34,18 +34,33 @@
 #include <flecs.h>
 #include "renderer.h"
 #include "resmngr.h"
+#include "thread_pool.h"
 
 #define ECS_MAX_CAMERAS (16)
 
-/* Registers internal components and systems */
-void ecs_setup_internal(ecs_world_t* world);
+/* Registers internal components and systems, heavy systems dispatch work to the given workers */
+void ecs_setup_internal(ecs_world_t* world, resmngr rm, threadpool_t* workers);
 
-/* Runs internal system to prepare render object list */
-void ecs_prepare_renderer_inputs(ecs_world_t* world, renderer_inputs* ri, resmngr rm);
+/* Frees internal render proxy storage, must be called after world destruction */
+void ecs_free_internal();
 
-/* Frees allocated resources used by render object list */
+/* Fills renderer inputs with references to the retained render proxies */
+void ecs_prepare_renderer_inputs(ecs_world_t* world, renderer_inputs* ri);
+
+/* Frees allocated resources used by render object list, along with the proxy data retired since the last call */
 void ecs_free_render_inputs(ecs_world_t* world, renderer_inputs* ri);
 
+/* Hands over the proxy data retired since the last call instead of freeing it, for inputs rendered later on.
+ * The caller frees each pointer and the array itself once no inputs referencing them are in flight */
+void ecs_take_retired_render_data(ecs_world_t* world, void*** ptrs, size_t* count);
+
+/* Returns the generation of the last transform update, transforms whose
+ * generation field matches it had their world matrix changed in that update */
+uint32_t ecs_transform_generation(ecs_world_t* world);
+
+/* Fetches the entities whose world transform changed during the last transform update */
+void ecs_fetch_transform_changes(ecs_world_t* world, const ecs_entity_t** entities, size_t* num_entities);
+
 /* Runs internal system to fetch camera object list */
 void ecs_fetch_cameras(ecs_world_t* world, void* cameras[ECS_MAX_CAMERAS], size_t* num_cameras);
 
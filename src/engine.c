@@ -1,6 +1,7 @@
 #include "engine.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "mainloop.h"
 #include "window.h"
 #include "opengl.h"
@@ -9,8 +10,27 @@
 #include "ecs.h"
 #include "embedded.h"
 #include "text.h"
+#include "ptime.h"
+#include "threads.h"
 
 #define FONT_INTERNAL "fonts/noto_mono.ttf"
+#define FRAME_ARENA_BLOCK_SIZE (1024 * 1024)
+#define ENGINE_WORKER_THREADS (4)
+#define PERF_SMOOTHING (0.05f) /* Weight of the newest sample in the overlay timings */
+#define ENGINE_MAX_SNAPSHOTS (3)
+
+/* Renderer inputs frozen by the update thread, consumed by the render thread */
+typedef struct frame_snapshot {
+    renderer_inputs ri;     /* Proxy arrays are copies living in mem */
+    struct arena mem;       /* Also serves as the frame memory of the renderer */
+    void** retired;         /* Proxy data released before the snapshot was taken, freed once it is rendered */
+    size_t num_retired;
+    void** deleted_models;  /* Model scenes deleted before the snapshot was taken, released once it is rendered */
+    size_t num_deleted_models;
+    float gather_msec;
+    float update_msec;      /* Mainloop averages when the snapshot was taken */
+    float total_msec;
+} frame_snapshot;
 
 struct engine {
     engine_params params;
@@ -18,11 +38,33 @@ struct engine {
     mainloop_perf_data ml_perf_data;
     window wnd;
     renderer renderer;
+    struct arena frame_mem;
+    threadpool_t* workers;
     resmngr rmgr;
     ecs_world_t* world;
     camera cam;
     text_renderer text_renderer;
     rid font;
+    /* Smoothed CPU timings of the render callback stages, in msec */
+    struct {
+        float gather;   /* Renderer inputs from the ecs */
+        float prepare;  /* Renderer culling, batching and uploads */
+        float submit;   /* Renderer GPU command submission */
+        float swap;     /* Backbuffer swap, blocks when the GPU is behind */
+        float update;   /* Mainloop averages of the thread that produced the rendered inputs */
+        float total;
+    } perf;
+    /* Render thread, snapshots are published and rendered in ring order */
+    struct {
+        frame_snapshot snapshots[ENGINE_MAX_SNAPSHOTS];
+        size_t num_snapshots;  /* Zero when rendering in place */
+        size_t published;      /* Snapshots handed to the render thread so far */
+        size_t rendered;       /* Snapshots the render thread is done with so far */
+        int stop;
+        mtx_t lock;
+        cnd_t cond;            /* Signaled on every publish, render and stop */
+        thrd_t thread;
+    } pipeline;
 };
 
 static void on_opengl_error(void* userdata, const char* msg)
@@ -86,18 +128,26 @@ engine engine_create(const engine_params* params)
     int fbwidth, fbheight;
     window_get_framebuffer_size(e->wnd, &fbwidth, &fbheight);
 
+    /* Create worker threads for parallel systems */
+    e->workers = threadpool_create(ENGINE_WORKER_THREADS, THREAD_POOL_MAX_QUEUE);
+
     /* Create renderer instance */
     e->renderer = renderer_create(&(renderer_params){
-        .width  = fbwidth,
-        .height = fbheight
+        .width   = fbwidth,
+        .height  = fbheight,
+        .workers = e->workers,
     });
 
+    /* Create per frame linear allocator */
+    arena_init(&e->frame_mem, FRAME_ARENA_BLOCK_SIZE);
+
     /* Create resource manager instance */
     e->rmgr = resmngr_create();
+    resmngr_set_vertex_quantization(e->rmgr, params->quantize_vertices);
 
     /* Create world instance */
     e->world = ecs_init();
-    ecs_setup_internal(e->world);
+    ecs_setup_internal(e->world, e->rmgr, e->workers);
 
     /* Create text renderer instance */
     e->text_renderer = text_renderer_create();
@@ -107,6 +157,15 @@ engine engine_create(const engine_params* params)
     embedded_file(&font_data, &font_sz, FONT_INTERNAL);
     e->font = resmngr_font_from_ttf_data(e->rmgr, font_data, font_sz);
 
+    /* Setup snapshot ring for the render thread */
+    if (params->render_snapshots >= 2) {
+        e->pipeline.num_snapshots = params->render_snapshots < ENGINE_MAX_SNAPSHOTS ? params->render_snapshots : ENGINE_MAX_SNAPSHOTS;
+        for (size_t i = 0; i < e->pipeline.num_snapshots; ++i)
+            arena_init(&e->pipeline.snapshots[i].mem, FRAME_ARENA_BLOCK_SIZE);
+        mtx_init(&e->pipeline.lock, mtx_plain);
+        cnd_init(&e->pipeline.cond);
+    }
+
     return e;
 }
 
@@ -151,8 +210,9 @@ static camera* pick_active_camera(engine e)
 
 void engine_update(engine e, float dt)
 {
-    /* Process pending loading operations */
-    resmngr_process(e->rmgr);
+    /* Process pending loading operations, uploads are left to the render thread when there is one */
+    if (!e->pipeline.num_snapshots)
+        resmngr_process(e->rmgr);
 
     /* Pick active camera reference */
     camera* cam = pick_active_camera(e);
@@ -175,20 +235,29 @@ void engine_update(engine e, float dt)
     ecs_progress(e->world, dt);
 }
 
-static void engine_render_perf_info(engine e)
+static void engine_render_perf_info(void* userdata)
 {
+    engine e = userdata;
+
     /* Alias screen width and height */
     const int width = e->params.width, height = e->params.height;
 
-    /* Construct perf text */
-    char perf_text[256];
-    float msec = e->ml_perf_data.total.average;
-    float updt = e->ml_perf_data.update.average;
-    float rndt = e->ml_perf_data.render.average;
-    snprintf(perf_text,
+    /* Construct perf text, GPU times come from timer queries of a previous frame */
+    char perf_text[TEXT_MAX_CHARS];
+    float msec = e->perf.total;
+    float updt = e->perf.update;
+    renderer_frame_timings rt;
+    renderer_timings(e->renderer, &rt);
+    int len = snprintf(perf_text,
              sizeof(perf_text),
-             "%.0f FPS %.2f|%.2f|%.2f (CPU|GPU|TOT)",
-             1000.0f / msec, updt, rndt, msec);
+             "%.0f FPS %.2f (TOT)\n"
+             "CPU %.2f|%.2f|%.2f|%.2f|%.2f (UPD|GTH|PRP|SUB|SWP)\n"
+             "GPU %.2f",
+             1000.0f / msec, msec,
+             updt, e->perf.gather, e->perf.prepare, e->perf.submit, e->perf.swap,
+             rt.gpu_msec);
+    for (size_t i = 0; i < rt.num_passes && len > 0 && (size_t)len < sizeof(perf_text); ++i)
+        len += snprintf(perf_text + len, sizeof(perf_text) - len, "\n  %s %.2f", rt.passes[i].name, rt.passes[i].msec);
 
     /* Render perf text */
     float aspect_ratio = (float)width/height;
@@ -207,38 +276,201 @@ static void engine_render_perf_info(engine e)
     });
 }
 
+/* Renders and shows a frame, accumulating the stage timings */
+static void engine_present(engine e, renderer_inputs* ri, float gather, float update, float total)
+{
+    e->perf.update = update;
+    e->perf.total = total;
+
+    /* Render the frame */
+    renderer_frame(e->renderer, ri);
+
+    /* Show backbuffer */
+    uint64_t t0 = time_now();
+    window_swap_buffers(e->wnd);
+    float swap = (float)time_msec(time_since(t0));
+
+    /* Accumulate stage timings */
+    renderer_frame_timings rt;
+    renderer_timings(e->renderer, &rt);
+    e->perf.gather  += (gather          - e->perf.gather)  * PERF_SMOOTHING;
+    e->perf.prepare += (rt.prepare_msec - e->perf.prepare) * PERF_SMOOTHING;
+    e->perf.submit  += (rt.submit_msec  - e->perf.submit)  * PERF_SMOOTHING;
+    e->perf.swap    += (swap            - e->perf.swap)    * PERF_SMOOTHING;
+}
+
 void engine_render(engine e, float dt)
 {
     (void) dt;
 
+    /* Release previous frame's transient data */
+    arena_reset(&e->frame_mem);
+
     /* Gather data needed by renderer from the ecs */
-    renderer_inputs ri = {.view = camera_view(&e->cam)};
-    ecs_prepare_renderer_inputs(e->world, &ri, e->rmgr);
+    renderer_inputs ri = {
+        .view         = camera_view(&e->cam),
+        .frame_mem    = &e->frame_mem,
+        .overlay      = engine_render_perf_info, /* Perf text, drawn as the last pass of the frame */
+        .overlay_data = e,
+    };
+    uint64_t t0 = time_now();
+    ecs_prepare_renderer_inputs(e->world, &ri);
+    float gather = (float)time_msec(time_since(t0));
 
-    /* Render the frame */
-    renderer_frame(e->renderer, ri);
+    /* Render and show the frame */
+    engine_present(e, &ri, gather, e->ml_perf_data.update.average, e->ml_perf_data.total.average);
 
     /* Free intermediate renderer input data */
     ecs_free_render_inputs(e->world, &ri);
 
-    /* Render performance info */
-    engine_render_perf_info(e);
+    /* Models deleted up to now are not referenced by any frame anymore */
+    void** deleted; size_t num_deleted;
+    resmngr_take_deleted_models(e->rmgr, &deleted, &num_deleted);
+    for (size_t i = 0; i < num_deleted; ++i)
+        resmngr_model_release(deleted[i]);
+    free(deleted);
+}
 
-    /* Show backbuffer */
-    window_swap_buffers(e->wnd);
+static void* snapshot_copy(struct arena* mem, const void* data, size_t count, size_t size)
+{
+    if (count == 0)
+        return 0;
+    void* copy = arena_alloc(mem, count * size);
+    memcpy(copy, data, count * size);
+    return copy;
+}
+
+/* Mainloop render callback of the update thread when rendering on a dedicated thread */
+static void engine_snapshot(engine e, float dt)
+{
+    (void) dt;
+
+    /* Wait for the render thread to be done with the next snapshot of the ring */
+    mtx_lock(&e->pipeline.lock);
+    while (e->pipeline.published - e->pipeline.rendered >= e->pipeline.num_snapshots)
+        cnd_wait(&e->pipeline.cond, &e->pipeline.lock);
+    mtx_unlock(&e->pipeline.lock);
+    frame_snapshot* s = &e->pipeline.snapshots[e->pipeline.published % e->pipeline.num_snapshots];
+    arena_reset(&s->mem);
+
+    /* Copy the proxies, as the ecs keeps updating them while the snapshot is rendered */
+    uint64_t t0 = time_now();
+    renderer_inputs refs = {0};
+    ecs_prepare_renderer_inputs(e->world, &refs);
+    s->ri = (renderer_inputs){
+        .instances     = snapshot_copy(&s->mem, refs.instances, refs.num_instances, sizeof(*refs.instances)),
+        .num_instances = refs.num_instances,
+        .lights        = snapshot_copy(&s->mem, refs.lights, refs.num_lights, sizeof(*refs.lights)),
+        .num_lights    = refs.num_lights,
+        .probes        = snapshot_copy(&s->mem, refs.probes, refs.num_probes, sizeof(*refs.probes)),
+        .num_probes    = refs.num_probes,
+        .view          = camera_view(&e->cam),
+        .frame_mem     = &s->mem,
+        .overlay       = engine_render_perf_info,
+        .overlay_data  = e,
+    };
+    /* Earlier snapshots may still reference the retired proxy data, they are all rendered before this one */
+    ecs_take_retired_render_data(e->world, &s->retired, &s->num_retired);
+    resmngr_take_deleted_models(e->rmgr, &s->deleted_models, &s->num_deleted_models);
+    s->gather_msec = (float)time_msec(time_since(t0));
+    s->update_msec = e->ml_perf_data.update.average;
+    s->total_msec  = e->ml_perf_data.total.average;
+
+    /* Publish */
+    mtx_lock(&e->pipeline.lock);
+    ++e->pipeline.published;
+    cnd_broadcast(&e->pipeline.cond);
+    mtx_unlock(&e->pipeline.lock);
+}
+
+/* Renders published snapshots in order until stopped, with the graphics context current */
+static int engine_render_thread(void* arg)
+{
+    engine e = arg;
+    window_make_context_current(e->wnd);
+
+    mtx_lock(&e->pipeline.lock);
+    for (;;) {
+        while (e->pipeline.rendered == e->pipeline.published && !e->pipeline.stop)
+            cnd_wait(&e->pipeline.cond, &e->pipeline.lock);
+        if (e->pipeline.rendered == e->pipeline.published)
+            break;
+        frame_snapshot* s = &e->pipeline.snapshots[e->pipeline.rendered % e->pipeline.num_snapshots];
+        mtx_unlock(&e->pipeline.lock);
+
+        /* Uploads of loaded resources are gfx calls as well */
+        resmngr_process(e->rmgr);
+        engine_present(e, &s->ri, s->gather_msec, s->update_msec, s->total_msec);
+        for (size_t i = 0; i < s->num_retired; ++i)
+            free(s->retired[i]);
+        free(s->retired);
+        s->retired = 0;
+        s->num_retired = 0;
+        for (size_t i = 0; i < s->num_deleted_models; ++i)
+            resmngr_model_release(s->deleted_models[i]);
+        free(s->deleted_models);
+        s->deleted_models = 0;
+        s->num_deleted_models = 0;
+
+        mtx_lock(&e->pipeline.lock);
+        ++e->pipeline.rendered;
+        cnd_broadcast(&e->pipeline.cond);
+    }
+    mtx_unlock(&e->pipeline.lock);
+
+    window_make_context_current(0);
+    return 0;
 }
 
 void engine_run(engine e)
 {
+    /* Hand the graphics context over to the render thread, the mainloop only takes snapshots then */
+    int pipelined = e->pipeline.num_snapshots != 0;
+    if (pipelined) {
+        e->pipeline.stop = 0;
+        window_make_context_current(0);
+        thrd_create(&e->pipeline.thread, engine_render_thread, e);
+    }
+
     /* Run main loop */
     e->ml_params = (mainloop_params){
         .update_callback = (mainloop_update_fn) engine_update,
-        .render_callback = (mainloop_render_fn) engine_render,
+        .render_callback = (mainloop_render_fn) (pipelined ? engine_snapshot : engine_render),
         .updates_per_sec = 60,
         .userdata = e
     };
     e->ml_perf_data = (mainloop_perf_data){};
     mainloop(&e->ml_params, &e->ml_perf_data);
+
+    /* Let the render thread finish the published snapshots and take the context back */
+    if (pipelined) {
+        mtx_lock(&e->pipeline.lock);
+        e->pipeline.stop = 1;
+        cnd_broadcast(&e->pipeline.cond);
+        mtx_unlock(&e->pipeline.lock);
+        thrd_join(e->pipeline.thread, 0);
+        window_make_context_current(e->wnd);
+    }
+}
+
+int engine_load_probes(engine e, const char* fpath)
+{
+    return renderer_load_probes(e->renderer, fpath);
+}
+
+void engine_bake_probes(engine e, const char* fpath)
+{
+    renderer_bake_probes(e->renderer, fpath);
+}
+
+int engine_load_pipeline_manifest(engine e, const char* fpath)
+{
+    return renderer_load_pipeline_manifest(e->renderer, fpath);
+}
+
+int engine_save_pipeline_manifest(engine e, const char* fpath)
+{
+    return renderer_save_pipeline_manifest(e->renderer, fpath);
 }
 
 void engine_stop(engine e)
@@ -256,6 +488,21 @@ void engine_destroy(engine e)
 
     /* Destroy world instance */
     ecs_fini(e->world);
+    ecs_free_internal();
+
+    /* Stop worker threads */
+    threadpool_destroy(e->workers, 0);
+
+    /* Destroy per frame linear allocator */
+    arena_destroy(&e->frame_mem);
+
+    /* Destroy snapshot ring */
+    if (e->pipeline.num_snapshots) {
+        for (size_t i = 0; i < e->pipeline.num_snapshots; ++i)
+            arena_destroy(&e->pipeline.snapshots[i].mem);
+        cnd_destroy(&e->pipeline.cond);
+        mtx_destroy(&e->pipeline.lock);
+    }
 
     /* Destroy renderer instance */
     renderer_destroy(e->renderer);
@@ -0,0 +1,589 @@
+#include "frame_graph.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NONE (~(size_t)0)
+
+/* Grows a dynamic array to hold at least n elements */
+#define ARRAY_RESERVE(arr, cap, n) do {                          \
+    if ((n) > (cap)) {                                           \
+        (cap) = (cap) ? (cap) * 2 : 16;                          \
+        if ((cap) < (n)) (cap) = (n);                            \
+        (arr) = realloc((arr), (cap) * sizeof(*(arr)));          \
+    }                                                            \
+} while (0)
+
+/* Logical texture of the current frame */
+typedef struct fg_texture {
+    const char* name;
+    gfx_image_desc desc;
+    gfx_image imported;   /* Backing image of imported textures */
+    int is_imported;
+    int is_backbuffer;
+    size_t first_use;     /* Execution order position of first and last pass using it */
+    size_t last_use;
+    size_t physical;      /* Pooled image backing transient textures */
+} fg_texture;
+
+/* Texture contents as produced by a single pass */
+typedef struct fg_version {
+    size_t texture;
+    size_t writer;        /* Pass producing this version, NONE for initial contents */
+    size_t prev;          /* Version overwritten by this one */
+} fg_version;
+
+typedef struct fg_attachment {
+    frame_graph_resource res;
+    int slice;
+} fg_attachment;
+
+typedef struct fg_pass {
+    const char* name;
+    gfx_pass_action action;
+    frame_graph_execute_fn fn;
+    void* data;
+    fg_attachment colors[GFX_MAX_COLOR_ATTACHMENTS];
+    size_t num_colors;
+    fg_attachment depth;
+    frame_graph_resource reads[FRAME_GRAPH_MAX_PASS_READS];
+    size_t num_reads;
+    int needed;
+} fg_pass;
+
+/* Image shared by transient textures across and within frames */
+typedef struct fg_physical {
+    gfx_image_desc desc;
+    gfx_image img;
+    uint64_t last_frame;  /* Last frame it backed a texture */
+    size_t busy_until;    /* Last execution position of its current occupant */
+} fg_physical;
+
+/* Render target set along with the pass object binding it */
+typedef struct fg_target {
+    gfx_image colors[GFX_MAX_COLOR_ATTACHMENTS];
+    int color_slices[GFX_MAX_COLOR_ATTACHMENTS];
+    size_t num_colors;
+    gfx_image depth;
+    int depth_slice;
+    int is_backbuffer;
+    int width, height;
+} fg_target;
+
+typedef struct fg_cached_pass {
+    fg_target target;
+    gfx_pass pass;
+    uint64_t last_frame;
+} fg_cached_pass;
+
+struct frame_graph {
+    uint64_t frame;
+    gpu_timer timer;
+    /* Frame records */
+    fg_texture* textures; size_t num_textures, cap_textures;
+    fg_version* versions; size_t num_versions, cap_versions;
+    fg_pass* passes;      size_t num_passes,   cap_passes;
+    /* Persistent pools */
+    fg_physical* physicals; size_t num_physicals, cap_physicals;
+    fg_cached_pass* cached; size_t num_cached,    cap_cached;
+};
+
+frame_graph frame_graph_create()
+{
+    frame_graph fg = calloc(1, sizeof(*fg));
+    return fg;
+}
+
+void frame_graph_destroy(frame_graph fg)
+{
+    for (size_t i = 0; i < fg->num_cached; ++i)
+        gfx_destroy_pass(fg->cached[i].pass);
+    for (size_t i = 0; i < fg->num_physicals; ++i)
+        gfx_destroy_image(fg->physicals[i].img);
+    free(fg->textures);
+    free(fg->versions);
+    free(fg->passes);
+    free(fg->physicals);
+    free(fg->cached);
+    free(fg);
+}
+
+void frame_graph_set_timer(frame_graph fg, gpu_timer gt)
+{
+    fg->timer = gt;
+}
+
+void frame_graph_begin(frame_graph fg)
+{
+    ++fg->frame;
+    fg->num_textures = 0;
+    fg->num_versions = 0;
+    fg->num_passes = 0;
+}
+
+static frame_graph_resource add_version(frame_graph fg, size_t texture, size_t writer, size_t prev)
+{
+    ARRAY_RESERVE(fg->versions, fg->cap_versions, fg->num_versions + 1);
+    fg->versions[fg->num_versions] = (fg_version){
+        .texture = texture,
+        .writer  = writer,
+        .prev    = prev,
+    };
+    return (frame_graph_resource)fg->num_versions++;
+}
+
+static frame_graph_resource add_texture(frame_graph fg, fg_texture* tex)
+{
+    ARRAY_RESERVE(fg->textures, fg->cap_textures, fg->num_textures + 1);
+    tex->first_use = NONE;
+    tex->last_use = 0;
+    tex->physical = NONE;
+    fg->textures[fg->num_textures] = *tex;
+    return add_version(fg, fg->num_textures++, NONE, NONE);
+}
+
+frame_graph_resource frame_graph_create_texture(frame_graph fg, const char* name, const gfx_image_desc* desc)
+{
+    fg_texture tex = { .name = name, .desc = *desc };
+    tex.desc.render_target = 1;
+    return add_texture(fg, &tex);
+}
+
+frame_graph_resource frame_graph_import_texture(frame_graph fg, const char* name, gfx_image img)
+{
+    return add_texture(fg, &(fg_texture){ .name = name, .imported = img, .is_imported = 1 });
+}
+
+frame_graph_resource frame_graph_import_backbuffer(frame_graph fg, int width, int height)
+{
+    return add_texture(fg, &(fg_texture){
+        .name = "backbuffer",
+        .desc = { .width = width, .height = height },
+        .is_imported = 1,
+        .is_backbuffer = 1,
+    });
+}
+
+size_t frame_graph_add_pass(frame_graph fg, const char* name, const gfx_pass_action* action, frame_graph_execute_fn fn, void* data)
+{
+    ARRAY_RESERVE(fg->passes, fg->cap_passes, fg->num_passes + 1);
+    fg->passes[fg->num_passes] = (fg_pass){
+        .name   = name,
+        .action = *action,
+        .fn     = fn,
+        .data   = data,
+        .depth  = { .res = FRAME_GRAPH_RESOURCE_INVALID },
+    };
+    return fg->num_passes++;
+}
+
+void frame_graph_read(frame_graph fg, size_t pass, frame_graph_resource res)
+{
+    fg_pass* p = &fg->passes[pass];
+    assert(p->num_reads < FRAME_GRAPH_MAX_PASS_READS);
+    p->reads[p->num_reads++] = res;
+}
+
+frame_graph_resource frame_graph_write_color(frame_graph fg, size_t pass, frame_graph_resource res, int slice)
+{
+    fg_pass* p = &fg->passes[pass];
+    assert(p->num_colors < GFX_MAX_COLOR_ATTACHMENTS);
+    frame_graph_resource nv = add_version(fg, fg->versions[res].texture, pass, res);
+    p->colors[p->num_colors++] = (fg_attachment){ .res = nv, .slice = slice };
+    return nv;
+}
+
+frame_graph_resource frame_graph_write_depth(frame_graph fg, size_t pass, frame_graph_resource res, int slice)
+{
+    fg_pass* p = &fg->passes[pass];
+    frame_graph_resource nv = add_version(fg, fg->versions[res].texture, pass, res);
+    p->depth = (fg_attachment){ .res = nv, .slice = slice };
+    return nv;
+}
+
+gfx_image frame_graph_image(frame_graph fg, frame_graph_resource res)
+{
+    fg_texture* tex = &fg->textures[fg->versions[res].texture];
+    if (tex->is_imported)
+        return tex->imported;
+    return tex->physical != NONE ? fg->physicals[tex->physical].img : (gfx_image){0};
+}
+
+/*
+ * Scheduling
+ */
+
+static int action_keeps(gfx_action a)
+{
+    /* Default actions clear */
+    return a == GFX_ACTION_LOAD || a == GFX_ACTION_DONTCARE;
+}
+
+static int pass_is_backbuffer(frame_graph fg, fg_pass* p)
+{
+    return p->num_colors > 0 && fg->textures[fg->versions[p->colors[0].res].texture].is_backbuffer;
+}
+
+static int pass_has_targets(fg_pass* p)
+{
+    return p->num_colors > 0 || p->depth.res != FRAME_GRAPH_RESOURCE_INVALID;
+}
+
+static int pass_clears(frame_graph fg, fg_pass* p)
+{
+    for (size_t i = 0; i < p->num_colors; ++i)
+        if (!action_keeps(p->action.colors[i].action))
+            return 1;
+    /* Default framebuffer always comes with a depth stencil buffer */
+    if (p->depth.res != FRAME_GRAPH_RESOURCE_INVALID || pass_is_backbuffer(fg, p))
+        return !action_keeps(p->action.depth.action) || !action_keeps(p->action.stencil.action);
+    return 0;
+}
+
+static int attachments_equal(frame_graph fg, fg_attachment* a, fg_attachment* b)
+{
+    int va = a->res != FRAME_GRAPH_RESOURCE_INVALID, vb = b->res != FRAME_GRAPH_RESOURCE_INVALID;
+    if (!va || !vb)
+        return va == vb;
+    return fg->versions[a->res].texture == fg->versions[b->res].texture && a->slice == b->slice;
+}
+
+/* Passes rendering into the same textures, which can share a begin/end */
+static int same_targets(frame_graph fg, fg_pass* a, fg_pass* b)
+{
+    if (!pass_has_targets(a) || a->num_colors != b->num_colors)
+        return 0;
+    for (size_t i = 0; i < a->num_colors; ++i)
+        if (!attachments_equal(fg, &a->colors[i], &b->colors[i]))
+            return 0;
+    return attachments_equal(fg, &a->depth, &b->depth);
+}
+
+/* Calls fn for every version written by given pass */
+#define FOR_EACH_WRITE(p, v, body) do {                          \
+    for (size_t _w = 0; _w <= (p)->num_colors; ++_w) {           \
+        frame_graph_resource v = _w < (p)->num_colors            \
+            ? (p)->colors[_w].res : (p)->depth.res;              \
+        if (v == FRAME_GRAPH_RESOURCE_INVALID) continue;         \
+        body                                                     \
+    }                                                            \
+} while (0)
+
+static void mark_needed(frame_graph fg, size_t pass, size_t* stack, size_t* top)
+{
+    if (pass == NONE || fg->passes[pass].needed)
+        return;
+    fg->passes[pass].needed = 1;
+    stack[(*top)++] = pass;
+}
+
+static void cull_passes(frame_graph fg)
+{
+    /* Passes writing imported textures are kept, along with everything they transitively depend on */
+    size_t* stack = malloc((fg->num_passes ? fg->num_passes : 1) * sizeof(*stack));
+    size_t top = 0;
+    for (size_t i = 0; i < fg->num_passes; ++i) {
+        fg_pass* p = &fg->passes[i];
+        FOR_EACH_WRITE(p, v, {
+            if (fg->textures[fg->versions[v].texture].is_imported)
+                mark_needed(fg, i, stack, &top);
+        });
+    }
+    while (top > 0) {
+        fg_pass* p = &fg->passes[stack[--top]];
+        for (size_t r = 0; r < p->num_reads; ++r)
+            mark_needed(fg, fg->versions[p->reads[r]].writer, stack, &top);
+        FOR_EACH_WRITE(p, v, {
+            mark_needed(fg, fg->versions[fg->versions[v].prev].writer, stack, &top);
+        });
+    }
+    free(stack);
+}
+
+typedef struct fg_edge { size_t from, to; } fg_edge;
+
+static void push_edge(fg_edge** edges, size_t* num, size_t* cap, size_t from, size_t to)
+{
+    if (from == NONE || from == to)
+        return;
+    ARRAY_RESERVE(*edges, *cap, *num + 1);
+    (*edges)[(*num)++] = (fg_edge){ from, to };
+}
+
+/* Orders needed passes, returns their count */
+static size_t schedule_passes(frame_graph fg, size_t* order)
+{
+    const size_t np = fg->num_passes, nv = fg->num_versions;
+
+    /* Pass overwriting each version, for write after read hazards */
+    size_t* overwriter = malloc(nv * sizeof(*overwriter));
+    for (size_t v = 0; v < nv; ++v)
+        overwriter[v] = NONE;
+    for (size_t v = 0; v < nv; ++v)
+        if (fg->versions[v].prev != NONE)
+            overwriter[fg->versions[v].prev] = fg->versions[v].writer;
+
+    /* Gather dependencies: read after write, write after write and write after read */
+    fg_edge* edges = 0; size_t num_edges = 0, cap_edges = 0;
+    for (size_t i = 0; i < np; ++i) {
+        fg_pass* p = &fg->passes[i];
+        if (!p->needed)
+            continue;
+        for (size_t r = 0; r < p->num_reads; ++r) {
+            frame_graph_resource v = p->reads[r];
+            push_edge(&edges, &num_edges, &cap_edges, fg->versions[v].writer, i);
+            size_t ow = overwriter[v];
+            if (ow != NONE && fg->passes[ow].needed)
+                push_edge(&edges, &num_edges, &cap_edges, i, ow);
+        }
+        FOR_EACH_WRITE(p, v, {
+            push_edge(&edges, &num_edges, &cap_edges, fg->versions[fg->versions[v].prev].writer, i);
+        });
+    }
+
+    /* Adjacency in compressed form */
+    size_t* indeg = calloc(np, sizeof(*indeg));
+    size_t* first = calloc(np + 1, sizeof(*first));
+    size_t* adj = malloc((num_edges ? num_edges : 1) * sizeof(*adj));
+    for (size_t e = 0; e < num_edges; ++e) {
+        ++indeg[edges[e].to];
+        ++first[edges[e].from + 1];
+    }
+    for (size_t i = 0; i < np; ++i)
+        first[i + 1] += first[i];
+    size_t* fill = malloc((np + 1) * sizeof(*fill));
+    memcpy(fill, first, (np + 1) * sizeof(*fill));
+    for (size_t e = 0; e < num_edges; ++e)
+        adj[fill[edges[e].from]++] = edges[e].to;
+
+    /*
+     * Topological sort, preferring a ready pass that continues into the targets of the last one
+     * so they can be merged, then declaration order. Backbuffer passes are deferred while anything
+     * else is ready, so they end up next to each other.
+     */
+    unsigned char* done = calloc(np, 1);
+    size_t count = 0, last = NONE;
+    for (;;) {
+        size_t pick = NONE, deferred = NONE;
+        for (size_t i = 0; i < np; ++i) {
+            fg_pass* p = &fg->passes[i];
+            if (!p->needed || done[i] || indeg[i] != 0)
+                continue;
+            if (last != NONE && same_targets(fg, &fg->passes[last], p) && !pass_clears(fg, p)) {
+                pick = i;
+                break;
+            }
+            if (pass_is_backbuffer(fg, p)) {
+                if (deferred == NONE)
+                    deferred = i;
+            } else if (pick == NONE) {
+                pick = i;
+            }
+        }
+        if (pick == NONE)
+            pick = deferred;
+        if (pick == NONE)
+            break;
+        done[pick] = 1;
+        order[count++] = pick;
+        last = pick;
+        for (size_t e = first[pick]; e < first[pick + 1]; ++e)
+            --indeg[adj[e]];
+    }
+
+    free(done);
+    free(fill);
+    free(adj);
+    free(first);
+    free(indeg);
+    free(edges);
+    free(overwriter);
+    return count;
+}
+
+/*
+ * Resources
+ */
+
+static int image_desc_equal(const gfx_image_desc* a, const gfx_image_desc* b)
+{
+    return a->type == b->type
+        && a->width == b->width
+        && a->height == b->height
+        && a->num_slices == b->num_slices
+        && a->num_mipmaps == b->num_mipmaps
+        && a->pixel_format == b->pixel_format
+        && a->sample_count == b->sample_count
+        && a->min_filter == b->min_filter
+        && a->mag_filter == b->mag_filter
+        && a->wrap_u == b->wrap_u
+        && a->wrap_v == b->wrap_v
+        && a->wrap_w == b->wrap_w
+        && a->border_color == b->border_color;
+}
+
+static void release_idle_images(frame_graph fg)
+{
+    for (size_t i = 0; i < fg->num_physicals;) {
+        fg_physical* ph = &fg->physicals[i];
+        if (fg->frame - ph->last_frame <= FRAME_GRAPH_MAX_IDLE_FRAMES) {
+            ++i;
+            continue;
+        }
+        /* Drop passes rendering into it first */
+        for (size_t c = 0; c < fg->num_cached;) {
+            fg_target* t = &fg->cached[c].target;
+            int uses = t->depth.id == ph->img.id;
+            for (size_t k = 0; k < t->num_colors; ++k)
+                uses |= t->colors[k].id == ph->img.id;
+            if (uses) {
+                gfx_destroy_pass(fg->cached[c].pass);
+                fg->cached[c] = fg->cached[--fg->num_cached];
+            } else {
+                ++c;
+            }
+        }
+        gfx_destroy_image(ph->img);
+        fg->physicals[i] = fg->physicals[--fg->num_physicals];
+    }
+}
+
+static void touch_texture(frame_graph fg, frame_graph_resource v, size_t pos)
+{
+    fg_texture* tex = &fg->textures[fg->versions[v].texture];
+    if (tex->first_use == NONE)
+        tex->first_use = pos;
+    tex->last_use = pos;
+}
+
+/* Backs transient textures with pooled images, sharing them between textures whose lifetimes do not overlap */
+static void allocate_textures(frame_graph fg, size_t* order, size_t count)
+{
+    for (size_t pos = 0; pos < count; ++pos) {
+        fg_pass* p = &fg->passes[order[pos]];
+        for (size_t r = 0; r < p->num_reads; ++r)
+            touch_texture(fg, p->reads[r], pos);
+        FOR_EACH_WRITE(p, v, { touch_texture(fg, v, pos); });
+    }
+
+    for (size_t pos = 0; pos < count; ++pos) {
+        for (size_t t = 0; t < fg->num_textures; ++t) {
+            fg_texture* tex = &fg->textures[t];
+            if (tex->is_imported || tex->first_use != pos)
+                continue;
+            size_t slot = NONE;
+            for (size_t i = 0; i < fg->num_physicals && slot == NONE; ++i) {
+                fg_physical* ph = &fg->physicals[i];
+                int avail = ph->last_frame != fg->frame || ph->busy_until < pos;
+                if (avail && image_desc_equal(&ph->desc, &tex->desc))
+                    slot = i;
+            }
+            if (slot == NONE) {
+                ARRAY_RESERVE(fg->physicals, fg->cap_physicals, fg->num_physicals + 1);
+                slot = fg->num_physicals++;
+                fg->physicals[slot] = (fg_physical){
+                    .desc = tex->desc,
+                    .img  = gfx_make_image(&tex->desc),
+                };
+            }
+            fg->physicals[slot].last_frame = fg->frame;
+            fg->physicals[slot].busy_until = tex->last_use;
+            tex->physical = slot;
+        }
+    }
+}
+
+static fg_target pass_target(frame_graph fg, fg_pass* p)
+{
+    fg_target t = { .num_colors = p->num_colors, .is_backbuffer = pass_is_backbuffer(fg, p) };
+    if (t.is_backbuffer) {
+        fg_texture* bb = &fg->textures[fg->versions[p->colors[0].res].texture];
+        t.width = bb->desc.width;
+        t.height = bb->desc.height;
+        return t;
+    }
+    for (size_t i = 0; i < p->num_colors; ++i) {
+        t.colors[i] = frame_graph_image(fg, p->colors[i].res);
+        t.color_slices[i] = p->colors[i].slice;
+    }
+    if (p->depth.res != FRAME_GRAPH_RESOURCE_INVALID) {
+        t.depth = frame_graph_image(fg, p->depth.res);
+        t.depth_slice = p->depth.slice;
+    }
+    return t;
+}
+
+static int target_equal(fg_target* a, fg_target* b)
+{
+    if (a->num_colors != b->num_colors || a->depth.id != b->depth.id || a->depth_slice != b->depth_slice)
+        return 0;
+    for (size_t i = 0; i < a->num_colors; ++i)
+        if (a->colors[i].id != b->colors[i].id || a->color_slices[i] != b->color_slices[i])
+            return 0;
+    return 1;
+}
+
+static gfx_pass fetch_pass(frame_graph fg, fg_target* t)
+{
+    for (size_t i = 0; i < fg->num_cached; ++i) {
+        if (target_equal(&fg->cached[i].target, t)) {
+            fg->cached[i].last_frame = fg->frame;
+            return fg->cached[i].pass;
+        }
+    }
+    gfx_pass_desc desc = {0};
+    for (size_t i = 0; i < t->num_colors; ++i) {
+        desc.color_attachments[i].image = t->colors[i];
+        desc.color_attachments[i].slice = t->color_slices[i];
+    }
+    desc.depth_stencil_attachment.image = t->depth;
+    desc.depth_stencil_attachment.slice = t->depth_slice;
+    ARRAY_RESERVE(fg->cached, fg->cap_cached, fg->num_cached + 1);
+    fg->cached[fg->num_cached++] = (fg_cached_pass){
+        .target     = *t,
+        .pass       = gfx_make_pass(&desc),
+        .last_frame = fg->frame,
+    };
+    return fg->cached[fg->num_cached - 1].pass;
+}
+
+void frame_graph_execute(frame_graph fg)
+{
+    size_t* order = malloc((fg->num_passes ? fg->num_passes : 1) * sizeof(*order));
+    cull_passes(fg);
+    size_t count = schedule_passes(fg, order);
+    release_idle_images(fg);
+    allocate_textures(fg, order, count);
+
+    /* Run passes, opening targets once for each run of passes that keep their contents */
+    for (size_t pos = 0; pos < count;) {
+        fg_pass* head = &fg->passes[order[pos]];
+        size_t end = pos + 1;
+        while (end < count
+            && same_targets(fg, head, &fg->passes[order[end]])
+            && !pass_clears(fg, &fg->passes[order[end]]))
+            ++end;
+
+        int has_targets = pass_has_targets(head);
+        if (has_targets) {
+            fg_target t = pass_target(fg, head);
+            if (t.is_backbuffer)
+                gfx_begin_default_pass(&head->action, t.width, t.height);
+            else
+                gfx_begin_pass(fetch_pass(fg, &t), &head->action);
+        }
+        for (; pos < end; ++pos) {
+            fg_pass* p = &fg->passes[order[pos]];
+            gfx_push_debug_group(p->name);
+            if (fg->timer)
+                gpu_timer_begin(fg->timer, p->name);
+            p->fn(p->data);
+            if (fg->timer)
+                gpu_timer_end(fg->timer);
+            gfx_pop_debug_group();
+        }
+        if (has_targets)
+            gfx_end_pass();
+    }
+    free(order);
+}
@@ -0,0 +1,92 @@
+/*********************************************************************************************************************/
+/*                                                  /===-_---~~~~~~~~~------____                                     */
+/*                                                 |===-~___                _,-'                                     */
+/*                  -==\\                         `//~\\   ~~~~`---.___.-~~                                          */
+/*              ______-==|                         | |  \\           _-~`                                            */
+/*        __--~~~  ,-/-==\\                        | |   `\        ,'                                                */
+/*     _-~       /'    |  \\                      / /      \      /                                                  */
+/*   .'        /       |   \\                   /' /        \   /'                                                   */
+/*  /  ____  /         |    \`\.__/-~~ ~ \ _ _/'  /          \/'                                                     */
+/* /-'~    ~~~~~---__  |     ~-/~         ( )   /'        _--~`                                                      */
+/*                   \_|      /        _)   ;  ),   __--~~                                                           */
+/*                     '~~--_/      _-~/-  / \   '-~ \                                                               */
+/*                    {\__--_/}    / \\_>- )<__\      \                                                              */
+/*                    /'   (_/  _-~  | |__>--<__|      |                                                             */
+/*                   |0  0 _/) )-~     | |__>--<__|     |                                                            */
+/*                   / /~ ,_/       / /__>---<__/      |                                                             */
+/*                  o o _//        /-~_>---<__-~      /                                                              */
+/*                  (^(~          /~_>---<__-      _-~                                                               */
+/*                 ,/|           /__>--<__/     _-~                                                                  */
+/*              ,//('(          |__>--<__|     /                  .----_                                             */
+/*             ( ( '))          |__>--<__|    |                 /' _---_~\                                           */
+/*          `-)) )) (           |__>--<__|    |               /'  /     ~\`\                                         */
+/*         ,/,'//( (             \__>--<__\    \            /'  //        ||                                         */
+/*       ,( ( ((, ))              ~-__>--<_~-_  ~--____---~' _/'/        /'                                          */
+/*     `~/  )` ) ,/|                 ~-_~>--<_/-__       __-~ _/                                                     */
+/*   ._-~//( )/ )) `                    ~~-'_/_/ /~~~~~~~__--~                                                       */
+/*    ;'( ')/ ,)(                              ~~~~~~~~~~                                                            */
+/*   ' ') '( (/                                                                                                      */
+/*     '   '  `                                                                                                      */
+/*********************************************************************************************************************/
+#ifndef _FRAME_GRAPH_H_
+#define _FRAME_GRAPH_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <gfx.h>
+#include "gpu_timer.h"
+
+/*
+ * Frame graph
+ *
+ * Passes are recorded every frame along with the textures they read and write.
+ * Writing a texture yields a new version of it, so data flow between passes is explicit.
+ * On execution passes are ordered by their dependencies, passes not contributing to an
+ * imported texture or the backbuffer are culled, consecutive passes rendering into the
+ * same targets without clearing them share a single begin/end, and transient textures
+ * with disjoint lifetimes and matching descriptions share the same image.
+ */
+
+#define FRAME_GRAPH_MAX_PASS_READS (8)
+#define FRAME_GRAPH_MAX_IDLE_FRAMES (60) /* Unused pooled images are released after this many frames */
+#define FRAME_GRAPH_RESOURCE_INVALID (~0u)
+
+typedef struct frame_graph* frame_graph;
+
+/* Versioned texture handle, valid for the frame it was returned in */
+typedef uint32_t frame_graph_resource;
+
+/* Records the GPU commands of a pass, its render targets are bound already */
+typedef void(*frame_graph_execute_fn)(void* data);
+
+frame_graph frame_graph_create();
+void frame_graph_destroy(frame_graph fg);
+
+/* Optional timer, passes are timed as scopes named after them */
+void frame_graph_set_timer(frame_graph fg, gpu_timer gt);
+
+/* Starts recording a new frame, handles of the previous one become invalid */
+void frame_graph_begin(frame_graph fg);
+
+/* Declares a texture living within the current frame, backed by a pooled image */
+frame_graph_resource frame_graph_create_texture(frame_graph fg, const char* name, const gfx_image_desc* desc);
+/* Declares a texture backed by an image outliving the frame, its passes are never culled */
+frame_graph_resource frame_graph_import_texture(frame_graph fg, const char* name, gfx_image img);
+/* Declares the default framebuffer */
+frame_graph_resource frame_graph_import_backbuffer(frame_graph fg, int width, int height);
+
+/* Adds a pass, returns its index for declaring its reads and writes */
+size_t frame_graph_add_pass(frame_graph fg, const char* name, const gfx_pass_action* action, frame_graph_execute_fn fn, void* data);
+/* Declares a texture sampled by the pass */
+void frame_graph_read(frame_graph fg, size_t pass, frame_graph_resource res);
+/* Declares render targets of the pass, returning the new version of the texture */
+frame_graph_resource frame_graph_write_color(frame_graph fg, size_t pass, frame_graph_resource res, int slice);
+frame_graph_resource frame_graph_write_depth(frame_graph fg, size_t pass, frame_graph_resource res, int slice);
+
+/* Image backing given texture, valid while executing */
+gfx_image frame_graph_image(frame_graph fg, frame_graph_resource res);
+
+/* Schedules, allocates and runs the recorded passes */
+void frame_graph_execute(frame_graph fg);
+
+#endif /* ! _FRAME_GRAPH_H_ */
@@ -0,0 +1,42 @@
+#include "gfx.h"
+#include "opengl.h"
+
+gfx_timer_query gfx_make_timer_query()
+{
+    GLuint id = 0;
+    glGenQueries(1, &id);
+    return (gfx_timer_query){ .id = id };
+}
+
+void gfx_destroy_timer_query(gfx_timer_query q)
+{
+    GLuint id = q.id;
+    glDeleteQueries(1, &id);
+}
+
+void gfx_timestamp(gfx_timer_query q)
+{
+    glQueryCounter(q.id, GL_TIMESTAMP);
+}
+
+int gfx_timer_query_available(gfx_timer_query q)
+{
+    GLint available = 0;
+    glGetQueryObjectiv(q.id, GL_QUERY_RESULT_AVAILABLE, &available);
+    return available != 0;
+}
+
+uint64_t gfx_timer_query_result(gfx_timer_query q)
+{
+    GLuint64 t = 0;
+    glGetQueryObjectui64v(q.id, GL_QUERY_RESULT, &t);
+    return t;
+}
+
+void gfx_read_pixels(int x, int y, int w, int h, void* dst, size_t pitch)
+{
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glPixelStorei(GL_PACK_ROW_LENGTH, (GLint)(pitch / 4));
+    glReadPixels(x, y, w, h, GL_RGBA, GL_UNSIGNED_BYTE, dst);
+    glPixelStorei(GL_PACK_ROW_LENGTH, 0);
+}
@@ -0,0 +1,124 @@
+#include "gpu_timer.h"
+#include <stdlib.h>
+#include <string.h>
+#include "gfx.h"
+
+#define NUM_QUERIES (2 * (GPU_TIMER_MAX_SCOPES + 1))
+#define MAX_DEPTH (8)
+
+/* Timestamp queries of a single frame, slot 0 and 1 bound the whole frame */
+typedef struct query_set {
+    gfx_timer_query queries[NUM_QUERIES];
+    const char* names[GPU_TIMER_MAX_SCOPES];
+    size_t num_scopes;
+    int recorded;       /* Holds queries not yet read back */
+} query_set;
+
+struct gpu_timer {
+    query_set sets[GPU_TIMER_LATENCY];
+    size_t cur;
+    size_t stack[MAX_DEPTH];
+    size_t depth;
+    int overflow;       /* Scopes dropped from the current frame past the limit */
+    float frame_msec;
+    gpu_timer_result results[GPU_TIMER_MAX_SCOPES];
+    size_t num_results;
+};
+
+gpu_timer gpu_timer_create()
+{
+    gpu_timer gt = calloc(1, sizeof(*gt));
+    for (size_t i = 0; i < GPU_TIMER_LATENCY; ++i)
+        for (size_t q = 0; q < NUM_QUERIES; ++q)
+            gt->sets[i].queries[q] = gfx_make_timer_query();
+    return gt;
+}
+
+void gpu_timer_destroy(gpu_timer gt)
+{
+    for (size_t i = 0; i < GPU_TIMER_LATENCY; ++i)
+        for (size_t q = 0; q < NUM_QUERIES; ++q)
+            gfx_destroy_timer_query(gt->sets[i].queries[q]);
+    free(gt);
+}
+
+static float query_msec(query_set* qs, size_t begin)
+{
+    uint64_t t0 = gfx_timer_query_result(qs->queries[begin]);
+    uint64_t t1 = gfx_timer_query_result(qs->queries[begin + 1]);
+    return t1 > t0 ? (float)((t1 - t0) / 1e6) : 0.0f;
+}
+
+static void resolve(gpu_timer gt, query_set* qs)
+{
+    /* Frame end is the last query issued, once it landed every other one did as well */
+    if (!gfx_timer_query_available(qs->queries[1]))
+        return;
+
+    gt->frame_msec = query_msec(qs, 0);
+    gt->num_results = 0;
+    for (size_t s = 0; s < qs->num_scopes; ++s) {
+        float msec = query_msec(qs, 2 * (s + 1));
+        size_t r = 0;
+        while (r < gt->num_results && strcmp(gt->results[r].name, qs->names[s]) != 0)
+            ++r;
+        if (r == gt->num_results)
+            gt->results[gt->num_results++] = (gpu_timer_result){ .name = qs->names[s] };
+        gt->results[r].msec += msec;
+    }
+}
+
+void gpu_timer_begin_frame(gpu_timer gt)
+{
+    query_set* qs = &gt->sets[gt->cur];
+    if (qs->recorded)
+        resolve(gt, qs);
+    qs->recorded = 0;
+    qs->num_scopes = 0;
+    gt->depth = 0;
+    gt->overflow = 0;
+    gfx_timestamp(qs->queries[0]);
+}
+
+void gpu_timer_end_frame(gpu_timer gt)
+{
+    query_set* qs = &gt->sets[gt->cur];
+    gfx_timestamp(qs->queries[1]);
+    qs->recorded = 1;
+    gt->cur = (gt->cur + 1) % GPU_TIMER_LATENCY;
+}
+
+void gpu_timer_begin(gpu_timer gt, const char* name)
+{
+    query_set* qs = &gt->sets[gt->cur];
+    if (qs->num_scopes == GPU_TIMER_MAX_SCOPES || gt->depth == MAX_DEPTH) {
+        ++gt->overflow;
+        return;
+    }
+    size_t s = qs->num_scopes++;
+    qs->names[s] = name;
+    gt->stack[gt->depth++] = s;
+    gfx_timestamp(qs->queries[2 * (s + 1)]);
+}
+
+void gpu_timer_end(gpu_timer gt)
+{
+    if (gt->overflow > 0) {
+        --gt->overflow;
+        return;
+    }
+    query_set* qs = &gt->sets[gt->cur];
+    size_t s = gt->stack[--gt->depth];
+    gfx_timestamp(qs->queries[2 * (s + 1) + 1]);
+}
+
+float gpu_timer_frame_msec(gpu_timer gt)
+{
+    return gt->frame_msec;
+}
+
+size_t gpu_timer_results(gpu_timer gt, const gpu_timer_result** results)
+{
+    *results = gt->results;
+    return gt->num_results;
+}
@@ -0,0 +1,66 @@
+/*********************************************************************************************************************/
+/*                                                  /===-_---~~~~~~~~~------____                                     */
+/*                                                 |===-~___                _,-'                                     */
+/*                  -==\\                         `//~\\   ~~~~`---.___.-~~                                          */
+/*              ______-==|                         | |  \\           _-~`                                            */
+/*        __--~~~  ,-/-==\\                        | |   `\        ,'                                                */
+/*     _-~       /'    |  \\                      / /      \      /                                                  */
+/*   .'        /       |   \\                   /' /        \   /'                                                   */
+/*  /  ____  /         |    \`\.__/-~~ ~ \ _ _/'  /          \/'                                                     */
+/* /-'~    ~~~~~---__  |     ~-/~         ( )   /'        _--~`                                                      */
+/*                   \_|      /        _)   ;  ),   __--~~                                                           */
+/*                     '~~--_/      _-~/-  / \   '-~ \                                                               */
+/*                    {\__--_/}    / \\_>- )<__\      \                                                              */
+/*                    /'   (_/  _-~  | |__>--<__|      |                                                             */
+/*                   |0  0 _/) )-~     | |__>--<__|     |                                                            */
+/*                   / /~ ,_/       / /__>---<__/      |                                                             */
+/*                  o o _//        /-~_>---<__-~      /                                                              */
+/*                  (^(~          /~_>---<__-      _-~                                                               */
+/*                 ,/|           /__>--<__/     _-~                                                                  */
+/*              ,//('(          |__>--<__|     /                  .----_                                             */
+/*             ( ( '))          |__>--<__|    |                 /' _---_~\                                           */
+/*          `-)) )) (           |__>--<__|    |               /'  /     ~\`\                                         */
+/*         ,/,'//( (             \__>--<__\    \            /'  //        ||                                         */
+/*       ,( ( ((, ))              ~-__>--<_~-_  ~--____---~' _/'/        /'                                          */
+/*     `~/  )` ) ,/|                 ~-_~>--<_/-__       __-~ _/                                                     */
+/*   ._-~//( )/ )) `                    ~~-'_/_/ /~~~~~~~__--~                                                       */
+/*    ;'( ')/ ,)(                              ~~~~~~~~~~                                                            */
+/*   ' ') '( (/                                                                                                      */
+/*     '   '  `                                                                                                      */
+/*********************************************************************************************************************/
+#ifndef _GPU_TIMER_H_
+#define _GPU_TIMER_H_
+
+#include <stddef.h>
+
+#define GPU_TIMER_MAX_SCOPES (32)  /* Distinct scopes per frame, repeated names are accumulated */
+#define GPU_TIMER_LATENCY (2)      /* Frames recorded before their queries are read back */
+
+/* Time spent by the GPU on a named scope of a past frame */
+typedef struct gpu_timer_result {
+    const char* name;
+    float msec;
+} gpu_timer_result;
+
+typedef struct gpu_timer* gpu_timer;
+
+gpu_timer gpu_timer_create();
+void gpu_timer_destroy(gpu_timer gt);
+
+/*
+ * Frame bounds. Beginning a frame resolves the queries of the frame recorded
+ * GPU_TIMER_LATENCY frames earlier, unless they are still pending in which
+ * case the previous results are kept rather than waiting on the GPU.
+ */
+void gpu_timer_begin_frame(gpu_timer gt);
+void gpu_timer_end_frame(gpu_timer gt);
+
+/* Scope bounds, name must outlive the frame */
+void gpu_timer_begin(gpu_timer gt, const char* name);
+void gpu_timer_end(gpu_timer gt);
+
+/* Latest resolved whole frame time and per scope times */
+float gpu_timer_frame_msec(gpu_timer gt);
+size_t gpu_timer_results(gpu_timer gt, const gpu_timer_result** results);
+
+#endif /* ! _GPU_TIMER_H_ */
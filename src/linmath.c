@@ -5,6 +5,12 @@
 #include <stdlib.h>
 #include <string.h>
 #include <float.h>
+#include "simd.h"
+
+/* Vectorized paths rely on matrix columns being contiguous in memory */
+#if !defined(LINALGB_ROW_MAJOR) && !defined(SIMD_SCALAR)
+#define LINMATH_SIMD
+#endif
 
 #ifdef M_PI
 #undef M_PI
@@ -1922,10 +1928,31 @@ mat4 mat3_to_mat4(mat3 m)
     return mat;
 }
 
+#ifdef LINMATH_SIMD
+static inline void mat4_mul_mat4_simd(float* r, const float* a, const float* b)
+{
+    simd4f a0 = simd4f_load(a + 0);
+    simd4f a1 = simd4f_load(a + 4);
+    simd4f a2 = simd4f_load(a + 8);
+    simd4f a3 = simd4f_load(a + 12);
+    for (int j = 0; j < 4; ++j) {
+        const float* bc = b + 4 * j;
+        simd4f c = simd4f_mul(a0, simd4f_splat(bc[0]));
+        c = simd4f_madd(a1, simd4f_splat(bc[1]), c);
+        c = simd4f_madd(a2, simd4f_splat(bc[2]), c);
+        c = simd4f_madd(a3, simd4f_splat(bc[3]), c);
+        simd4f_store(r + 4 * j, c);
+    }
+}
+#endif
+
 mat4 mat4_mul_mat4(mat4 m1, mat4 m2)
 {
     mat4 mat;
 
+#ifdef LINMATH_SIMD
+    mat4_mul_mat4_simd(mat.m, m1.m, m2.m);
+#else
     mat.xx = (m1.xx * m2.xx) + (m1.xy * m2.yx) + (m1.xz * m2.zx) + (m1.xw * m2.wx);
     mat.xy = (m1.xx * m2.xy) + (m1.xy * m2.yy) + (m1.xz * m2.zy) + (m1.xw * m2.wy);
     mat.xz = (m1.xx * m2.xz) + (m1.xy * m2.yz) + (m1.xz * m2.zz) + (m1.xw * m2.wz);
@@ -1945,6 +1972,7 @@ mat4 mat4_mul_mat4(mat4 m1, mat4 m2)
     mat.wy = (m1.wx * m2.xy) + (m1.wy * m2.yy) + (m1.wz * m2.zy) + (m1.ww * m2.wy);
     mat.wz = (m1.wx * m2.xz) + (m1.wy * m2.yz) + (m1.wz * m2.zz) + (m1.ww * m2.wz);
     mat.ww = (m1.wx * m2.xw) + (m1.wy * m2.yw) + (m1.wz * m2.zw) + (m1.ww * m2.ww);
+#endif
 
     return mat;
 }
@@ -1953,10 +1981,18 @@ vec4 mat4_mul_vec4(mat4 m, vec4 v)
 {
     vec4 vec;
 
+#ifdef LINMATH_SIMD
+    simd4f r = simd4f_mul(simd4f_load(m.m + 0), simd4f_splat(v.x));
+    r = simd4f_madd(simd4f_load(m.m + 4), simd4f_splat(v.y), r);
+    r = simd4f_madd(simd4f_load(m.m + 8), simd4f_splat(v.z), r);
+    r = simd4f_madd(simd4f_load(m.m + 12), simd4f_splat(v.w), r);
+    simd4f_store(vec.xyzw, r);
+#else
     vec.x = (m.xx * v.x) + (m.xy * v.y) + (m.xz * v.z) + (m.xw * v.w);
     vec.y = (m.yx * v.x) + (m.yy * v.y) + (m.yz * v.z) + (m.yw * v.w);
     vec.z = (m.zx * v.x) + (m.zy * v.y) + (m.zz * v.z) + (m.zw * v.w);
     vec.w = (m.wx * v.x) + (m.wy * v.y) + (m.wz * v.z) + (m.ww * v.w);
+#endif
 
     return vec;
 }
@@ -2327,18 +2363,110 @@ mat4 mat4_rotation_quat_dual(quat_dual q)
 
 mat4 mat4_world(vec3 position, vec3 scale, quat rotation)
 {
-    mat4 pos_m, sca_m, rot_m, result;
-
-    pos_m = mat4_translation(position);
-    rot_m = mat4_rotation_quat(rotation);
-    sca_m = mat4_scale(scale);
+    /* Composes translation * rotation * scale directly */
+    mat4 m = mat4_rotation_quat(rotation);
+    m.xx *= scale.x; m.yx *= scale.x; m.zx *= scale.x;
+    m.xy *= scale.y; m.yy *= scale.y; m.zy *= scale.y;
+    m.xz *= scale.z; m.yz *= scale.z; m.zz *= scale.z;
+    m.xw = position.x;
+    m.yw = position.y;
+    m.zw = position.z;
+    return m;
+}
 
-    result = mat4_id();
-    result = mat4_mul_mat4(result, pos_m);
-    result = mat4_mul_mat4(result, rot_m);
-    result = mat4_mul_mat4(result, sca_m);
+void mat4_mul_mat4_batch(mat4* out, const mat4* m1, const mat4* m2, size_t count)
+{
+    for (size_t i = 0; i < count; ++i) {
+#ifdef LINMATH_SIMD
+        mat4_mul_mat4_simd(out[i].m, m1[i].m, m2[i].m);
+#else
+        out[i] = mat4_mul_mat4(m1[i], m2[i]);
+#endif
+    }
+}
 
-    return result;
+void mat4_world_batch(mat4* out, const vec3* positions, const vec3* scales, const quat* rotations, size_t count)
+{
+    size_t i = 0;
+#ifdef LINMATH_SIMD
+    /* Four poses at a time, one per lane */
+    const simd4f one = simd4f_splat(1.0f), zero = simd4f_splat(0.0f);
+    for (; i + 4 <= count; i += 4) {
+        const quat* q = rotations + i;
+        const vec3* s = scales + i;
+        const vec3* p = positions + i;
+        simd4f qx = simd4f_set(q[0].x, q[1].x, q[2].x, q[3].x);
+        simd4f qy = simd4f_set(q[0].y, q[1].y, q[2].y, q[3].y);
+        simd4f qz = simd4f_set(q[0].z, q[1].z, q[2].z, q[3].z);
+        simd4f qw = simd4f_set(q[0].w, q[1].w, q[2].w, q[3].w);
+        simd4f sx = simd4f_set(s[0].x, s[1].x, s[2].x, s[3].x);
+        simd4f sy = simd4f_set(s[0].y, s[1].y, s[2].y, s[3].y);
+        simd4f sz = simd4f_set(s[0].z, s[1].z, s[2].z, s[3].z);
+
+        simd4f x2 = simd4f_add(qx, qx), y2 = simd4f_add(qy, qy), z2 = simd4f_add(qz, qz);
+        simd4f xx = simd4f_mul(qx, x2), yy = simd4f_mul(qy, y2), zz = simd4f_mul(qz, z2);
+        simd4f xy = simd4f_mul(qx, y2), xz = simd4f_mul(qx, z2), yz = simd4f_mul(qy, z2);
+        simd4f wx = simd4f_mul(qw, x2), wy = simd4f_mul(qw, y2), wz = simd4f_mul(qw, z2);
+
+        /* Scaled rotation columns, lanes hold the same element of four matrices */
+        simd4f c0x = simd4f_mul(simd4f_sub(one, simd4f_add(yy, zz)), sx);
+        simd4f c0y = simd4f_mul(simd4f_add(xy, wz), sx);
+        simd4f c0z = simd4f_mul(simd4f_sub(xz, wy), sx);
+        simd4f c0w = zero;
+        simd4f c1x = simd4f_mul(simd4f_sub(xy, wz), sy);
+        simd4f c1y = simd4f_mul(simd4f_sub(one, simd4f_add(xx, zz)), sy);
+        simd4f c1z = simd4f_mul(simd4f_add(yz, wx), sy);
+        simd4f c1w = zero;
+        simd4f c2x = simd4f_mul(simd4f_add(xz, wy), sz);
+        simd4f c2y = simd4f_mul(simd4f_sub(yz, wx), sz);
+        simd4f c2z = simd4f_mul(simd4f_sub(one, simd4f_add(xx, yy)), sz);
+        simd4f c2w = zero;
+        simd4f c3x = simd4f_set(p[0].x, p[1].x, p[2].x, p[3].x);
+        simd4f c3y = simd4f_set(p[0].y, p[1].y, p[2].y, p[3].y);
+        simd4f c3z = simd4f_set(p[0].z, p[1].z, p[2].z, p[3].z);
+        simd4f c3w = one;
+
+        /* Transpose lanes back into per matrix columns */
+        simd4f_transpose(&c0x, &c0y, &c0z, &c0w);
+        simd4f_transpose(&c1x, &c1y, &c1z, &c1w);
+        simd4f_transpose(&c2x, &c2y, &c2z, &c2w);
+        simd4f_transpose(&c3x, &c3y, &c3z, &c3w);
+        simd4f c[4][4] = {
+            { c0x, c1x, c2x, c3x },
+            { c0y, c1y, c2y, c3y },
+            { c0z, c1z, c2z, c3z },
+            { c0w, c1w, c2w, c3w },
+        };
+        for (int k = 0; k < 4; ++k)
+            for (int j = 0; j < 4; ++j)
+                simd4f_store(out[i + k].m + 4 * j, c[k][j]);
+    }
+#endif
+    for (; i < count; ++i)
+        out[i] = mat4_world(positions[i], scales[i], rotations[i]);
+}
+
+void mat4_mul_point_batch(vec3* out, mat4 m, const vec3* points, size_t count)
+{
+#ifdef LINMATH_SIMD
+    simd4f c0 = simd4f_load(m.m + 0);
+    simd4f c1 = simd4f_load(m.m + 4);
+    simd4f c2 = simd4f_load(m.m + 8);
+    simd4f c3 = simd4f_load(m.m + 12);
+    for (size_t i = 0; i < count; ++i) {
+        simd4f r = simd4f_madd(c0, simd4f_splat(points[i].x), c3);
+        r = simd4f_madd(c1, simd4f_splat(points[i].y), r);
+        r = simd4f_madd(c2, simd4f_splat(points[i].z), r);
+        float v[4];
+        simd4f_store(v, r);
+        out[i] = vec3_new(v[0], v[1], v[2]);
+    }
+#else
+    for (size_t i = 0; i < count; ++i) {
+        vec4 r = mat4_mul_vec4(m, vec4_new(points[i].x, points[i].y, points[i].z, 1.0f));
+        out[i] = vec3_new(r.x, r.y, r.z);
+    }
+#endif
 }
 
 mat4 mat4_lerp(mat4 m1, mat4 m2, float amount)
@@ -2642,6 +2770,84 @@ box box_transform(box bb, mat4 world, mat3 world_normal)
     return bb;
 }
 
+aabb aabb_new(vec3 lo, vec3 hi)
+{
+    aabb a;
+    a.lo = lo;
+    a.hi = hi;
+    return a;
+}
+
+aabb aabb_empty()
+{
+    return aabb_new(vec3_new(FLT_MAX, FLT_MAX, FLT_MAX), vec3_new(-FLT_MAX, -FLT_MAX, -FLT_MAX));
+}
+
+aabb aabb_merge(aabb a1, aabb a2)
+{
+    return aabb_new(
+        vec3_new(min(a1.lo.x, a2.lo.x), min(a1.lo.y, a2.lo.y), min(a1.lo.z, a2.lo.z)),
+        vec3_new(max(a1.hi.x, a2.hi.x), max(a1.hi.y, a2.hi.y), max(a1.hi.z, a2.hi.z)));
+}
+
+aabb aabb_merge_point(aabb a, vec3 point)
+{
+    return aabb_merge(a, aabb_new(point, point));
+}
+
+vec3 aabb_center(aabb a)
+{
+    return vec3_mul(vec3_add(a.lo, a.hi), 0.5f);
+}
+
+vec3 aabb_extents(aabb a)
+{
+    return vec3_mul(vec3_sub(a.hi, a.lo), 0.5f);
+}
+
+aabb aabb_transform(aabb a, mat4 world)
+{
+    aabb r;
+    aabb_transform_batch(&r, &a, &world, 1);
+    return r;
+}
+
+void aabb_transform_batch(aabb* out, const aabb* in, const mat4* world, size_t count)
+{
+    /* Transform center and project extents on the absolute axes of the matrix */
+    for (size_t i = 0; i < count; ++i) {
+        vec3 c = aabb_center(in[i]);
+        vec3 e = aabb_extents(in[i]);
+#ifdef LINMATH_SIMD
+        const float* m = world[i].m;
+        simd4f c0 = simd4f_load(m + 0), c1 = simd4f_load(m + 4), c2 = simd4f_load(m + 8);
+        simd4f nc = simd4f_madd(c0, simd4f_splat(c.x), simd4f_load(m + 12));
+        nc = simd4f_madd(c1, simd4f_splat(c.y), nc);
+        nc = simd4f_madd(c2, simd4f_splat(c.z), nc);
+        simd4f ne = simd4f_mul(simd4f_abs(c0), simd4f_splat(e.x));
+        ne = simd4f_madd(simd4f_abs(c1), simd4f_splat(e.y), ne);
+        ne = simd4f_madd(simd4f_abs(c2), simd4f_splat(e.z), ne);
+        float vmin[4], vmax[4];
+        simd4f_store(vmin, simd4f_sub(nc, ne));
+        simd4f_store(vmax, simd4f_add(nc, ne));
+        out[i].lo = vec3_new(vmin[0], vmin[1], vmin[2]);
+        out[i].hi = vec3_new(vmax[0], vmax[1], vmax[2]);
+#else
+        mat4 m = world[i];
+        vec3 nc = vec3_new(
+            m.xx * c.x + m.xy * c.y + m.xz * c.z + m.xw,
+            m.yx * c.x + m.yy * c.y + m.yz * c.z + m.yw,
+            m.zx * c.x + m.zy * c.y + m.zz * c.z + m.zw);
+        vec3 ne = vec3_new(
+            fabs(m.xx) * e.x + fabs(m.xy) * e.y + fabs(m.xz) * e.z,
+            fabs(m.yx) * e.x + fabs(m.yy) * e.y + fabs(m.yz) * e.z,
+            fabs(m.zx) * e.x + fabs(m.zy) * e.y + fabs(m.zz) * e.z);
+        out[i].lo = vec3_sub(nc, ne);
+        out[i].hi = vec3_add(nc, ne);
+#endif
+    }
+}
+
 frustum frustum_new(vec3 ntr, vec3 ntl, vec3 nbr, vec3 nbl, vec3 ftr, vec3 ftl, vec3 fbr, vec3 fbl)
 {
     frustum f;
@@ -0,0 +1,239 @@
+#include "occlusion.h"
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+#include "simd.h"
+
+/* Clip space w below which vertices are treated as crossing the near plane */
+#define OCCLUSION_MIN_W (1e-5f)
+
+void occlusion_buffer_init(occlusion_buffer* ob, int width, int height)
+{
+    assert(width % 4 == 0 && height > 0);
+    *ob = (occlusion_buffer){ .viewproj = mat4_id() };
+    int w = width, h = height;
+    for (int l = 0; l < OCCLUSION_MAX_LEVELS; ++l) {
+        occlusion_level* lvl = &ob->levels[l];
+        lvl->width = w;
+        lvl->height = h;
+        lvl->min = malloc(w * h * sizeof(*lvl->min));
+        /* The full resolution level covers a single depth per pixel */
+        lvl->max = l == 0 ? lvl->min : malloc(w * h * sizeof(*lvl->max));
+        ++ob->num_levels;
+        if (w == 1 && h == 1)
+            break;
+        w = (w + 1) / 2;
+        h = (h + 1) / 2;
+    }
+    occlusion_buffer_clear(ob, mat4_id());
+}
+
+void occlusion_buffer_destroy(occlusion_buffer* ob)
+{
+    for (int l = 0; l < ob->num_levels; ++l) {
+        occlusion_level* lvl = &ob->levels[l];
+        if (lvl->max != lvl->min)
+            free(lvl->max);
+        free(lvl->min);
+    }
+    *ob = (occlusion_buffer){0};
+}
+
+void occlusion_buffer_clear(occlusion_buffer* ob, mat4 viewproj)
+{
+    ob->viewproj = viewproj;
+    occlusion_level* lvl = &ob->levels[0];
+    simd4f one = simd4f_splat(1.0f);
+    for (int i = 0; i < lvl->width * lvl->height; i += 4)
+        simd4f_store(lvl->min + i, one);
+}
+
+/* Column major matrix times (p, 1), the four clip space components in a single vector */
+static inline simd4f transform_point(const simd4f cols[4], vec3 p)
+{
+    return simd4f_madd(cols[0], simd4f_splat(p.x),
+           simd4f_madd(cols[1], simd4f_splat(p.y),
+           simd4f_madd(cols[2], simd4f_splat(p.z), cols[3])));
+}
+
+void occlusion_rasterize(occlusion_buffer* ob, const vec3* positions, const uint32_t* indices, size_t num_indices, mat4 model)
+{
+    occlusion_level* lvl = &ob->levels[0];
+    const int width = lvl->width, height = lvl->height;
+    float* depth = lvl->min;
+
+    mat4 mvp = mat4_mul_mat4(ob->viewproj, model);
+    simd4f cols[4];
+    for (int c = 0; c < 4; ++c)
+        cols[c] = simd4f_load(mvp.m + 4 * c);
+
+    const simd4f zero = simd4f_splat(0.0f);
+    const simd4f lane = simd4f_set(0.0f, 1.0f, 2.0f, 3.0f);
+    /* Pushes the depth of pixels outside of the triangle past any stored depth */
+    const simd4f reject = simd4f_splat(1e30f);
+
+    for (size_t t = 0; t + 2 < num_indices; t += 3) {
+        /* Window coordinates of the triangle vertices */
+        float sx[3], sy[3], sz[3];
+        int crosses_near = 0;
+        for (int k = 0; k < 3; ++k) {
+            float clip[4];
+            simd4f_store(clip, transform_point(cols, positions[indices[t + k]]));
+            if (clip[3] < OCCLUSION_MIN_W || clip[2] < -clip[3]) {
+                crosses_near = 1;
+                break;
+            }
+            float inv_w = 1.0f / clip[3];
+            sx[k] = (clip[0] * inv_w * 0.5f + 0.5f) * width;
+            sy[k] = (clip[1] * inv_w * 0.5f + 0.5f) * height;
+            sz[k] = clip[2] * inv_w * 0.5f + 0.5f;
+        }
+        if (crosses_near)
+            continue;
+
+        /* Both windings are drawn, counter clockwise order keeps the edge functions positive inside */
+        float area = (sx[1] - sx[0]) * (sy[2] - sy[0]) - (sx[2] - sx[0]) * (sy[1] - sy[0]);
+        if (fabsf(area) < 1e-8f)
+            continue;
+        if (area < 0.0f) {
+            float tx = sx[1], ty = sy[1], tz = sz[1];
+            sx[1] = sx[2]; sy[1] = sy[2]; sz[1] = sz[2];
+            sx[2] = tx;    sy[2] = ty;    sz[2] = tz;
+            area = -area;
+        }
+
+        /* Pixel bounds, starting on a multiple of four */
+        int x0 = (int)floorf(fminf(sx[0], fminf(sx[1], sx[2])));
+        int x1 = (int)ceilf (fmaxf(sx[0], fmaxf(sx[1], sx[2])));
+        int y0 = (int)floorf(fminf(sy[0], fminf(sy[1], sy[2])));
+        int y1 = (int)ceilf (fmaxf(sy[0], fmaxf(sy[1], sy[2])));
+        x0 = x0 < 0 ? 0 : x0 & ~3;
+        y0 = y0 < 0 ? 0 : y0;
+        x1 = x1 >= width  ? width  - 1 : x1;
+        y1 = y1 >= height ? height - 1 : y1;
+        if (x0 > x1 || y0 > y1)
+            continue;
+
+        /* Edge functions a * x + b * y + c, each one weighting the vertex opposite to its edge */
+        float ea[3], eb[3], ec[3];
+        for (int k = 0; k < 3; ++k) {
+            int i = (k + 1) % 3, j = (k + 2) % 3;
+            ea[k] = sy[i] - sy[j];
+            eb[k] = sx[j] - sx[i];
+            ec[k] = sx[i] * sy[j] - sx[j] * sy[i];
+        }
+
+        /* Depth is affine in window space */
+        float inv_area = 1.0f / area;
+        float za = (sz[0] * ea[0] + sz[1] * ea[1] + sz[2] * ea[2]) * inv_area;
+        float zb = (sz[0] * eb[0] + sz[1] * eb[1] + sz[2] * eb[2]) * inv_area;
+        float zc = (sz[0] * ec[0] + sz[1] * ec[1] + sz[2] * ec[2]) * inv_area;
+
+        /* Sample at pixel centers, four pixels of a row at once */
+        simd4f px = simd4f_add(simd4f_splat((float)x0 + 0.5f), lane);
+        simd4f e_dx[3], z_dx = simd4f_splat(4.0f * za);
+        for (int k = 0; k < 3; ++k)
+            e_dx[k] = simd4f_splat(4.0f * ea[k]);
+        for (int y = y0; y <= y1; ++y) {
+            float py = (float)y + 0.5f;
+            simd4f e[3];
+            for (int k = 0; k < 3; ++k)
+                e[k] = simd4f_madd(simd4f_splat(ea[k]), px, simd4f_splat(eb[k] * py + ec[k]));
+            simd4f z = simd4f_madd(simd4f_splat(za), px, simd4f_splat(zb * py + zc));
+            float* row = depth + y * width;
+            for (int x = x0; x <= x1; x += 4) {
+                simd4f inside = simd4f_min(e[0], simd4f_min(e[1], e[2]));
+                if (simd4f_movemask_gt(zero, inside) != 0xF) {
+                    simd4f outside = simd4f_max(simd4f_sub(zero, inside), zero);
+                    simd4f_store(row + x, simd4f_min(simd4f_load(row + x), simd4f_madd(outside, reject, z)));
+                }
+                for (int k = 0; k < 3; ++k)
+                    e[k] = simd4f_add(e[k], e_dx[k]);
+                z = simd4f_add(z, z_dx);
+            }
+        }
+    }
+}
+
+void occlusion_build_hierarchy(occlusion_buffer* ob)
+{
+    for (int l = 1; l < ob->num_levels; ++l) {
+        const occlusion_level* src = &ob->levels[l - 1];
+        occlusion_level* dst = &ob->levels[l];
+        for (int y = 0; y < dst->height; ++y) {
+            int sy0 = 2 * y, sy1 = 2 * y + 1 < src->height ? 2 * y + 1 : src->height - 1;
+            for (int x = 0; x < dst->width; ++x) {
+                int sx0 = 2 * x, sx1 = 2 * x + 1 < src->width ? 2 * x + 1 : src->width - 1;
+                int i00 = sy0 * src->width + sx0, i01 = sy0 * src->width + sx1;
+                int i10 = sy1 * src->width + sx0, i11 = sy1 * src->width + sx1;
+                dst->min[y * dst->width + x] = fminf(fminf(src->min[i00], src->min[i01]), fminf(src->min[i10], src->min[i11]));
+                dst->max[y * dst->width + x] = fmaxf(fmaxf(src->max[i00], src->max[i01]), fmaxf(src->max[i10], src->max[i11]));
+            }
+        }
+    }
+}
+
+static int occlusion_test_box(const occlusion_buffer* ob, const aabb* b)
+{
+    const occlusion_level* base = &ob->levels[0];
+    const float* m = ob->viewproj.m;
+
+    /* Clip space corners, four at a time */
+    float cx[8], cy[8], cz[8], cw[8];
+    float* out[4] = {cx, cy, cz, cw};
+    simd4f x = simd4f_set(b->lo.x, b->hi.x, b->lo.x, b->hi.x);
+    simd4f y = simd4f_set(b->lo.y, b->lo.y, b->hi.y, b->hi.y);
+    for (int h = 0; h < 2; ++h) {
+        simd4f z = simd4f_splat(h ? b->hi.z : b->lo.z);
+        for (int k = 0; k < 4; ++k) {
+            simd4f r = simd4f_madd(simd4f_splat(m[k]), x,
+                       simd4f_madd(simd4f_splat(m[4 + k]), y,
+                       simd4f_madd(simd4f_splat(m[8 + k]), z, simd4f_splat(m[12 + k]))));
+            simd4f_store(out[k] + 4 * h, r);
+        }
+    }
+
+    /* Window space rectangle and nearest depth, boxes reaching the near plane are always visible */
+    float x_lo = INFINITY, x_hi = -INFINITY, y_lo = INFINITY, y_hi = -INFINITY, z_near = INFINITY;
+    for (int i = 0; i < 8; ++i) {
+        if (cw[i] < OCCLUSION_MIN_W || cz[i] < -cw[i])
+            return 1;
+        float inv_w = 1.0f / cw[i];
+        float sx = (cx[i] * inv_w * 0.5f + 0.5f) * base->width;
+        float sy = (cy[i] * inv_w * 0.5f + 0.5f) * base->height;
+        x_lo = fminf(x_lo, sx); x_hi = fmaxf(x_hi, sx);
+        y_lo = fminf(y_lo, sy); y_hi = fmaxf(y_hi, sy);
+        z_near = fminf(z_near, cz[i] * inv_w * 0.5f + 0.5f);
+    }
+    if (x_hi < 0.0f || y_hi < 0.0f || x_lo >= base->width || y_lo >= base->height)
+        return 1;
+    int x0 = x_lo < 0.0f ? 0 : (int)x_lo;
+    int y0 = y_lo < 0.0f ? 0 : (int)y_lo;
+    int x1 = x_hi >= base->width  ? base->width  - 1 : (int)x_hi;
+    int y1 = y_hi >= base->height ? base->height - 1 : (int)y_hi;
+
+    /* Coarsest level where the rectangle still spans at most two texels per axis */
+    int l = 0;
+    while (l + 1 < ob->num_levels && ((x1 >> l) - (x0 >> l) > 1 || (y1 >> l) - (y0 >> l) > 1))
+        ++l;
+
+    /* Occluded when every covered texel is nearer than the box */
+    const occlusion_level* lvl = &ob->levels[l];
+    for (int y = y0 >> l; y <= y1 >> l; ++y)
+        for (int x = x0 >> l; x <= x1 >> l; ++x)
+            if (lvl->max[y * lvl->width + x] >= z_near)
+                return 1;
+    return 0;
+}
+
+size_t occlusion_cull_boxes(const occlusion_buffer* ob, const aabb* boxes, size_t count, uint8_t* visible)
+{
+    size_t num_occluded = 0;
+    for (size_t i = 0; i < count; ++i) {
+        if (!visible[i] || occlusion_test_box(ob, &boxes[i]))
+            continue;
+        visible[i] = 0;
+        ++num_occluded;
+    }
+    return num_occluded;
+}
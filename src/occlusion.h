@@ -0,0 +1,76 @@
+/*********************************************************************************************************************/
+/*                                                  /===-_---~~~~~~~~~------____                                     */
+/*                                                 |===-~___                _,-'                                     */
+/*                  -==\\                         `//~\\   ~~~~`---.___.-~~                                          */
+/*              ______-==|                         | |  \\           _-~`                                            */
+/*        __--~~~  ,-/-==\\                        | |   `\        ,'                                                */
+/*     _-~       /'    |  \\                      / /      \      /                                                  */
+/*   .'        /       |   \\                   /' /        \   /'                                                   */
+/*  /  ____  /         |    \`\.__/-~~ ~ \ _ _/'  /          \/'                                                     */
+/* /-'~    ~~~~~---__  |     ~-/~         ( )   /'        _--~`                                                      */
+/*                   \_|      /        _)   ;  ),   __--~~                                                           */
+/*                     '~~--_/      _-~/-  / \   '-~ \                                                               */
+/*                    {\__--_/}    / \\_>- )<__\      \                                                              */
+/*                    /'   (_/  _-~  | |__>--<__|      |                                                             */
+/*                   |0  0 _/) )-~     | |__>--<__|     |                                                            */
+/*                   / /~ ,_/       / /__>---<__/      |                                                             */
+/*                  o o _//        /-~_>---<__-~      /                                                              */
+/*                  (^(~          /~_>---<__-      _-~                                                               */
+/*                 ,/|           /__>--<__/     _-~                                                                  */
+/*              ,//('(          |__>--<__|     /                  .----_                                             */
+/*             ( ( '))          |__>--<__|    |                 /' _---_~\                                           */
+/*          `-)) )) (           |__>--<__|    |               /'  /     ~\`\                                         */
+/*         ,/,'//( (             \__>--<__\    \            /'  //        ||                                         */
+/*       ,( ( ((, ))              ~-__>--<_~-_  ~--____---~' _/'/        /'                                          */
+/*     `~/  )` ) ,/|                 ~-_~>--<_/-__       __-~ _/                                                     */
+/*   ._-~//( )/ )) `                    ~~-'_/_/ /~~~~~~~__--~                                                       */
+/*    ;'( ')/ ,)(                              ~~~~~~~~~~                                                            */
+/*   ' ') '( (/                                                                                                      */
+/*     '   '  `                                                                                                      */
+/*********************************************************************************************************************/
+#ifndef _OCCLUSION_H_
+#define _OCCLUSION_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <linmath.h>
+
+/* Software depth buffer that occluder triangles are rasterized into, along with its
+ * hierarchical Z pyramid. Depth is stored as window depth in [0, 1], 1 being empty.
+ * The width is kept a multiple of four, pixels are shaded four at a time. */
+#define OCCLUSION_WIDTH      (256)
+#define OCCLUSION_HEIGHT     (128)
+#define OCCLUSION_MAX_LEVELS (16)
+
+typedef struct occlusion_level {
+    int width, height;
+    float* min; /* Nearest depth of the covered pixels */
+    float* max; /* Farthest depth of the covered pixels */
+} occlusion_level;
+
+typedef struct occlusion_buffer {
+    mat4 viewproj;
+    occlusion_level levels[OCCLUSION_MAX_LEVELS]; /* Level 0 is the full resolution depth buffer */
+    int num_levels;
+} occlusion_buffer;
+
+/* Allocates the depth buffer and its pyramid */
+void occlusion_buffer_init(occlusion_buffer* ob, int width, int height);
+/* Releases the depth buffer and its pyramid */
+void occlusion_buffer_destroy(occlusion_buffer* ob);
+
+/* Empties the depth buffer and sets the view projection occluders are rendered with */
+void occlusion_buffer_clear(occlusion_buffer* ob, mat4 viewproj);
+
+/* Rasterizes the indexed triangles transformed by the given model matrix, keeping the nearest depth.
+ * Triangles crossing the near plane are skipped, which only leaves holes in the occluders */
+void occlusion_rasterize(occlusion_buffer* ob, const vec3* positions, const uint32_t* indices, size_t num_indices, mat4 model);
+
+/* Reduces the depth buffer into the min/max pyramid, to be called once all occluders are in */
+void occlusion_build_hierarchy(occlusion_buffer* ob);
+
+/* Tests world space boxes against the pyramid, clears visible[i] of each box lying entirely
+ * behind the occluders. Returns number of boxes found occluded */
+size_t occlusion_cull_boxes(const occlusion_buffer* ob, const aabb* boxes, size_t count, uint8_t* visible);
+
+#endif /* ! _OCCLUSION_H_ */
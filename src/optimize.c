@@ -0,0 +1,275 @@
+#include "optimize.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+/* Entries of the simulated post transform vertex cache, a FIFO as found in most hardware */
+#define OPTIMIZE_CACHE_SIZE 16
+
+typedef struct cluster_key {
+    float key;
+    uint32_t cluster;
+} cluster_key;
+
+static const float* vertex_position(const void* positions, size_t stride, uint32_t v)
+{
+    return (const float*)((const char*)positions + v * stride);
+}
+
+/* Triangles around each vertex, the ones of vertex v are adj[offsets[v]] to adj[offsets[v + 1]] */
+static void build_adjacency(uint32_t* offsets, uint32_t* adj, const uint32_t* indices, size_t num_indices, size_t num_vertices)
+{
+    memset(offsets, 0, (num_vertices + 1) * sizeof(*offsets));
+    for (size_t i = 0; i < num_indices; ++i)
+        ++offsets[indices[i] + 1];
+    for (size_t v = 0; v < num_vertices; ++v)
+        offsets[v + 1] += offsets[v];
+    for (size_t i = 0; i < num_indices; ++i)
+        adj[offsets[indices[i]]++] = (uint32_t)(i / 3);
+    for (size_t v = num_vertices; v > 0; --v)
+        offsets[v] = offsets[v - 1];
+    offsets[0] = 0;
+}
+
+/* Vertices are cached when used no more than the cache size misses ago.
+ * Bumping the timestamp past the cache size flushes the whole cache */
+static int vertex_cached(const uint32_t* cache_time, uint32_t timestamp, uint32_t v)
+{
+    return timestamp - cache_time[v] <= OPTIMIZE_CACHE_SIZE;
+}
+
+static unsigned triangle_cache_misses(uint32_t* cache_time, uint32_t* timestamp, const uint32_t* tri)
+{
+    unsigned misses = 0;
+    for (int c = 0; c < 3; ++c) {
+        if (!vertex_cached(cache_time, *timestamp, tri[c])) {
+            cache_time[tri[c]] = (*timestamp)++;
+            ++misses;
+        }
+    }
+    return misses;
+}
+
+/* Next vertex to fan around, preferring the oldest cached candidate that stays cached while its
+ * remaining triangles are emitted. Falls back to dead end vertices, then to any vertex left */
+static int64_t tipsify_next_vertex(
+    const uint32_t* candidates, size_t num_candidates,
+    uint32_t* dead_end, size_t* dead_end_top, size_t* cursor,
+    const uint32_t* live, const uint32_t* cache_time, uint32_t timestamp, size_t num_vertices)
+{
+    int64_t best = -1;
+    int64_t best_priority = -1;
+    for (size_t i = 0; i < num_candidates; ++i) {
+        uint32_t v = candidates[i];
+        if (live[v] == 0)
+            continue;
+        int64_t priority = 0;
+        if (timestamp - cache_time[v] + 2 * live[v] <= OPTIMIZE_CACHE_SIZE)
+            priority = timestamp - cache_time[v];
+        if (priority > best_priority) {
+            best = v;
+            best_priority = priority;
+        }
+    }
+    if (best >= 0)
+        return best;
+
+    while (*dead_end_top > 0) {
+        uint32_t v = dead_end[--*dead_end_top];
+        if (live[v] > 0)
+            return v;
+    }
+    for (; *cursor < num_vertices; ++*cursor)
+        if (live[*cursor] > 0)
+            return *cursor;
+    return -1;
+}
+
+void optimize_vertex_cache(uint32_t* dst, const uint32_t* indices, size_t num_indices, size_t num_vertices)
+{
+    size_t count = num_indices - num_indices % 3;
+    memcpy(dst + count, indices + count, (num_indices - count) * sizeof(*dst));
+    if (count == 0)
+        return;
+
+    uint32_t* offsets = malloc((num_vertices + 1) * sizeof(*offsets));
+    uint32_t* adj = malloc(count * sizeof(*adj));
+    build_adjacency(offsets, adj, indices, count, num_vertices);
+
+    uint32_t* live = malloc(num_vertices * sizeof(*live));
+    for (size_t v = 0; v < num_vertices; ++v)
+        live[v] = offsets[v + 1] - offsets[v];
+    uint32_t* cache_time = calloc(num_vertices, sizeof(*cache_time));
+    uint8_t* emitted = calloc(count / 3, sizeof(*emitted));
+    uint32_t* dead_end = malloc(count * sizeof(*dead_end));
+    uint32_t* candidates = malloc(count * sizeof(*candidates));
+
+    uint32_t timestamp = OPTIMIZE_CACHE_SIZE + 1;
+    size_t dead_end_top = 0, cursor = 0, out = 0;
+    int64_t fan = indices[0];
+    while (fan >= 0) {
+        /* Emit every remaining triangle around the fanning vertex */
+        size_t num_candidates = 0;
+        for (uint32_t k = offsets[fan]; k < offsets[fan + 1]; ++k) {
+            uint32_t t = adj[k];
+            if (emitted[t])
+                continue;
+            for (int c = 0; c < 3; ++c) {
+                uint32_t v = indices[3 * t + c];
+                dst[out++] = v;
+                dead_end[dead_end_top++] = v;
+                candidates[num_candidates++] = v;
+                --live[v];
+                if (!vertex_cached(cache_time, timestamp, v))
+                    cache_time[v] = timestamp++;
+            }
+            emitted[t] = 1;
+        }
+        fan = tipsify_next_vertex(candidates, num_candidates, dead_end, &dead_end_top, &cursor, live, cache_time, timestamp, num_vertices);
+    }
+
+    free(candidates);
+    free(dead_end);
+    free(emitted);
+    free(cache_time);
+    free(live);
+    free(adj);
+    free(offsets);
+}
+
+/* Splits the triangles into clusters, writing the first triangle of each one and the triangle count at the end */
+static size_t overdraw_clusters(uint32_t* clusters, const uint32_t* indices, size_t num_triangles, size_t num_vertices, float threshold)
+{
+    uint32_t* cache_time = calloc(num_vertices, sizeof(*cache_time));
+    uint32_t timestamp = OPTIMIZE_CACHE_SIZE + 1;
+
+    /* Hard boundaries where all vertices of a triangle miss, the vertex cache optimizer started over */
+    uint32_t* hard = malloc((num_triangles + 1) * sizeof(*hard));
+    size_t num_hard = 0;
+    for (size_t t = 0; t < num_triangles; ++t)
+        if (triangle_cache_misses(cache_time, &timestamp, &indices[3 * t]) == 3 || t == 0)
+            hard[num_hard++] = (uint32_t)t;
+    hard[num_hard] = (uint32_t)num_triangles;
+
+    /* Soft boundaries inside each of them, wherever the cluster so far is about as cache friendly as the whole */
+    size_t num_clusters = 0;
+    for (size_t h = 0; h < num_hard; ++h) {
+        uint32_t start = hard[h], end = hard[h + 1];
+        timestamp += OPTIMIZE_CACHE_SIZE + 1;
+        size_t misses = 0;
+        for (uint32_t t = start; t < end; ++t)
+            misses += triangle_cache_misses(cache_time, &timestamp, &indices[3 * t]);
+        float limit = threshold * (float)misses / (float)(end - start);
+
+        timestamp += OPTIMIZE_CACHE_SIZE + 1;
+        clusters[num_clusters++] = start;
+        misses = 0;
+        for (uint32_t t = start; t < end; ++t) {
+            misses += triangle_cache_misses(cache_time, &timestamp, &indices[3 * t]);
+            if (t + 1 < end && (float)misses / (float)(t + 1 - start) <= limit) {
+                clusters[num_clusters++] = t + 1;
+                start = t + 1;
+                misses = 0;
+                timestamp += OPTIMIZE_CACHE_SIZE + 1;
+            }
+        }
+    }
+    clusters[num_clusters] = (uint32_t)num_triangles;
+
+    free(hard);
+    free(cache_time);
+    return num_clusters;
+}
+
+/* Area weighted centroid and normal of a triangle range, the normal is left unnormalized */
+static void triangles_centroid_normal(const uint32_t* indices, size_t first, size_t last, const void* positions, size_t stride, double c[3], double n[3])
+{
+    double area = 0.0;
+    c[0] = c[1] = c[2] = 0.0;
+    n[0] = n[1] = n[2] = 0.0;
+    for (size_t t = first; t < last; ++t) {
+        const float* p0 = vertex_position(positions, stride, indices[3 * t + 0]);
+        const float* p1 = vertex_position(positions, stride, indices[3 * t + 1]);
+        const float* p2 = vertex_position(positions, stride, indices[3 * t + 2]);
+        double e1[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+        double e2[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+        double tn[3] = {
+            e1[1] * e2[2] - e1[2] * e2[1],
+            e1[2] * e2[0] - e1[0] * e2[2],
+            e1[0] * e2[1] - e1[1] * e2[0],
+        };
+        double a = sqrt(tn[0] * tn[0] + tn[1] * tn[1] + tn[2] * tn[2]);
+        for (int k = 0; k < 3; ++k) {
+            c[k] += a * (p0[k] + p1[k] + p2[k]) / 3.0;
+            n[k] += tn[k];
+        }
+        area += a;
+    }
+    if (area > 0.0)
+        for (int k = 0; k < 3; ++k)
+            c[k] /= area;
+}
+
+static int cluster_key_cmp(const void* a, const void* b)
+{
+    const cluster_key* ka = a;
+    const cluster_key* kb = b;
+    return ka->key > kb->key ? -1 : ka->key < kb->key;
+}
+
+void optimize_overdraw(
+    uint32_t* dst, const uint32_t* indices, size_t num_indices,
+    const void* positions, size_t stride, size_t num_vertices,
+    float threshold)
+{
+    size_t count = num_indices - num_indices % 3;
+    memcpy(dst + count, indices + count, (num_indices - count) * sizeof(*dst));
+    size_t num_triangles = count / 3;
+    if (num_triangles == 0)
+        return;
+
+    uint32_t* clusters = malloc((num_triangles + 1) * sizeof(*clusters));
+    size_t num_clusters = overdraw_clusters(clusters, indices, num_triangles, num_vertices, threshold);
+
+    /* Clusters further out along their facing direction are more likely to occlude than to be occluded */
+    double mc[3], mn[3];
+    triangles_centroid_normal(indices, 0, num_triangles, positions, stride, mc, mn);
+    cluster_key* keys = malloc(num_clusters * sizeof(*keys));
+    for (size_t i = 0; i < num_clusters; ++i) {
+        double c[3], n[3];
+        triangles_centroid_normal(indices, clusters[i], clusters[i + 1], positions, stride, c, n);
+        double len = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        double d = (c[0] - mc[0]) * n[0] + (c[1] - mc[1]) * n[1] + (c[2] - mc[2]) * n[2];
+        keys[i] = (cluster_key){ .key = len > 0.0 ? (float)(d / len) : 0.0f, .cluster = (uint32_t)i };
+    }
+    qsort(keys, num_clusters, sizeof(*keys), cluster_key_cmp);
+
+    size_t out = 0;
+    for (size_t i = 0; i < num_clusters; ++i) {
+        uint32_t c = keys[i].cluster;
+        size_t n = 3 * (clusters[c + 1] - clusters[c]);
+        memcpy(dst + out, indices + 3 * clusters[c], n * sizeof(*dst));
+        out += n;
+    }
+
+    free(keys);
+    free(clusters);
+}
+
+size_t optimize_vertex_fetch(void* dst, uint32_t* indices, size_t num_indices, const void* vertices, size_t num_vertices, size_t vertex_size)
+{
+    uint32_t* remap = malloc(num_vertices * sizeof(*remap));
+    memset(remap, 0xFF, num_vertices * sizeof(*remap));
+    size_t count = 0;
+    for (size_t i = 0; i < num_indices; ++i) {
+        uint32_t v = indices[i];
+        if (remap[v] == ~0u) {
+            remap[v] = (uint32_t)count;
+            memcpy((char*)dst + count * vertex_size, (const char*)vertices + v * vertex_size, vertex_size);
+            ++count;
+        }
+        indices[i] = remap[v];
+    }
+    free(remap);
+    return count;
+}
@@ -0,0 +1,57 @@
+/*********************************************************************************************************************/
+/*                                                  /===-_---~~~~~~~~~------____                                     */
+/*                                                 |===-~___                _,-'                                     */
+/*                  -==\\                         `//~\\   ~~~~`---.___.-~~                                          */
+/*              ______-==|                         | |  \\           _-~`                                            */
+/*        __--~~~  ,-/-==\\                        | |   `\        ,'                                                */
+/*     _-~       /'    |  \\                      / /      \      /                                                  */
+/*   .'        /       |   \\                   /' /        \   /'                                                   */
+/*  /  ____  /         |    \`\.__/-~~ ~ \ _ _/'  /          \/'                                                     */
+/* /-'~    ~~~~~---__  |     ~-/~         ( )   /'        _--~`                                                      */
+/*                   \_|      /        _)   ;  ),   __--~~                                                           */
+/*                     '~~--_/      _-~/-  / \   '-~ \                                                               */
+/*                    {\__--_/}    / \\_>- )<__\      \                                                              */
+/*                    /'   (_/  _-~  | |__>--<__|      |                                                             */
+/*                   |0  0 _/) )-~     | |__>--<__|     |                                                            */
+/*                   / /~ ,_/       / /__>---<__/      |                                                             */
+/*                  o o _//        /-~_>---<__-~      /                                                              */
+/*                  (^(~          /~_>---<__-      _-~                                                               */
+/*                 ,/|           /__>--<__/     _-~                                                                  */
+/*              ,//('(          |__>--<__|     /                  .----_                                             */
+/*             ( ( '))          |__>--<__|    |                 /' _---_~\                                           */
+/*          `-)) )) (           |__>--<__|    |               /'  /     ~\`\                                         */
+/*         ,/,'//( (             \__>--<__\    \            /'  //        ||                                         */
+/*       ,( ( ((, ))              ~-__>--<_~-_  ~--____---~' _/'/        /'                                          */
+/*     `~/  )` ) ,/|                 ~-_~>--<_/-__       __-~ _/                                                     */
+/*   ._-~//( )/ )) `                    ~~-'_/_/ /~~~~~~~__--~                                                       */
+/*    ;'( ')/ ,)(                              ~~~~~~~~~~                                                            */
+/*   ' ') '( (/                                                                                                      */
+/*     '   '  `                                                                                                      */
+/*********************************************************************************************************************/
+#ifndef _OPTIMIZE_H_
+#define _OPTIMIZE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Reorders the triangles of an indexed triangle list for the post transform vertex cache with Tipsify,
+ * fanning around the most recently used vertices and restarting from the last dead end vertices.
+ * Writes num_indices indices to dst, which must not alias indices */
+void optimize_vertex_cache(uint32_t* dst, const uint32_t* indices, size_t num_indices, size_t num_vertices);
+
+/* Reorders clusters of a cache optimized triangle list so that triangles facing outwards of the mesh
+ * come first and occlude the ones behind them. Clusters split where the cache restarts, and further
+ * where their cache miss ratio stays within threshold times the one of the whole cluster. Positions
+ * are three floats found every stride bytes. Writes num_indices indices to dst, which must not alias indices */
+void optimize_overdraw(
+    uint32_t* dst, const uint32_t* indices, size_t num_indices,
+    const void* positions, size_t stride, size_t num_vertices,
+    float threshold
+);
+
+/* Reorders vertices in the order the index list first references them, for linear vertex fetches.
+ * Rewrites indices in place and copies the vertices into dst, which must not alias vertices.
+ * Unreferenced vertices are dropped, returns the number of vertices written */
+size_t optimize_vertex_fetch(void* dst, uint32_t* indices, size_t num_indices, const void* vertices, size_t num_vertices, size_t vertex_size);
+
+#endif /* ! _OPTIMIZE_H_ */
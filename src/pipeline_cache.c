@@ -0,0 +1,188 @@
+#include "pipeline_cache.h"
+#include <stdlib.h>
+#include <string.h>
+#include "hashmap.h"
+
+static struct {
+    hashmap_t* shaders;   /* Description key to shader id */
+    hashmap_t* pipelines; /* Description key to pipeline id */
+} cache;
+
+/* Canonical encoding of a description, written field by field so that padding never takes part.
+ * The whole encoding is the hashmap key, so that hits compare the full description */
+typedef struct desc_key {
+    uint8_t* data;
+    size_t size;
+    size_t cap;
+} desc_key;
+
+static void key_bytes(desc_key* k, const void* data, size_t size)
+{
+    if (k->size + size > k->cap) {
+        k->cap = k->cap ? k->cap : 256;
+        while (k->size + size > k->cap)
+            k->cap *= 2;
+        k->data = realloc(k->data, k->cap);
+    }
+    memcpy(k->data + k->size, data, size);
+    k->size += size;
+}
+
+static void key_int(desc_key* k, int64_t v)
+{
+    key_bytes(k, &v, sizeof(v));
+}
+
+static void key_float(desc_key* k, float v)
+{
+    key_bytes(k, &v, sizeof(v));
+}
+
+/* Null and empty strings encode differently */
+static void key_string(desc_key* k, const char* s)
+{
+    key_int(k, s ? (int64_t)strlen(s) : -1);
+    if (s)
+        key_bytes(k, s, strlen(s));
+}
+
+static void key_shader_stage(desc_key* k, const gfx_shader_stage_desc* sd)
+{
+    key_string(k, sd->source);
+    key_int(k, sd->bytecode.ptr ? (int64_t)sd->bytecode.size : -1);
+    if (sd->bytecode.ptr)
+        key_bytes(k, sd->bytecode.ptr, sd->bytecode.size);
+    key_string(k, sd->entry);
+    key_string(k, sd->d3d11_target);
+    for (int i = 0; i < GFX_MAX_SHADERSTAGE_UBS; ++i) {
+        const gfx_shader_uniform_block_desc* ub = &sd->uniform_blocks[i];
+        key_int(k, ub->size);
+        for (int j = 0; j < GFX_MAX_UB_MEMBERS; ++j) {
+            key_string(k, ub->uniforms[j].name);
+            key_int(k, ub->uniforms[j].type);
+            key_int(k, ub->uniforms[j].array_count);
+        }
+    }
+    for (int i = 0; i < GFX_MAX_SHADERSTAGE_IMAGES; ++i) {
+        key_string(k, sd->images[i].name);
+        key_int(k, sd->images[i].image_type);
+        key_int(k, sd->images[i].sampler_type);
+    }
+}
+
+static void key_shader_desc(desc_key* k, const gfx_shader_desc* desc)
+{
+    for (int i = 0; i < GFX_MAX_VERTEX_ATTRIBUTES; ++i) {
+        key_string(k, desc->attrs[i].name);
+        key_string(k, desc->attrs[i].sem_name);
+        key_int(k, desc->attrs[i].sem_index);
+    }
+    key_shader_stage(k, &desc->vs);
+    key_shader_stage(k, &desc->fs);
+}
+
+/* Every field but the label */
+static void key_pipeline_desc(desc_key* k, const gfx_pipeline_desc* desc)
+{
+    key_int(k, desc->shader.id);
+    for (int i = 0; i < GFX_MAX_SHADERSTAGE_BUFFERS; ++i) {
+        key_int(k, desc->layout.buffers[i].stride);
+        key_int(k, desc->layout.buffers[i].step_func);
+        key_int(k, desc->layout.buffers[i].step_rate);
+    }
+    for (int i = 0; i < GFX_MAX_VERTEX_ATTRIBUTES; ++i) {
+        key_int(k, desc->layout.attrs[i].buffer_index);
+        key_int(k, desc->layout.attrs[i].offset);
+        key_int(k, desc->layout.attrs[i].format);
+    }
+    key_int(k, desc->depth.pixel_format);
+    key_int(k, desc->depth.compare);
+    key_int(k, desc->depth.write_enabled);
+    key_float(k, desc->depth.bias);
+    key_float(k, desc->depth.bias_slope_scale);
+    key_float(k, desc->depth.bias_clamp);
+    key_int(k, desc->stencil.enabled);
+    key_int(k, desc->stencil.front.compare);
+    key_int(k, desc->stencil.front.fail_op);
+    key_int(k, desc->stencil.front.depth_fail_op);
+    key_int(k, desc->stencil.front.pass_op);
+    key_int(k, desc->stencil.back.compare);
+    key_int(k, desc->stencil.back.fail_op);
+    key_int(k, desc->stencil.back.depth_fail_op);
+    key_int(k, desc->stencil.back.pass_op);
+    key_int(k, desc->stencil.read_mask);
+    key_int(k, desc->stencil.write_mask);
+    key_int(k, desc->stencil.ref);
+    key_int(k, desc->color_count);
+    for (int i = 0; i < GFX_MAX_COLOR_ATTACHMENTS; ++i) {
+        const gfx_color_state* cs = &desc->colors[i];
+        key_int(k, cs->pixel_format);
+        key_int(k, cs->write_mask);
+        key_int(k, cs->blend.enabled);
+        key_int(k, cs->blend.src_factor_rgb);
+        key_int(k, cs->blend.dst_factor_rgb);
+        key_int(k, cs->blend.op_rgb);
+        key_int(k, cs->blend.src_factor_alpha);
+        key_int(k, cs->blend.dst_factor_alpha);
+        key_int(k, cs->blend.op_alpha);
+    }
+    key_int(k, desc->primitive_type);
+    key_int(k, desc->index_type);
+    key_int(k, desc->cull_mode);
+    key_int(k, desc->face_winding);
+    key_int(k, desc->sample_count);
+    key_float(k, desc->blend_color.r);
+    key_float(k, desc->blend_color.g);
+    key_float(k, desc->blend_color.b);
+    key_float(k, desc->blend_color.a);
+    key_int(k, desc->alpha_to_coverage_enabled);
+}
+
+void pipeline_cache_setup()
+{
+    cache.shaders = hashmap_create(0, 0);
+    cache.pipelines = hashmap_create(0, 0);
+}
+
+void pipeline_cache_shutdown()
+{
+    /* Pipelines go first, as they reference the shaders */
+    uintmax_t iter = HM_WALK_BEGIN;
+    void* val;
+    while (hashmap_walk(cache.pipelines, &iter, 0, &val) != 0)
+        gfx_destroy_pipeline((gfx_pipeline){ .id = (uint32_t)(uintptr_t)val });
+    iter = HM_WALK_BEGIN;
+    while (hashmap_walk(cache.shaders, &iter, 0, &val) != 0)
+        gfx_destroy_shader((gfx_shader){ .id = (uint32_t)(uintptr_t)val });
+    hashmap_destroy(cache.pipelines);
+    hashmap_destroy(cache.shaders);
+    cache.pipelines = cache.shaders = 0;
+}
+
+gfx_shader pipeline_cache_shader(const gfx_shader_desc* desc)
+{
+    desc_key key = {0};
+    key_shader_desc(&key, desc);
+    void* val = hashmap_get(cache.shaders, key.data, key.size);
+    gfx_shader shd = { .id = (uint32_t)(uintptr_t)val };
+    if (!val) {
+        shd = gfx_make_shader(desc);
+        hashmap_put(cache.shaders, key.data, key.size, (void*)(uintptr_t)shd.id);
+    }
+    free(key.data);
+    return shd;
+}
+
+gfx_pipeline pipeline_cache_pipeline(const gfx_pipeline_desc* desc)
+{
+    desc_key key = {0};
+    key_pipeline_desc(&key, desc);
+    void* val = hashmap_get(cache.pipelines, key.data, key.size);
+    gfx_pipeline pip = { .id = (uint32_t)(uintptr_t)val };
+    if (!val) {
+        pip = gfx_make_pipeline(desc);
+        hashmap_put(cache.pipelines, key.data, key.size, (void*)(uintptr_t)pip.id);
+    }
+    free(key.data);
+    return pip;
+}
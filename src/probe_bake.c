@@ -0,0 +1,160 @@
+#include "probe_bake.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PROBE_BAKE_MAGIC (0x42525043) /* "CPRB" */
+#define PROBE_BAKE_VERSION (1)
+
+/* On disk header, followed by the probe records and every atlas level in order */
+typedef struct probe_bake_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t tile_res;
+    uint32_t num_mips;
+    uint32_t num_probes;
+    uint32_t width;
+    uint32_t height;
+    uint32_t reserved;
+} probe_bake_header;
+
+static uint32_t level_extent(uint32_t v, uint32_t mip)
+{
+    v >>= mip;
+    return v ? v : 1;
+}
+
+/* Sets up records and level pointers for a bake blob laid out as on disk past the header */
+static size_t probe_bake_layout(probe_bake* pb, unsigned char* base)
+{
+    size_t ofs = pb->num_probes * sizeof(probe_bake_record);
+    pb->probes = (probe_bake_record*)base;
+    for (uint32_t m = 0; m < pb->num_mips; ++m) {
+        pb->level_sizes[m] = (size_t)level_extent(pb->width, m) * level_extent(pb->height, m) * 4;
+        pb->levels[m] = base ? base + ofs : 0;
+        ofs += pb->level_sizes[m];
+    }
+    return ofs;
+}
+
+void probe_bake_init(probe_bake* pb, uint32_t num_probes, uint32_t tile_res)
+{
+    memset(pb, 0, sizeof(*pb));
+    uint32_t rows = (num_probes + PROBE_BAKE_TILES_PER_ROW - 1) / PROBE_BAKE_TILES_PER_ROW;
+    pb->tile_res   = tile_res;
+    pb->num_probes = num_probes;
+    pb->width      = tile_res * PROBE_BAKE_TILES_PER_ROW;
+    pb->height     = tile_res * (rows ? rows : 1);
+    for (uint32_t r = tile_res; r > 0 && pb->num_mips < PROBE_BAKE_MAX_MIPS; r >>= 1)
+        ++pb->num_mips;
+    size_t size = probe_bake_layout(pb, 0);
+    pb->data = calloc(1, sizeof(probe_bake_header) + size);
+    probe_bake_layout(pb, (unsigned char*)pb->data + sizeof(probe_bake_header));
+}
+
+unsigned char* probe_bake_tile(probe_bake* pb, uint32_t probe, size_t* pitch)
+{
+    uint32_t x = (probe % PROBE_BAKE_TILES_PER_ROW) * pb->tile_res;
+    uint32_t y = (probe / PROBE_BAKE_TILES_PER_ROW) * pb->tile_res;
+    *pitch = (size_t)pb->width * 4;
+    return pb->levels[0] + y * *pitch + x * 4;
+}
+
+void probe_bake_build_mips(probe_bake* pb)
+{
+    /* Tiles are power of two and aligned to their size, so a 2x2 box never crosses tile borders */
+    for (uint32_t m = 1; m < pb->num_mips; ++m) {
+        const uint32_t sw = level_extent(pb->width, m - 1), sh = level_extent(pb->height, m - 1);
+        const uint32_t dw = level_extent(pb->width, m),     dh = level_extent(pb->height, m);
+        const unsigned char* src = pb->levels[m - 1];
+        unsigned char* dst = pb->levels[m];
+        for (uint32_t y = 0; y < dh; ++y) {
+            for (uint32_t x = 0; x < dw; ++x) {
+                const uint32_t x0 = x * 2, x1 = x0 + 1 < sw ? x0 + 1 : x0;
+                const uint32_t y0 = y * 2, y1 = y0 + 1 < sh ? y0 + 1 : y0;
+                for (int c = 0; c < 4; ++c) {
+                    unsigned sum = src[(y0 * sw + x0) * 4 + c] + src[(y0 * sw + x1) * 4 + c]
+                                 + src[(y1 * sw + x0) * 4 + c] + src[(y1 * sw + x1) * 4 + c];
+                    dst[(y * dw + x) * 4 + c] = (unsigned char)((sum + 2) / 4);
+                }
+            }
+        }
+    }
+}
+
+int probe_bake_save(const probe_bake* pb, const char* fpath)
+{
+    FILE* f = fopen(fpath, "wb");
+    if (!f)
+        return -1;
+
+    /* Header is written in place in front of the blob, so the file goes out with a single write */
+    probe_bake_header* hdr = pb->data;
+    *hdr = (probe_bake_header){
+        .magic      = PROBE_BAKE_MAGIC,
+        .version    = PROBE_BAKE_VERSION,
+        .tile_res   = pb->tile_res,
+        .num_mips   = pb->num_mips,
+        .num_probes = pb->num_probes,
+        .width      = pb->width,
+        .height     = pb->height,
+    };
+    size_t size = sizeof(*hdr) + probe_bake_layout(&(probe_bake){
+        .num_probes = pb->num_probes,
+        .num_mips   = pb->num_mips,
+        .width      = pb->width,
+        .height     = pb->height,
+    }, 0);
+    size_t written = fwrite(pb->data, 1, size, f);
+    fclose(f);
+    return written == size ? 0 : -1;
+}
+
+int probe_bake_load(probe_bake* pb, const char* fpath)
+{
+    memset(pb, 0, sizeof(*pb));
+    FILE* f = fopen(fpath, "rb");
+    if (!f)
+        return -1;
+
+    /* Gather size */
+    fseek(f, 0, SEEK_END);
+    long file_sz = ftell(f);
+    rewind(f);
+    if (file_sz < (long)sizeof(probe_bake_header)) {
+        fclose(f);
+        return -1;
+    }
+
+    /* Read whole file at once, records and levels are used in place */
+    void* data = malloc(file_sz);
+    size_t read = fread(data, 1, file_sz, f);
+    fclose(f);
+    probe_bake_header* hdr = data;
+    if (read != (size_t)file_sz
+     || hdr->magic != PROBE_BAKE_MAGIC
+     || hdr->version != PROBE_BAKE_VERSION
+     || hdr->num_mips == 0 || hdr->num_mips > PROBE_BAKE_MAX_MIPS) {
+        free(data);
+        return -1;
+    }
+    pb->tile_res   = hdr->tile_res;
+    pb->num_mips   = hdr->num_mips;
+    pb->num_probes = hdr->num_probes;
+    pb->width      = hdr->width;
+    pb->height     = hdr->height;
+    if (sizeof(*hdr) + probe_bake_layout(pb, 0) != (size_t)file_sz) {
+        free(data);
+        memset(pb, 0, sizeof(*pb));
+        return -1;
+    }
+    pb->data = data;
+    probe_bake_layout(pb, (unsigned char*)data + sizeof(*hdr));
+    return 0;
+}
+
+void probe_bake_free(probe_bake* pb)
+{
+    free(pb->data);
+    memset(pb, 0, sizeof(*pb));
+}
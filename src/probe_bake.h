@@ -0,0 +1,82 @@
+/*********************************************************************************************************************/
+/*                                                  /===-_---~~~~~~~~~------____                                     */
+/*                                                 |===-~___                _,-'                                     */
+/*                  -==\\                         `//~\\   ~~~~`---.___.-~~                                          */
+/*              ______-==|                         | |  \\           _-~`                                            */
+/*        __--~~~  ,-/-==\\                        | |   `\        ,'                                                */
+/*     _-~       /'    |  \\                      / /      \      /                                                  */
+/*   .'        /       |   \\                   /' /        \   /'                                                   */
+/*  /  ____  /         |    \`\.__/-~~ ~ \ _ _/'  /          \/'                                                     */
+/* /-'~    ~~~~~---__  |     ~-/~         ( )   /'        _--~`                                                      */
+/*                   \_|      /        _)   ;  ),   __--~~                                                           */
+/*                     '~~--_/      _-~/-  / \   '-~ \                                                               */
+/*                    {\__--_/}    / \\_>- )<__\      \                                                              */
+/*                    /'   (_/  _-~  | |__>--<__|      |                                                             */
+/*                   |0  0 _/) )-~     | |__>--<__|     |                                                            */
+/*                   / /~ ,_/       / /__>---<__/      |                                                             */
+/*                  o o _//        /-~_>---<__-~      /                                                              */
+/*                  (^(~          /~_>---<__-      _-~                                                               */
+/*                 ,/|           /__>--<__/     _-~                                                                  */
+/*              ,//('(          |__>--<__|     /                  .----_                                             */
+/*             ( ( '))          |__>--<__|    |                 /' _---_~\                                           */
+/*          `-)) )) (           |__>--<__|    |               /'  /     ~\`\                                         */
+/*         ,/,'//( (             \__>--<__\    \            /'  //        ||                                         */
+/*       ,( ( ((, ))              ~-__>--<_~-_  ~--____---~' _/'/        /'                                          */
+/*     `~/  )` ) ,/|                 ~-_~>--<_/-__       __-~ _/                                                     */
+/*   ._-~//( )/ )) `                    ~~-'_/_/ /~~~~~~~__--~                                                       */
+/*    ;'( ')/ ,)(                              ~~~~~~~~~~                                                            */
+/*   ' ') '( (/                                                                                                      */
+/*     '   '  `                                                                                                      */
+/*********************************************************************************************************************/
+#ifndef _PROBE_BAKE_H_
+#define _PROBE_BAKE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <linmath.h>
+
+#define PROBE_BAKE_MAX_MIPS (16)
+#define PROBE_BAKE_TILES_PER_ROW (8)
+
+/* Baked probe, index of the record is the index of its atlas tile */
+typedef struct probe_bake_record {
+    vec3 position;
+    float radius;
+} probe_bake_record;
+
+/*
+ * Baked probe atlas. Tiles hold octahedral RGBA8 captures laid out
+ * PROBE_BAKE_TILES_PER_ROW to a row, each level is a full atlas image
+ * ready for upload.
+ */
+typedef struct probe_bake {
+    uint32_t tile_res;
+    uint32_t num_mips;
+    uint32_t num_probes;
+    uint32_t width;
+    uint32_t height;
+    probe_bake_record* probes;
+    unsigned char* levels[PROBE_BAKE_MAX_MIPS];
+    size_t level_sizes[PROBE_BAKE_MAX_MIPS];
+    void* data;
+} probe_bake;
+
+/* Allocates an empty bake for num_probes tiles of tile_res size, with a full mip chain down to 1x1 tiles */
+void probe_bake_init(probe_bake* pb, uint32_t num_probes, uint32_t tile_res);
+
+/* Returns pointer to the top level texels of the given tile along with the row pitch in bytes */
+unsigned char* probe_bake_tile(probe_bake* pb, uint32_t probe, size_t* pitch);
+
+/* Box filters the top level of every tile down the mip chain */
+void probe_bake_build_mips(probe_bake* pb);
+
+/* Writes the bake to given file, returns 0 on success */
+int probe_bake_save(const probe_bake* pb, const char* fpath);
+
+/* Reads a bake from given file with a single read, returns 0 on success */
+int probe_bake_load(probe_bake* pb, const char* fpath);
+
+/* Frees bake memory */
+void probe_bake_free(probe_bake* pb);
+
+#endif /* ! _PROBE_BAKE_H_ */
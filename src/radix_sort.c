@@ -0,0 +1,57 @@
+#include "radix_sort.h"
+#include <string.h>
+
+#define RADIX_BITS (8)
+#define RADIX_SIZE (1 << RADIX_BITS)
+#define RADIX_PASSES (64 / RADIX_BITS)
+
+void radix_sort64(uint64_t* keys, uint32_t* vals, uint64_t* tmp_keys, uint32_t* tmp_vals, size_t count)
+{
+    if (count == 0)
+        return;
+
+    /* Build histograms of all digits in a single sweep */
+    size_t hist[RADIX_PASSES][RADIX_SIZE];
+    memset(hist, 0, sizeof(hist));
+    for (size_t i = 0; i < count; ++i) {
+        uint64_t k = keys[i];
+        for (int p = 0; p < RADIX_PASSES; ++p)
+            ++hist[p][(k >> (p * RADIX_BITS)) & (RADIX_SIZE - 1)];
+    }
+
+    uint64_t* src_keys = keys; uint32_t* src_vals = vals;
+    uint64_t* dst_keys = tmp_keys; uint32_t* dst_vals = tmp_vals;
+    for (int p = 0; p < RADIX_PASSES; ++p) {
+        /* Skip digits shared by all keys */
+        size_t* h = hist[p];
+        const uint64_t first_digit = (src_keys[0] >> (p * RADIX_BITS)) & (RADIX_SIZE - 1);
+        if (h[first_digit] == count)
+            continue;
+
+        /* Exclusive prefix sum into bucket offsets */
+        size_t sum = 0;
+        for (int b = 0; b < RADIX_SIZE; ++b) {
+            size_t c = h[b];
+            h[b] = sum;
+            sum += c;
+        }
+
+        /* Scatter */
+        for (size_t i = 0; i < count; ++i) {
+            uint64_t k = src_keys[i];
+            size_t o = h[(k >> (p * RADIX_BITS)) & (RADIX_SIZE - 1)]++;
+            dst_keys[o] = k;
+            dst_vals[o] = src_vals[i];
+        }
+
+        /* Swap buffers */
+        uint64_t* tk = src_keys; src_keys = dst_keys; dst_keys = tk;
+        uint32_t* tv = src_vals; src_vals = dst_vals; dst_vals = tv;
+    }
+
+    /* Result ended up in scratch space */
+    if (src_keys != keys) {
+        memcpy(keys, src_keys, count * sizeof(*keys));
+        memcpy(vals, src_vals, count * sizeof(*vals));
+    }
+}
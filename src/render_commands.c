@@ -0,0 +1,144 @@
+#include "render_commands.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* Uniform blocks are copied at this alignment, so they can be read in place at replay */
+#define RENDER_COMMANDS_UNIFORM_ALIGN 16
+
+/* Makes room for one more element, doubling the capacity when full */
+static void* grow(void* data, size_t count, size_t* cap, size_t elem_size, size_t min_cap)
+{
+    if (count < *cap)
+        return data;
+    size_t new_cap = *cap ? 2 * *cap : min_cap;
+    while (new_cap <= count)
+        new_cap *= 2;
+    *cap = new_cap;
+    return realloc(data, new_cap * elem_size);
+}
+
+static render_command* push_command(render_commands* rc, render_command_type type)
+{
+    rc->commands = grow(rc->commands, rc->num_commands, &rc->cap_commands, sizeof(*rc->commands), 256);
+    render_command* cmd = &rc->commands[rc->num_commands++];
+    cmd->type = type;
+    return cmd;
+}
+
+void render_commands_init(render_commands* rc)
+{
+    *rc = (render_commands){0};
+}
+
+void render_commands_destroy(render_commands* rc)
+{
+    free(rc->uniforms);
+    free(rc->bindings);
+    free(rc->commands);
+    *rc = (render_commands){0};
+}
+
+void render_commands_reset(render_commands* rc)
+{
+    rc->num_commands = 0;
+    rc->num_bindings = 0;
+    rc->uniforms_size = 0;
+}
+
+void render_commands_viewport(render_commands* rc, int x, int y, int width, int height, int origin_top_left)
+{
+    render_command* cmd = push_command(rc, RENDER_COMMAND_VIEWPORT);
+    cmd->data.rect.x = x;
+    cmd->data.rect.y = y;
+    cmd->data.rect.width = width;
+    cmd->data.rect.height = height;
+    cmd->data.rect.origin_top_left = origin_top_left;
+}
+
+void render_commands_scissor(render_commands* rc, int x, int y, int width, int height, int origin_top_left)
+{
+    render_command* cmd = push_command(rc, RENDER_COMMAND_SCISSOR);
+    cmd->data.rect.x = x;
+    cmd->data.rect.y = y;
+    cmd->data.rect.width = width;
+    cmd->data.rect.height = height;
+    cmd->data.rect.origin_top_left = origin_top_left;
+}
+
+void render_commands_pipeline(render_commands* rc, gfx_pipeline pip)
+{
+    render_command* cmd = push_command(rc, RENDER_COMMAND_PIPELINE);
+    cmd->data.pipeline = pip;
+}
+
+void render_commands_bindings(render_commands* rc, const gfx_bindings* binds, uint32_t input_fs_images)
+{
+    rc->bindings = grow(rc->bindings, rc->num_bindings, &rc->cap_bindings, sizeof(*rc->bindings), 64);
+    rc->bindings[rc->num_bindings] = *binds;
+    render_command* cmd = push_command(rc, RENDER_COMMAND_BINDINGS);
+    cmd->data.bindings.index = (uint32_t)rc->num_bindings++;
+    cmd->data.bindings.input_fs_images = input_fs_images;
+}
+
+void render_commands_uniforms(render_commands* rc, gfx_shader_stage stage, int slot, const void* data, size_t size)
+{
+    size_t offset = (rc->uniforms_size + RENDER_COMMANDS_UNIFORM_ALIGN - 1) & ~(size_t)(RENDER_COMMANDS_UNIFORM_ALIGN - 1);
+    if (offset + size > rc->cap_uniforms) {
+        size_t new_cap = rc->cap_uniforms ? 2 * rc->cap_uniforms : 4096;
+        while (new_cap < offset + size)
+            new_cap *= 2;
+        rc->uniforms = realloc(rc->uniforms, new_cap);
+        rc->cap_uniforms = new_cap;
+    }
+    memcpy(rc->uniforms + offset, data, size);
+    rc->uniforms_size = offset + size;
+
+    render_command* cmd = push_command(rc, RENDER_COMMAND_UNIFORMS);
+    cmd->data.uniforms.stage = (uint32_t)stage;
+    cmd->data.uniforms.slot = (uint32_t)slot;
+    cmd->data.uniforms.offset = (uint32_t)offset;
+    cmd->data.uniforms.size = (uint32_t)size;
+}
+
+void render_commands_draw(render_commands* rc, int base_element, int num_elements, int num_instances)
+{
+    render_command* cmd = push_command(rc, RENDER_COMMAND_DRAW);
+    cmd->data.draw.base_element = base_element;
+    cmd->data.draw.num_elements = num_elements;
+    cmd->data.draw.num_instances = num_instances;
+}
+
+void render_commands_replay(const render_commands* rc, gfx_image input)
+{
+    for (size_t i = 0; i < rc->num_commands; ++i) {
+        const render_command* cmd = &rc->commands[i];
+        switch (cmd->type) {
+            case RENDER_COMMAND_VIEWPORT:
+                gfx_apply_viewport(cmd->data.rect.x, cmd->data.rect.y, cmd->data.rect.width, cmd->data.rect.height, cmd->data.rect.origin_top_left);
+                break;
+            case RENDER_COMMAND_SCISSOR:
+                gfx_apply_scissor_rect(cmd->data.rect.x, cmd->data.rect.y, cmd->data.rect.width, cmd->data.rect.height, cmd->data.rect.origin_top_left);
+                break;
+            case RENDER_COMMAND_PIPELINE:
+                gfx_apply_pipeline(cmd->data.pipeline);
+                break;
+            case RENDER_COMMAND_BINDINGS: {
+                gfx_bindings binds = rc->bindings[cmd->data.bindings.index];
+                for (int s = 0; s < GFX_MAX_SHADERSTAGE_IMAGES; ++s)
+                    if (cmd->data.bindings.input_fs_images & (1u << s))
+                        binds.fs_images[s] = input;
+                gfx_apply_bindings(&binds);
+                break;
+            }
+            case RENDER_COMMAND_UNIFORMS:
+                gfx_apply_uniforms(
+                    (gfx_shader_stage)cmd->data.uniforms.stage,
+                    (int)cmd->data.uniforms.slot,
+                    &(gfx_range){rc->uniforms + cmd->data.uniforms.offset, cmd->data.uniforms.size});
+                break;
+            case RENDER_COMMAND_DRAW:
+                gfx_draw(cmd->data.draw.base_element, cmd->data.draw.num_elements, cmd->data.draw.num_instances);
+                break;
+        }
+    }
+}
@@ -0,0 +1,111 @@
+/*********************************************************************************************************************/
+/*                                                  /===-_---~~~~~~~~~------____                                     */
+/*                                                 |===-~___                _,-'                                     */
+/*                  -==\\                         `//~\\   ~~~~`---.___.-~~                                          */
+/*              ______-==|                         | |  \\           _-~`                                            */
+/*        __--~~~  ,-/-==\\                        | |   `\        ,'                                                */
+/*     _-~       /'    |  \\                      / /      \      /                                                  */
+/*   .'        /       |   \\                   /' /        \   /'                                                   */
+/*  /  ____  /         |    \`\.__/-~~ ~ \ _ _/'  /          \/'                                                     */
+/* /-'~    ~~~~~---__  |     ~-/~         ( )   /'        _--~`                                                      */
+/*                   \_|      /        _)   ;  ),   __--~~                                                           */
+/*                     '~~--_/      _-~/-  / \   '-~ \                                                               */
+/*                    {\__--_/}    / \\_>- )<__\      \                                                              */
+/*                    /'   (_/  _-~  | |__>--<__|      |                                                             */
+/*                   |0  0 _/) )-~     | |__>--<__|     |                                                            */
+/*                   / /~ ,_/       / /__>---<__/      |                                                             */
+/*                  o o _//        /-~_>---<__-~      /                                                              */
+/*                  (^(~          /~_>---<__-      _-~                                                               */
+/*                 ,/|           /__>--<__/     _-~                                                                  */
+/*              ,//('(          |__>--<__|     /                  .----_                                             */
+/*             ( ( '))          |__>--<__|    |                 /' _---_~\                                           */
+/*          `-)) )) (           |__>--<__|    |               /'  /     ~\`\                                         */
+/*         ,/,'//( (             \__>--<__\    \            /'  //        ||                                         */
+/*       ,( ( ((, ))              ~-__>--<_~-_  ~--____---~' _/'/        /'                                          */
+/*     `~/  )` ) ,/|                 ~-_~>--<_/-__       __-~ _/                                                     */
+/*   ._-~//( )/ )) `                    ~~-'_/_/ /~~~~~~~__--~                                                       */
+/*    ;'( ')/ ,)(                              ~~~~~~~~~~                                                            */
+/*   ' ') '( (/                                                                                                      */
+/*     '   '  `                                                                                                      */
+/*********************************************************************************************************************/
+#ifndef _RENDER_COMMANDS_H_
+#define _RENDER_COMMANDS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "gfx.h"
+
+/*
+ * Plain data recording of the gfx calls of a pass, to be replayed later in recording order.
+ *
+ * => Recording makes no gfx calls, so buffers of different views can be filled
+ *    on worker threads at once. Each buffer must only be recorded by a single thread.
+ * => Replay is a straight walk over the commands and happens on the rendering thread.
+ * => Uniform blocks are copied into the buffer, bindings are kept aside
+ *    as they are far larger than the other commands.
+ * => Storage is kept across resets, so steady state recording does not allocate.
+ */
+typedef enum render_command_type {
+    RENDER_COMMAND_VIEWPORT,
+    RENDER_COMMAND_SCISSOR,
+    RENDER_COMMAND_PIPELINE,
+    RENDER_COMMAND_BINDINGS,
+    RENDER_COMMAND_UNIFORMS,
+    RENDER_COMMAND_DRAW,
+} render_command_type;
+
+typedef struct render_command {
+    uint32_t type;
+    union {
+        struct {
+            int x, y, width, height;
+            int origin_top_left;
+        } rect;
+        gfx_pipeline pipeline;
+        struct {
+            uint32_t index;           /* Into the bindings of the buffer */
+            uint32_t input_fs_images; /* Mask of fragment image slots bound to the replay input */
+        } bindings;
+        struct {
+            uint32_t stage;
+            uint32_t slot;
+            uint32_t offset;          /* Into the uniform data of the buffer */
+            uint32_t size;
+        } uniforms;
+        struct {
+            int base_element;
+            int num_elements;
+            int num_instances;
+        } draw;
+    } data;
+} render_command;
+
+typedef struct render_commands {
+    render_command* commands;
+    size_t num_commands;
+    size_t cap_commands;
+    gfx_bindings* bindings;
+    size_t num_bindings;
+    size_t cap_bindings;
+    uint8_t* uniforms;
+    size_t uniforms_size;
+    size_t cap_uniforms;
+} render_commands;
+
+void render_commands_init(render_commands* rc);
+void render_commands_destroy(render_commands* rc);
+void render_commands_reset(render_commands* rc);
+
+void render_commands_viewport(render_commands* rc, int x, int y, int width, int height, int origin_top_left);
+void render_commands_scissor(render_commands* rc, int x, int y, int width, int height, int origin_top_left);
+void render_commands_pipeline(render_commands* rc, gfx_pipeline pip);
+/* Fragment image slots set in input_fs_images are left to the image given at replay,
+ * for textures that only get allocated once the recorded pass executes */
+void render_commands_bindings(render_commands* rc, const gfx_bindings* binds, uint32_t input_fs_images);
+void render_commands_uniforms(render_commands* rc, gfx_shader_stage stage, int slot, const void* data, size_t size);
+void render_commands_draw(render_commands* rc, int base_element, int num_elements, int num_instances);
+
+/* Issues the recorded commands, must be called from the rendering thread */
+void render_commands_replay(const render_commands* rc, gfx_image input);
+
+#endif /* ! _RENDER_COMMANDS_H_ */
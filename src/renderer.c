@@ -1,34 +1,215 @@
 #include "renderer.h"
 #include <assert.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
+#include <float.h>
 #include "linmath.h"
 #include "gfx.h"
 #include "shaders.h"
 #include "exposure.h"
 #include "geometry.h"
+#include "culling.h"
+#include "occlusion.h"
+#include "radix_sort.h"
+#include "clustering.h"
+#include "probe_bake.h"
+#include "frame_graph.h"
+#include "gpu_timer.h"
+#include "pipeline_cache.h"
+#include "render_commands.h"
+#include "ptime.h"
 
-#define LIGHT_SHDWMAP_RESOLUTION (1024)
+#define LIGHT_SHDWMAP_RESOLUTION (1024) /* Per cascade */
+#define SHADOW_NUM_CASCADES (4)         /* Must match the shader cascade count */
+#define SHADOW_ATLAS_TILES (2)          /* Cascade tiles per atlas row */
+#define SHADOW_ATLAS_RESOLUTION (LIGHT_SHDWMAP_RESOLUTION * SHADOW_ATLAS_TILES)
+#define SHADOW_CASCADE_MARGIN (4)       /* Texels left around each tile against filter bleeding */
+#define SHADOW_SPLIT_LAMBDA (0.9f)      /* Blend of logarithmic over uniform split distances */
+#define SHADOW_MAX_DISTANCE (2000.0f)
+#define SHADOW_CASTER_EXTRUSION (500.0f) /* Distance towards the light that casters are captured from */
 #define PROBE_CUBEMAP_RESOLUTION (128)
+#define PROBE_ATLAS_TILES (8)  /* Octahedral probe tiles per atlas row */
+#define PROBE_ATLAS_CAPACITY (PROBE_ATLAS_TILES * PROBE_ATLAS_TILES)
+#define PROBE_ATLAS_RESOLUTION (PROBE_CUBEMAP_RESOLUTION * PROBE_ATLAS_TILES)
+#define PROBE_FACE_BUDGET (6)  /* Probe faces captured per frame */
+#define PROBE_BAKE_MATCH_DIST (1e-3f)  /* Max distance of a probe from its baked position */
+#define INSTANCE_BUFFER_INITIAL_CAPACITY (1024)
+#define INSTANCE_BUFFER_RING_SIZE (3)
+#define CAMERA_EV100 (14.5f)
+#define CAMERA_FOV (60.0f)
+#define CAMERA_NEAR (0.01f)
+#define CAMERA_FAR (1000.0f)
+/* Screen space error, in pixels, a level of detail may reach before a finer one is picked */
+#define LOD_ERROR_PIXELS (1.0f)
+/* Fraction of the error threshold that has to be crossed before switching levels again */
+#define LOD_HYSTERESIS (0.25f)
+#define LIGHT_CLUSTER_NEAR (0.1f)  /* Depth range sliced into clusters */
+#define LIGHT_CLUSTER_FAR (200.0f)
+#define LIGHT_INDEX_TEXTURE_WIDTH (1024)
+#define SHADER_NUM_FEATURES (4)
+#define SHADER_MAX_PERMUTATIONS (1 << SHADER_NUM_FEATURES)
+#define VIEW_COMMANDS_ARENA_SIZE (64 * 1024) /* Draw list scratch memory of each view, grows as needed */
+
+/* Features of scene shader permutations, each one enabling a define of the shader sources */
+enum shader_feature {
+    SHADER_FEATURE_VERTEX_QUANTIZED = 1 << 0,
+    SHADER_FEATURE_BCOLOR_MAP       = 1 << 1,
+    SHADER_FEATURE_NORMAL_MAP       = 1 << 2,
+    SHADER_FEATURE_MTLRGN_MAP       = 1 << 3,
+};
+
+static const char* shader_feature_defines[SHADER_NUM_FEATURES] = {
+    "VERTEX_QUANTIZED",
+    "HAS_BCOLOR_MAP",
+    "HAS_NORMAL_MAP",
+    "HAS_MTLRGN_MAP",
+};
+
+/* Shader program whose variants are compiled on first use and indexed by feature bitmask,
+ * along with a pipeline per index type. Descriptions are of the featureless variant.
+ * The index spares fetching sources and hashing descriptions on every draw list build */
+typedef struct shader_permutations {
+    const char* name;      /* Program name in pipeline manifests */
+    const char* vs_name;
+    const char* fs_name;
+    gfx_shader_desc shd_desc;
+    gfx_pipeline_desc pip_desc;
+    gfx_shader shaders[SHADER_MAX_PERMUTATIONS];
+    gfx_pipeline pipelines[SHADER_MAX_PERMUTATIONS][RENDERER_INDEX_TYPE_COUNT];
+} shader_permutations;
+
+/* A group of nodes sharing the same mesh, drawn with a single instanced call per primitive */
+typedef struct draw_batch {
+    renderer_scene* scene;
+    size_t mesh;
+    size_t lod;            /* Level of detail drawn for every primitive of the mesh */
+    size_t first_instance; /* Index into the per frame instance transform stream */
+    size_t num_instances;
+    float depth;           /* Distance of the closest instance to the view */
+} draw_batch;
+
+/* Draw sort key layout, from most to least significant bits */
+#define DRAW_KEY_PASS_SHIFT     (60) /* 4 bits  */
+#define DRAW_KEY_PIPELINE_SHIFT (52) /* 8 bits  */
+#define DRAW_KEY_MATERIAL_SHIFT (36) /* 16 bits */
+#define DRAW_KEY_BUFFER_SHIFT   (20) /* 16 bits */
+#define DRAW_KEY_DEPTH_SHIFT    (0)  /* 20 bits */
+
+enum draw_pass {
+    DRAW_PASS_MAIN = 0,
+    DRAW_PASS_SHADOW,
+};
+
+/* Single primitive draw of a batch */
+typedef struct draw_item {
+    draw_batch* batch;
+    renderer_primitive* prim;
+    gfx_pipeline pip;      /* Permutation matching the mesh and material */
+} draw_item;
+
+/* Light view fitted to a slice of the camera frustum */
+typedef struct shadow_cascade {
+    mat4 view;
+    mat4 proj;
+    mat4 sample_mat;     /* World space to tile uv and depth in [0, 1] */
+    float split_near;    /* Camera depth range covered */
+    float split_far;
+} shadow_cascade;
+
+/* Atlas tile caching the octahedral capture of a probe */
+typedef struct probe_cache_entry {
+    uint64_t id;        /* Owning probe, zero when unused */
+    uint32_t version;   /* Probe version held by the tile */
+    int valid;          /* Tile holds a complete capture */
+    uint64_t last_seen; /* Last frame the probe was part of the inputs */
+    int baked;          /* Probe is served by the baked atlas instead of its tile */
+    uint32_t baked_tile;
+} probe_cache_entry;
+
+/* Capture of a single probe face, scheduled for the current frame */
+typedef struct probe_face_job {
+    size_t slot;        /* Atlas tile of the probe */
+    int face;
+    vec3 position;
+    int completes;      /* Last face of the capture, tile is written afterwards */
+    int bake_index;     /* Bake record the tile is read back into, -1 outside of baking */
+} probe_face_job;
+
+/* Draw items of a view, along with their sorted order */
+typedef struct draw_list {
+    draw_item* items;
+    uint32_t* order;
+    size_t count;
+} draw_list;
+
+/* A point of view the scene is rendered from, along with its visible batches */
+typedef struct render_view {
+    mat4 view;
+    mat4 proj;
+    cull_volume cull;      /* Volume that nodes must intersect to be drawn in this view */
+    const occlusion_buffer* occlusion; /* Optional, nodes hidden behind its occluders are not drawn */
+    int clustered_lights;  /* Point lights were binned into clusters of this view */
+    int shadow_cascade;    /* Cascade drawn by shadow views, -1 for shaded views */
+    draw_batch* batches;
+    size_t num_batches;
+    render_commands* commands; /* Recorded draws, replayed by the pass of the view */
+} render_view;
+
+/* Command buffer of a view along with the scratch memory used to record it, owned by a single worker at a time */
+typedef struct view_commands {
+    render_commands commands;
+    struct arena mem;
+} view_commands;
+
+/* Data handed to the frame graph pass callbacks */
+typedef struct render_pass_data {
+    struct renderer* r;
+    renderer_inputs* ri;
+    render_view* views;           /* View, or views, rendered by the pass */
+    frame_graph_resource input;   /* Texture sampled by the pass */
+    float blur_dir;
+    probe_face_job* job;
+} render_pass_data;
 
 typedef struct renderer {
     renderer_params params;
+    /* Render passes and their transient targets */
+    frame_graph graph;
+    /* Timings of the last frame, GPU ones lag behind by the timer latency */
+    gpu_timer timer;
+    float prepare_msec;
+    float submit_msec;
+    /* Software depth of the occluders seen by the main view */
+    occlusion_buffer occlusion;
     /* Default pass */
-    gfx_image color_img;
-    gfx_image depth_img;
-    gfx_shader default_shd;
-    gfx_pipeline default_pip;
+    shader_permutations default_perms;
     /* Shadow pass */
-    gfx_image shadow_img;
-    gfx_image shadow_blur_img;
-    gfx_pipeline shadow_pip;
-    gfx_pass shadow_pass;
-    gfx_pass shadow_blur_pass[2];
+    gfx_image_desc shadow_img_desc;
+    shader_permutations shadow_perms;
     /* Probe pass */
-    gfx_image probe_color_img;
-    gfx_image probe_depth_img;
-    gfx_pass probe_cubemap_pass[GFX_CUBEFACE_NUM];
+    gfx_image probe_color_img; /* Outlives the frame, as captures span several frames */
+    gfx_image_desc probe_depth_desc;
     gfx_pipeline probe_trans_pip;
+    gfx_image probe_atlas_img;
+    gfx_pipeline probe_blit_pip;
+    /* Probe capture cache, faces of a single probe are captured at a time into the shared cubemap */
+    struct {
+        probe_cache_entry entries[PROBE_ATLAS_CAPACITY];
+        uint64_t frame;
+        size_t cursor;          /* Round robin position in the input probes */
+        int capturing;          /* Capture in progress */
+        size_t capture_slot;
+        uint64_t capture_id;
+        uint32_t capture_version;
+        vec3 capture_pos;
+        int capture_faces;      /* Faces captured so far */
+        probe_bake baked;       /* Loaded bake, its records match probes to baked tiles */
+        gfx_image baked_img;
+        probe_bake bake;        /* Bake being captured this frame */
+        char* bake_path;        /* Destination of a requested bake */
+    } probes;
     /* Debug resources */
     gfx_shader probe_debug_shd;
     gfx_pipeline probe_debug_pip;
@@ -39,25 +220,125 @@ typedef struct renderer {
     gfx_buffer sphere_vbuf;
     gfx_buffer sphere_ibuf;
     size_t sphere_num_elem;
+    /* Clustered point lights */
+    gfx_image light_data_img;
+    gfx_image cluster_grid_img;
+    gfx_image light_index_img;
+    /* Shadow cascades of the current frame */
+    shadow_cascade cascades[SHADOW_NUM_CASCADES];
+    /* Per object data stream, cycled through a ring of buffers to avoid stalling on in flight frames */
+    gfx_buffer instance_ring[INSTANCE_BUFFER_RING_SIZE];
+    size_t instance_ring_cap[INSTANCE_BUFFER_RING_SIZE];
+    size_t instance_ring_head;
+    gfx_buffer instance_buf; /* Ring slot of the current frame */
+    /* Per view command buffers, recorded on the workers and replayed by the passes */
+    view_commands* view_cmds;
+    size_t num_view_cmds;
 }* renderer;
 
 typedef struct {
-    mat4 modl;
     mat4 view;
     mat4 proj;
 } vs_params_t;
 
+/* Vertex uniforms of quantized meshes */
+typedef struct {
+    vec4 qpos_offset;
+    vec4 qpos_scale;
+    vec4 qtco_transform;
+} vs_dequantize_params_t;
+
+/* Fragment uniforms constant over a view */
 typedef struct {
     vec3 view_pos;
     vec3 light_pos;
     vec4 light_col;
+    mat4 cascade_mats[SHADOW_NUM_CASCADES];
+    vec4 cascade_atlas;
+    mat4 cluster_view;
+    vec4 cluster_dims;
+    vec4 cluster_scale;
+} fs_frame_params_t;
+
+/* Fragment uniforms that change along with the material */
+typedef struct {
     vec4 bcolor_val;
     vec2 mtlrgn_val;
-    float has_bcolor_map;
-    float has_normal_map;
-    float has_mtlrgn_map;
-    mat4 lightsp_mat;
-} fs_params_t;
+} fs_material_params_t;
+
+/* Rewrites the vertex attributes of permutation descriptions for the quantized vertex streams, matching attributes by name */
+static void quantize_permutation_descs(gfx_shader_desc* shd_desc, gfx_pipeline_desc* pip_desc)
+{
+    int n = 0;
+    for (int i = 0; i < GFX_MAX_VERTEX_ATTRIBUTES && shd_desc->attrs[i].name; ++i) {
+        const char* name = shd_desc->attrs[i].name;
+        gfx_vertex_attr_desc attr = pip_desc->layout.attrs[i];
+        if (strcmp(name, "atng") == 0)
+            continue; /* The tangent frame shares the normal attribute */
+        if (strcmp(name, "apos") == 0 || strcmp(name, "anrm") == 0)
+            attr.format = GFX_VERTEXFORMAT_SHORT4N;
+        else if (strcmp(name, "atco") == 0)
+            attr.format = GFX_VERTEXFORMAT_SHORT2N;
+        shd_desc->attrs[n].name = name;
+        pip_desc->layout.attrs[n] = attr;
+        ++n;
+    }
+    for (int i = n; i < GFX_MAX_VERTEX_ATTRIBUTES; ++i) {
+        shd_desc->attrs[i].name = 0;
+        pip_desc->layout.attrs[i] = (gfx_vertex_attr_desc){0};
+    }
+
+    /* Dequantization transform of the mesh being drawn */
+    shd_desc->vs.uniform_blocks[1] = (gfx_shader_uniform_block_desc){
+        .size = sizeof(vs_dequantize_params_t),
+        .uniforms = {
+            [0] = { .name = "qpos_offset",    .type = GFX_UNIFORMTYPE_FLOAT4 },
+            [1] = { .name = "qpos_scale",     .type = GFX_UNIFORMTYPE_FLOAT4 },
+            [2] = { .name = "qtco_transform", .type = GFX_UNIFORMTYPE_FLOAT4 },
+        }
+    };
+}
+
+static gfx_pipeline permutation_pipeline(shader_permutations* sp, uint32_t features, renderer_index_type index_type)
+{
+    gfx_pipeline* pip = &sp->pipelines[features][index_type];
+    if (pip->id != GFX_INVALID_ID)
+        return *pip;
+
+    gfx_shader_desc shd_desc = sp->shd_desc;
+    gfx_pipeline_desc pip_desc = sp->pip_desc;
+    if (features & SHADER_FEATURE_VERTEX_QUANTIZED)
+        quantize_permutation_descs(&shd_desc, &pip_desc);
+
+    /* Compile the variant with the defines of its features */
+    gfx_shader* shd = &sp->shaders[features];
+    if (shd->id == GFX_INVALID_ID) {
+        char defines[256] = {0};
+        for (int f = 0; f < SHADER_NUM_FEATURES; ++f) {
+            if (features & (1u << f)) {
+                strcat(defines, "#define ");
+                strcat(defines, shader_feature_defines[f]);
+                strcat(defines, "\n");
+            }
+        }
+        shader_desc vs = shader_fetch_defines(sp->vs_name, defines);
+        shader_desc fs = shader_fetch_defines(sp->fs_name, defines);
+        shd_desc.vs.source = vs->source;
+        shd_desc.fs.source = fs->source;
+        *shd = pipeline_cache_shader(&shd_desc);
+        shader_free(fs);
+        shader_free(vs);
+    }
+
+    const gfx_index_type index_types[RENDERER_INDEX_TYPE_COUNT] = {
+        [RENDERER_INDEX_TYPE_UINT32] = GFX_INDEXTYPE_UINT32,
+        [RENDERER_INDEX_TYPE_UINT16] = GFX_INDEXTYPE_UINT16,
+    };
+    pip_desc.shader = *shd;
+    pip_desc.index_type = index_types[index_type];
+    *pip = pipeline_cache_pipeline(&pip_desc);
+    return *pip;
+}
 
 renderer renderer_create(renderer_params* params)
 {
@@ -65,24 +346,13 @@ renderer renderer_create(renderer_params* params)
     const gfx_desc desc = { .context.sample_count = 4 };
     gfx_setup(&desc);
     assert(gfx_isvalid());
+    pipeline_cache_setup();
 
-    /* Create render target images */
-    gfx_image_desc img_desc = {
-        .render_target = 1,
-        .width = params->width,
-        .height = params->height,
-        .min_filter = GFX_FILTER_LINEAR,
-        .mag_filter = GFX_FILTER_LINEAR,
-    };
-    gfx_image color_img = gfx_make_image(&img_desc);
-    img_desc.pixel_format = GFX_PIXELFORMAT_DEPTH;
-    gfx_image depth_img = gfx_make_image(&img_desc);
-
-    /* Create shadowmap render target images */
+    /* Shadowmap atlas render targets, holding a tile per cascade, allocated by the frame graph */
     gfx_image_desc shadow_img_desc = (gfx_image_desc){
         .render_target = 1,
-        .width  = LIGHT_SHDWMAP_RESOLUTION,
-        .height = LIGHT_SHDWMAP_RESOLUTION,
+        .width  = SHADOW_ATLAS_RESOLUTION,
+        .height = SHADOW_ATLAS_RESOLUTION,
         .min_filter = GFX_FILTER_LINEAR,
         .mag_filter = GFX_FILTER_LINEAR,
         .wrap_u = GFX_WRAP_CLAMP_TO_BORDER,
@@ -90,62 +360,52 @@ renderer renderer_create(renderer_params* params)
         .pixel_format = GFX_PIXELFORMAT_RGBA32F,
         .sample_count = 1
     };
-    gfx_image shadow_color_img = gfx_make_image(&shadow_img_desc);
-    shadow_img_desc.pixel_format = GFX_PIXELFORMAT_DEPTH_STENCIL;
-    gfx_image shadow_depth_img = gfx_make_image(&shadow_img_desc);
-
-    /* Create shadowmap blur render target images */
-    gfx_image shadow_blur_img = gfx_make_image(&(gfx_image_desc){
-        .render_target = 1,
-        .width  = LIGHT_SHDWMAP_RESOLUTION,
-        .height = LIGHT_SHDWMAP_RESOLUTION,
-        .min_filter = GFX_FILTER_LINEAR,
-        .mag_filter = GFX_FILTER_LINEAR,
-        .wrap_u = GFX_WRAP_CLAMP_TO_BORDER,
-        .wrap_v = GFX_WRAP_CLAMP_TO_BORDER,
-        .pixel_format = GFX_PIXELFORMAT_RGBA32F,
-        .sample_count = 1
-    });
 
     /* Load shader sources */
-    shader_desc static_vs = shader_fetch("primitive.vs");
-    shader_desc direct_fs = shader_fetch("pbr_light.fs");
-    shader_desc shadow_vs = shader_fetch("shadowmap.vs");
-    shader_desc shadow_fs = shader_fetch("shadowmap.fs");
     shader_desc prbdbg_vs = shader_fetch("probe_dbg.vs");
     shader_desc prbdbg_fs = shader_fetch("probe_dbg.fs");
     shader_desc fullscreen_vs = shader_fetch("fullscreen.vs");
     shader_desc cubetoocta_fs = shader_fetch("cubetoocta.fs");
+    shader_desc texture_blit_fs = shader_fetch("texture_blit.fs");
     shader_desc texture_blur_fs = shader_fetch("texture_blur.fs");
 
-    /* Shader for the default pass */
-    gfx_shader default_shd = gfx_make_shader(&(gfx_shader_desc){
+    /* Shader for the default pass, its permutations are compiled on first use */
+    gfx_shader_desc default_shd_desc = (gfx_shader_desc){
         .attrs = {
             [0].name = "apos",
             [1].name = "anrm",
             [2].name = "atco",
             [3].name = "atng",
+            [4].name = "imdl0",
+            [5].name = "imdl1",
+            [6].name = "imdl2",
+            [7].name = "imdl3",
         },
         .vs.uniform_blocks[0] = {
             .size = sizeof(vs_params_t),
             .uniforms = {
-                [0] = { .name = "modl", .type = GFX_UNIFORMTYPE_MAT4 },
-                [1] = { .name = "view", .type = GFX_UNIFORMTYPE_MAT4 },
-                [2] = { .name = "proj", .type = GFX_UNIFORMTYPE_MAT4 }
+                [0] = { .name = "view", .type = GFX_UNIFORMTYPE_MAT4 },
+                [1] = { .name = "proj", .type = GFX_UNIFORMTYPE_MAT4 }
             }
         },
         .fs.uniform_blocks[0] = {
-            .size = sizeof(fs_params_t),
+            .size = sizeof(fs_frame_params_t),
             .uniforms = {
                 [0] = { .name = "view_pos",       .type = GFX_UNIFORMTYPE_FLOAT3 },
                 [1] = { .name = "light_pos",      .type = GFX_UNIFORMTYPE_FLOAT3 },
                 [2] = { .name = "light_col",      .type = GFX_UNIFORMTYPE_FLOAT4 },
-                [3] = { .name = "bcolor_val",     .type = GFX_UNIFORMTYPE_FLOAT4 },
-                [4] = { .name = "mtlrgn_val",     .type = GFX_UNIFORMTYPE_FLOAT2 },
-                [5] = { .name = "has_bcolor_map", .type = GFX_UNIFORMTYPE_FLOAT },
-                [6] = { .name = "has_normal_map", .type = GFX_UNIFORMTYPE_FLOAT },
-                [7] = { .name = "has_mtlrgn_map", .type = GFX_UNIFORMTYPE_FLOAT },
-                [8] = { .name = "lightsp_mat",    .type = GFX_UNIFORMTYPE_MAT4 },
+                [3] = { .name = "cascade_mats",   .type = GFX_UNIFORMTYPE_MAT4, .array_count = SHADOW_NUM_CASCADES },
+                [4] = { .name = "cascade_atlas",  .type = GFX_UNIFORMTYPE_FLOAT4 },
+                [5] = { .name = "cluster_view",   .type = GFX_UNIFORMTYPE_MAT4 },
+                [6] = { .name = "cluster_dims",   .type = GFX_UNIFORMTYPE_FLOAT4 },
+                [7] = { .name = "cluster_scale",  .type = GFX_UNIFORMTYPE_FLOAT4 },
+            }
+        },
+        .fs.uniform_blocks[1] = {
+            .size = sizeof(fs_material_params_t),
+            .uniforms = {
+                [0] = { .name = "bcolor_val",     .type = GFX_UNIFORMTYPE_FLOAT4 },
+                [1] = { .name = "mtlrgn_val",     .type = GFX_UNIFORMTYPE_FLOAT2 },
             }
         },
         .fs.images = {
@@ -153,30 +413,32 @@ renderer renderer_create(renderer_params* params)
             [1] = { .name = "normal_map", .image_type = GFX_IMAGETYPE_2D },
             [2] = { .name = "mtlrgn_map", .image_type = GFX_IMAGETYPE_2D },
             [3] = { .name = "shadow_map", .image_type = GFX_IMAGETYPE_2D },
+            [4] = { .name = "light_data",   .image_type = GFX_IMAGETYPE_2D },
+            [5] = { .name = "cluster_grid", .image_type = GFX_IMAGETYPE_2D },
+            [6] = { .name = "light_index",  .image_type = GFX_IMAGETYPE_2D },
         },
-        .vs.source = static_vs->source,
-        .fs.source = direct_fs->source,
-    });
+    };
 
     /* Shader for the shadow pass */
-    gfx_shader shadow_shd = gfx_make_shader(&(gfx_shader_desc){
+    gfx_shader_desc shadow_shd_desc = (gfx_shader_desc){
         .attrs = {
             [0].name = "apos",
+            [1].name = "imdl0",
+            [2].name = "imdl1",
+            [3].name = "imdl2",
+            [4].name = "imdl3",
         },
         .vs.uniform_blocks[0] = {
             .size = sizeof(vs_params_t),
             .uniforms = {
-                [0] = { .name = "modl", .type = GFX_UNIFORMTYPE_MAT4 },
-                [1] = { .name = "view", .type = GFX_UNIFORMTYPE_MAT4 },
-                [2] = { .name = "proj", .type = GFX_UNIFORMTYPE_MAT4 }
+                [0] = { .name = "view", .type = GFX_UNIFORMTYPE_MAT4 },
+                [1] = { .name = "proj", .type = GFX_UNIFORMTYPE_MAT4 }
             }
         },
-        .vs.source = shadow_vs->source,
-        .fs.source = shadow_fs->source,
-    });
+    };
 
     /* Shader for texture blurring */
-    gfx_shader texture_blur_shd = gfx_make_shader(&(gfx_shader_desc){
+    gfx_shader texture_blur_shd = pipeline_cache_shader(&(gfx_shader_desc){
         .fs.uniform_blocks[0] = {
             .size = sizeof(float),
             .uniforms = {
@@ -191,7 +453,7 @@ renderer renderer_create(renderer_params* params)
     });
 
     /* Shader for the probe debug view */
-    gfx_shader probe_debug_shd = gfx_make_shader(&(gfx_shader_desc){
+    gfx_shader probe_debug_shd = pipeline_cache_shader(&(gfx_shader_desc){
         .attrs = {
             [0].name = "apos",
             [1].name = "anrm",
@@ -202,15 +464,21 @@ renderer renderer_create(renderer_params* params)
                 [0] = { .name = "mvp", .type = GFX_UNIFORMTYPE_MAT4 },
             }
         },
+        .fs.uniform_blocks[0] = {
+            .size = sizeof(vec4),
+            .uniforms = {
+                [0] = { .name = "probe_rect", .type = GFX_UNIFORMTYPE_FLOAT4 },
+            }
+        },
         .fs.images = {
-            [0] = { .name = "probe", .image_type = GFX_IMAGETYPE_CUBE },
+            [0] = { .name = "probe_atlas", .image_type = GFX_IMAGETYPE_2D },
         },
         .vs.source = prbdbg_vs->source,
         .fs.source = prbdbg_fs->source,
     });
 
     /* Shader for transforming cubemap to octahedral */
-    gfx_shader probe_trans_shd = gfx_make_shader(&(gfx_shader_desc){
+    gfx_shader probe_trans_shd = pipeline_cache_shader(&(gfx_shader_desc){
         .fs.images = {
             [0] = { .name = "probe", .image_type = GFX_IMAGETYPE_CUBE },
         },
@@ -218,48 +486,68 @@ renderer renderer_create(renderer_params* params)
         .fs.source = cubetoocta_fs->source,
     });
 
+    /* Shader for showing a region of a texture */
+    gfx_shader texture_blit_shd = pipeline_cache_shader(&(gfx_shader_desc){
+        .fs.uniform_blocks[0] = {
+            .size = sizeof(vec4),
+            .uniforms = {
+                [0] = { .name = "rect", .type = GFX_UNIFORMTYPE_FLOAT4 },
+            }
+        },
+        .fs.images = {
+            [0] = { .name = "tex", .image_type = GFX_IMAGETYPE_2D },
+        },
+        .vs.source = fullscreen_vs->source,
+        .fs.source = texture_blit_fs->source,
+    });
+
     /* Free shader sources */
+    shader_free(texture_blit_fs);
     shader_free(texture_blur_fs);
     shader_free(fullscreen_vs);
     shader_free(cubetoocta_fs);
     shader_free(prbdbg_vs);
     shader_free(prbdbg_fs);
-    shader_free(shadow_vs);
-    shader_free(shadow_fs);
-    shader_free(static_vs);
-    shader_free(direct_fs);
 
     /* Pipeline object for the default pass */
-    gfx_pipeline default_pip = gfx_make_pipeline(&(gfx_pipeline_desc){
+    gfx_pipeline_desc default_pip_desc = (gfx_pipeline_desc){
         .layout = {
-            /* Don't need to provide buffer stride or attr offsets, no gaps here */
+            /* Don't need to provide buffer stride or attr offsets, no gaps here.
+             * Positions, remaining attributes and instances come from separate streams */
+            .buffers = { [2] = { .step_func = GFX_VERTEXSTEP_PER_INSTANCE } },
             .attrs = {
-                [0] = { .format = GFX_VERTEXFORMAT_FLOAT3 }, /* position */
-                [1] = { .format = GFX_VERTEXFORMAT_FLOAT3 }, /* normal   */
-                [2] = { .format = GFX_VERTEXFORMAT_FLOAT2 }, /* texcoord */
-                [3] = { .format = GFX_VERTEXFORMAT_FLOAT4 }  /* tangent  */
+                [0] = { .format = GFX_VERTEXFORMAT_FLOAT3 },                    /* position */
+                [1] = { .format = GFX_VERTEXFORMAT_FLOAT3, .buffer_index = 1 }, /* normal   */
+                [2] = { .format = GFX_VERTEXFORMAT_FLOAT2, .buffer_index = 1 }, /* texcoord */
+                [3] = { .format = GFX_VERTEXFORMAT_FLOAT4, .buffer_index = 1 }, /* tangent  */
+                [4] = { .format = GFX_VERTEXFORMAT_FLOAT4, .buffer_index = 2 }, /* model matrix columns */
+                [5] = { .format = GFX_VERTEXFORMAT_FLOAT4, .buffer_index = 2 },
+                [6] = { .format = GFX_VERTEXFORMAT_FLOAT4, .buffer_index = 2 },
+                [7] = { .format = GFX_VERTEXFORMAT_FLOAT4, .buffer_index = 2 },
             }
         },
-        .shader = default_shd,
-        .index_type = GFX_INDEXTYPE_UINT32,
         .depth = {
             .compare = GFX_COMPAREFUNC_LESS_EQUAL,
             .write_enabled = true,
         },
         .cull_mode = GFX_CULLMODE_BACK,
         .face_winding = GFX_FACEWINDING_CCW,
-    });
+    };
 
-    /* Pipeline object for the shadowmap pass */
-    gfx_pipeline shadow_pip = gfx_make_pipeline(&(gfx_pipeline_desc){
+    /* Pipeline object for the shadowmap pass, fetching the position only stream */
+    gfx_pipeline_desc shadow_pip_desc = (gfx_pipeline_desc){
         .layout = {
-            .buffers = { [0] = { .stride = (3 + 3 + 2 + 4) * sizeof(float)} },
+            .buffers = {
+                [1] = { .step_func = GFX_VERTEXSTEP_PER_INSTANCE },
+            },
             .attrs = {
-                [0] = { .format = GFX_VERTEXFORMAT_FLOAT3 }, /* position */
+                [0] = { .format = GFX_VERTEXFORMAT_FLOAT3 },                    /* position */
+                [1] = { .format = GFX_VERTEXFORMAT_FLOAT4, .buffer_index = 1 }, /* model matrix columns */
+                [2] = { .format = GFX_VERTEXFORMAT_FLOAT4, .buffer_index = 1 },
+                [3] = { .format = GFX_VERTEXFORMAT_FLOAT4, .buffer_index = 1 },
+                [4] = { .format = GFX_VERTEXFORMAT_FLOAT4, .buffer_index = 1 },
             }
         },
-        .shader = shadow_shd,
-        .index_type = GFX_INDEXTYPE_UINT32,
         .depth = {
             .compare = GFX_COMPAREFUNC_LESS_EQUAL,
             .write_enabled = true,
@@ -270,10 +558,10 @@ renderer renderer_create(renderer_params* params)
         .cull_mode = GFX_CULLMODE_FRONT,
         .face_winding = GFX_FACEWINDING_CCW,
         .sample_count = 1
-    });
+    };
 
     /* Pipeline object for texture blurring passes */
-    gfx_pipeline tex_blur_pip = gfx_make_pipeline(&(gfx_pipeline_desc){
+    gfx_pipeline tex_blur_pip = pipeline_cache_pipeline(&(gfx_pipeline_desc){
         .layout = {
             .buffers = { [0] = { .stride = (3 + 3 + 2 + 4) * sizeof(float)} },
             .attrs = {
@@ -291,32 +579,8 @@ renderer renderer_create(renderer_params* params)
         .sample_count = 1
     });
 
-    /* Shadowmap pass */
-    gfx_pass shadow_pass = gfx_make_pass(&(gfx_pass_desc){
-        .color_attachments[0] = {
-            .image = shadow_color_img,
-        },
-        .depth_stencil_attachment = {
-            .image = shadow_depth_img,
-        }
-    });
-
-    /* Shadowmap blur pass */
-    gfx_pass shadow_blur_pass[2] = {
-        [0] = gfx_make_pass(&(gfx_pass_desc){
-            .color_attachments[0] = {
-                .image = shadow_blur_img,
-            },
-        }),
-        [1] = gfx_make_pass(&(gfx_pass_desc){
-            .color_attachments[0] = {
-                .image = shadow_color_img,
-            },
-        }),
-    };
-
     /* Pipeline object for the probe debug pass */
-    gfx_pipeline probe_debug_pip = gfx_make_pipeline(&(gfx_pipeline_desc){
+    gfx_pipeline probe_debug_pip = pipeline_cache_pipeline(&(gfx_pipeline_desc){
         .layout = {
             .buffers = { [0] = { .stride = (3 + 3 + 2 + 4) * sizeof(float)} },
             .attrs = {
@@ -334,14 +598,40 @@ renderer renderer_create(renderer_params* params)
         .face_winding = GFX_FACEWINDING_CCW,
     });
 
-    /* Pipeline object for the cube to octahedral map pass */
-    gfx_pipeline probe_trans_pip = gfx_make_pipeline(&(gfx_pipeline_desc){
+    /* Pipeline object for the cube to octahedral map pass, writing into the probe atlas */
+    gfx_pipeline probe_trans_pip = pipeline_cache_pipeline(&(gfx_pipeline_desc){
         .layout = {
             .attrs = {
                 [0] = { .format = GFX_VERTEXFORMAT_FLOAT3 }, /* position */
             }
         },
         .shader = probe_trans_shd,
+        .depth.pixel_format = GFX_PIXELFORMAT_NONE,
+        .colors[0].pixel_format = GFX_PIXELFORMAT_RGBA8,
+        .sample_count = 1,
+    });
+
+    /* Pipeline object for the probe atlas debug view */
+    gfx_pipeline probe_blit_pip = pipeline_cache_pipeline(&(gfx_pipeline_desc){
+        .layout = {
+            .attrs = {
+                [0] = { .format = GFX_VERTEXFORMAT_FLOAT3 }, /* position */
+            }
+        },
+        .shader = texture_blit_shd,
+    });
+
+    /* Probe atlas, holding the octahedral capture of each cached probe */
+    gfx_image probe_atlas_img = gfx_make_image(&(gfx_image_desc){
+        .render_target = 1,
+        .width         = PROBE_ATLAS_RESOLUTION,
+        .height        = PROBE_ATLAS_RESOLUTION,
+        .pixel_format  = GFX_PIXELFORMAT_RGBA8,
+        .min_filter    = GFX_FILTER_LINEAR,
+        .mag_filter    = GFX_FILTER_LINEAR,
+        .wrap_u        = GFX_WRAP_CLAMP_TO_EDGE,
+        .wrap_v        = GFX_WRAP_CLAMP_TO_EDGE,
+        .sample_count  = 1,
     });
 
     /* Probe cubemap passes render targets */
@@ -354,27 +644,13 @@ renderer renderer_create(renderer_params* params)
         .mag_filter    = GFX_FILTER_LINEAR,
     });
 
-    gfx_image probe_depth_img = gfx_make_image(&(gfx_image_desc){
+    gfx_image_desc probe_depth_desc = (gfx_image_desc){
         .type          = GFX_IMAGETYPE_CUBE,
         .render_target = 1,
         .width         = PROBE_CUBEMAP_RESOLUTION,
         .height        = PROBE_CUBEMAP_RESOLUTION,
         .pixel_format  = GFX_PIXELFORMAT_DEPTH_STENCIL,
-    });
-
-    /* Probe cubemap passes */
-    gfx_pass probe_cubemap_pass[GFX_CUBEFACE_NUM];
-    for (int i = 0; i < GFX_CUBEFACE_NUM; ++i) {
-        probe_cubemap_pass[i] = gfx_make_pass(&(gfx_pass_desc){
-            .color_attachments[0] = {
-                .image = probe_color_img,
-                .slice = i,
-            },
-            .depth_stencil_attachment = {
-                .image = probe_depth_img,
-            }
-        });
-    }
+    };
 
     /* Fallback textures */
     gfx_image fallback_tex = gfx_make_image(&(gfx_image_desc){
@@ -418,16 +694,48 @@ renderer renderer_create(renderer_params* params)
     });
     free(sph_verts); free(sph_indcs);
 
+    /* Clustered light data, rewritten every frame */
+    gfx_image_desc cluster_img_desc = (gfx_image_desc){
+        .usage = GFX_USAGE_STREAM,
+        .min_filter = GFX_FILTER_NEAREST,
+        .mag_filter = GFX_FILTER_NEAREST,
+        .wrap_u = GFX_WRAP_CLAMP_TO_EDGE,
+        .wrap_v = GFX_WRAP_CLAMP_TO_EDGE,
+    };
+    cluster_img_desc.width = 2;
+    cluster_img_desc.height = CLUSTER_MAX_LIGHTS;
+    cluster_img_desc.pixel_format = GFX_PIXELFORMAT_RGBA32F;
+    gfx_image light_data_img = gfx_make_image(&cluster_img_desc);
+    cluster_img_desc.width = CLUSTER_GRID_X * CLUSTER_GRID_Y;
+    cluster_img_desc.height = CLUSTER_GRID_Z;
+    cluster_img_desc.pixel_format = GFX_PIXELFORMAT_RG32F;
+    gfx_image cluster_grid_img = gfx_make_image(&cluster_img_desc);
+    cluster_img_desc.width = LIGHT_INDEX_TEXTURE_WIDTH;
+    cluster_img_desc.height = CLUSTER_MAX_INDICES / LIGHT_INDEX_TEXTURE_WIDTH;
+    cluster_img_desc.pixel_format = GFX_PIXELFORMAT_R32F;
+    gfx_image light_index_img = gfx_make_image(&cluster_img_desc);
+
     renderer r = calloc(1, sizeof(*r));
     r->params          = *params;
-    r->color_img       = color_img;
-    r->depth_img       = depth_img;
-    r->default_shd     = default_shd;
-    r->default_pip     = default_pip;
-    r->shadow_img      = shadow_color_img;
-    r->shadow_blur_img = shadow_blur_img;
-    r->shadow_pip      = shadow_pip;
-    r->shadow_pass     = shadow_pass;
+    r->graph           = frame_graph_create();
+    r->timer           = gpu_timer_create();
+    frame_graph_set_timer(r->graph, r->timer);
+    occlusion_buffer_init(&r->occlusion, OCCLUSION_WIDTH, OCCLUSION_HEIGHT);
+    r->default_perms   = (shader_permutations){
+        .name     = "default",
+        .vs_name  = "primitive.vs",
+        .fs_name  = "pbr_light.fs",
+        .shd_desc = default_shd_desc,
+        .pip_desc = default_pip_desc,
+    };
+    r->shadow_perms    = (shader_permutations){
+        .name     = "shadow",
+        .vs_name  = "shadowmap.vs",
+        .fs_name  = "shadowmap.fs",
+        .shd_desc = shadow_shd_desc,
+        .pip_desc = shadow_pip_desc,
+    };
+    r->shadow_img_desc = shadow_img_desc;
     r->fallback_tex    = fallback_tex;
     r->tex_blur_pip    = tex_blur_pip;
     r->quad_vbuf       = quad_vbuf;
@@ -435,12 +743,25 @@ renderer renderer_create(renderer_params* params)
     r->sphere_ibuf     = sphere_ibuf;
     r->sphere_num_elem = sph_num_indcs;
     r->probe_color_img = probe_color_img;
-    r->probe_depth_img = probe_depth_img;
+    r->probe_depth_desc = probe_depth_desc;
     r->probe_trans_pip = probe_trans_pip;
+    r->probe_atlas_img  = probe_atlas_img;
+    r->probe_blit_pip   = probe_blit_pip;
     r->probe_debug_shd = probe_debug_shd;
     r->probe_debug_pip = probe_debug_pip;
-    memcpy(&r->shadow_blur_pass, shadow_blur_pass, sizeof(r->shadow_blur_pass));
-    memcpy(&r->probe_cubemap_pass, probe_cubemap_pass, sizeof(r->probe_cubemap_pass));
+    r->light_data_img   = light_data_img;
+    r->cluster_grid_img = cluster_grid_img;
+    r->light_index_img  = light_index_img;
+
+    /* Per object data streams, grown on demand */
+    for (size_t i = 0; i < INSTANCE_BUFFER_RING_SIZE; ++i) {
+        r->instance_ring[i] = gfx_make_buffer(&(gfx_buffer_desc){
+            .size  = INSTANCE_BUFFER_INITIAL_CAPACITY * sizeof(mat4),
+            .usage = GFX_USAGE_STREAM,
+        });
+        r->instance_ring_cap[i] = INSTANCE_BUFFER_INITIAL_CAPACITY;
+    }
+    r->instance_buf = r->instance_ring[0];
     return r;
 }
 
@@ -451,288 +772,1288 @@ static vec3 vpos_from_matrix(mat4 view)
     return view_pos;
 }
 
-static void light_space_matrices(renderer_light* l, mat4* proj, mat4* view)
+static mat4 camera_projection(renderer r, float near_dist, float far_dist)
+{
+    return mat4_perspective(radians(CAMERA_FOV), near_dist, far_dist, (float)r->params.width / (float)r->params.height);
+}
+
+/* Unit direction pointing from the scene towards the light */
+static vec3 light_direction(renderer_light* l)
+{
+    return vec3_normalize(l->position);
+}
+
+static void shadow_cascade_tile(int cascade, int* x, int* y)
+{
+    *x = (cascade % SHADOW_ATLAS_TILES) * LIGHT_SHDWMAP_RESOLUTION + SHADOW_CASCADE_MARGIN;
+    *y = (cascade / SHADOW_ATLAS_TILES) * LIGHT_SHDWMAP_RESOLUTION + SHADOW_CASCADE_MARGIN;
+}
+
+static void shadow_cascades_fit(renderer r, renderer_light* l, mat4 cam_view, shadow_cascade cascades[SHADOW_NUM_CASCADES])
+{
+    /* Camera frustum up to the shadow distance */
+    const float near_dist = CAMERA_NEAR;
+    const float far_dist  = fminf(CAMERA_FAR, SHADOW_MAX_DISTANCE);
+    frustum f = frustum_new_camera(cam_view, camera_projection(r, near_dist, far_dist));
+
+    /* Light space rotation, looking from the light towards the scene */
+    vec3 ldir = light_direction(l);
+    vec3 up = fabsf(ldir.y) > 0.99f ? vec3_new(0.0f, 0.0f, 1.0f) : vec3_up();
+    mat4 lrot = mat4_view_look_at(vec3_zero(), vec3_mul(ldir, -1.0f), up);
+
+    const float tile_res = (float)(LIGHT_SHDWMAP_RESOLUTION - 2 * SHADOW_CASCADE_MARGIN);
+    for (int c = 0; c < SHADOW_NUM_CASCADES; ++c) {
+        /* Practical split scheme, logarithmic splits blended with uniform ones */
+        float split[2];
+        for (int k = 0; k < 2; ++k) {
+            float t = (float)(c + k) / SHADOW_NUM_CASCADES;
+            float log_split = near_dist * powf(far_dist / near_dist, t);
+            float uni_split = near_dist + (far_dist - near_dist) * t;
+            split[k] = SHADOW_SPLIT_LAMBDA * log_split + (1.0f - SHADOW_SPLIT_LAMBDA) * uni_split;
+        }
+        frustum slice = frustum_slice(f,
+            (split[0] - near_dist) / (far_dist - near_dist),
+            (split[1] - near_dist) / (far_dist - near_dist));
+
+        /* Bounding sphere of the slice keeps the projection size constant as the camera rotates */
+        vec3 center = frustum_center(slice);
+        vec3 corners[8] = { slice.ntr, slice.ntl, slice.nbr, slice.nbl, slice.ftr, slice.ftl, slice.fbr, slice.fbl };
+        float radius = 0.0f;
+        for (int k = 0; k < 8; ++k)
+            radius = fmaxf(radius, vec3_dist(center, corners[k]));
+        radius = ceilf(radius * 16.0f) / 16.0f;
+
+        /* Snap the projection window to whole texels so that edges do not shimmer as the camera moves */
+        vec3 lcenter = mat4_mul_vec3(lrot, center);
+        float texel = 2.0f * radius / tile_res;
+        float x0 = floorf((lcenter.x - radius) / texel) * texel;
+        float y0 = floorf((lcenter.y - radius) / texel) * texel;
+        float dist = -lcenter.z;
+
+        shadow_cascade* sc = &cascades[c];
+        sc->view = lrot;
+        sc->proj = mat4_orthographic(
+            x0, x0 + 2.0f * radius,
+            y0, y0 + 2.0f * radius,
+            dist - radius - SHADOW_CASTER_EXTRUSION, dist + radius);
+        sc->split_near = split[0];
+        sc->split_far  = split[1];
+
+        /* Clip space to [0, 1] */
+        mat4 bias = mat4_id();
+        bias.xx = bias.yy = bias.zz = 0.5f;
+        bias.xw = bias.yw = bias.zw = 0.5f;
+        sc->sample_mat = mat4_mul_mat4(bias, mat4_mul_mat4(sc->proj, sc->view));
+    }
+}
+
+static renderer_light* pick_main_light(renderer_inputs* ri)
+{
+    /* First directional light, point lights are shaded through clusters */
+    for (size_t i = 0; i < ri->num_lights; ++i)
+        if (ri->lights[i].type == RENDERER_LIGHT_TYPE_DIRECTIONAL)
+            return &ri->lights[i];
+    /* Unlit fallback for scenes without any lights */
+    static renderer_light no_light = { .type = RENDERER_LIGHT_TYPE_DIRECTIONAL };
+    return &no_light;
+}
+
+static cluster_params light_cluster_params(render_view* rv)
+{
+    return (cluster_params){
+        .view      = rv->view,
+        .proj      = rv->proj,
+        .near_dist = LIGHT_CLUSTER_NEAR,
+        .far_dist  = LIGHT_CLUSTER_FAR,
+    };
+}
+
+static uint64_t draw_key(enum draw_pass pass, gfx_pipeline pip, draw_batch* db, renderer_primitive* rp, int with_material)
+{
+    renderer_scene* rs = db->scene;
+
+    /* Material identity folded from owning scene and material slot, only used for ordering */
+    uint32_t mtl = 0;
+    if (with_material && rp->material != RENDERER_SCENE_INVALID_INDEX) {
+        mtl = (uint32_t)((uintptr_t)rs >> 4) * 2654435761u ^ (uint32_t)(rp->material + 1) * 40503u;
+        mtl = (mtl >> 16) ^ (mtl & 0xFFFF);
+    }
+
+    /* Geometry buffers identity */
+    uint32_t buf = rs->buffers[rp->vertex_buffer].id ^ (rs->buffers[rp->index_buffer].id << 8);
+    buf = (buf >> 16) ^ (buf & 0xFFFF);
+
+    /* Positive floats keep their ordering when compared as integers, keep the top bits */
+    union { float f; uint32_t u; } depth = { .f = db->depth };
+    uint32_t dpt = (depth.u >> 11) & 0xFFFFF;
+
+    return ((uint64_t)(pass & 0xF)         << DRAW_KEY_PASS_SHIFT)
+         | ((uint64_t)(pip.id & 0xFF)      << DRAW_KEY_PIPELINE_SHIFT)
+         | ((uint64_t)(mtl & 0xFFFF)       << DRAW_KEY_MATERIAL_SHIFT)
+         | ((uint64_t)(buf & 0xFFFF)       << DRAW_KEY_BUFFER_SHIFT)
+         | ((uint64_t)dpt                  << DRAW_KEY_DEPTH_SHIFT);
+}
+
+/* Shader features a primitive draws with, material maps only matter to shaded passes */
+static uint32_t primitive_features(renderer_scene* rs, renderer_mesh* rm, renderer_primitive* rp, int with_material)
+{
+    uint32_t features = 0;
+    if (rm->vertex_format == RENDERER_VERTEX_FORMAT_QUANTIZED)
+        features |= SHADER_FEATURE_VERTEX_QUANTIZED;
+    if (with_material && rp->material != RENDERER_SCENE_INVALID_INDEX) {
+        renderer_material* mtl = &rs->materials[rp->material];
+        if (mtl->data.metallic.images.base_color != RENDERER_SCENE_INVALID_INDEX)
+            features |= SHADER_FEATURE_BCOLOR_MAP;
+        if (mtl->data.metallic.images.normal != RENDERER_SCENE_INVALID_INDEX)
+            features |= SHADER_FEATURE_NORMAL_MAP;
+        if (mtl->data.metallic.images.metallic_roughness != RENDERER_SCENE_INVALID_INDEX)
+            features |= SHADER_FEATURE_MTLRGN_MAP;
+    }
+    return features;
+}
+
+static void build_draw_list(draw_list* dl, struct arena* mem, render_view* rv, enum draw_pass pass, shader_permutations* perms, int with_material)
+{
+    /* Count primitive draws */
+    size_t count = 0;
+    for (size_t k = 0; k < rv->num_batches; ++k)
+        count += rv->batches[k].scene->meshes[rv->batches[k].mesh].num_primitives;
+
+    dl->items = arena_alloc(mem, count * sizeof(*dl->items));
+    dl->order = arena_alloc(mem, count * sizeof(*dl->order));
+    dl->count = count;
+    uint64_t* keys = arena_alloc(mem, count * sizeof(*keys));
+
+    /* Emit items and their keys, picking the permutation of each */
+    size_t n = 0;
+    for (size_t k = 0; k < rv->num_batches; ++k) {
+        draw_batch* db = &rv->batches[k];
+        renderer_scene* rs = db->scene;
+        renderer_mesh* rm = &rs->meshes[db->mesh];
+        for (size_t j = 0; j < rm->num_primitives; ++j) {
+            renderer_primitive* rp = &rs->primitives[rm->first_primitive + j];
+            uint32_t features = primitive_features(rs, rm, rp, with_material);
+            gfx_pipeline pip = perms->pipelines[features][rm->index_type]; /* Compiled by prepare_view_pipelines */
+            dl->items[n] = (draw_item){ .batch = db, .prim = rp, .pip = pip };
+            dl->order[n] = n;
+            keys[n] = draw_key(pass, pip, db, rp, with_material);
+            ++n;
+        }
+    }
+
+    /* Sort */
+    uint64_t* tmp_keys = arena_alloc(mem, count * sizeof(*tmp_keys));
+    uint32_t* tmp_order = arena_alloc(mem, count * sizeof(*tmp_order));
+    radix_sort64(keys, dl->order, tmp_keys, tmp_order, count);
+}
+
+/* Records the dequantization transform of quantized meshes, the current pipeline must be a quantized variant */
+static void record_dequantize_uniforms(render_commands* rc, const renderer_mesh* rm)
 {
-    vec3 ldir = vec3_normalize(l->position);
-    *proj = mat4_orthographic(-20.0f, 20.0f, -20.0f, 20.0f, 100.0f, -10.0f);
-    *view = mat4_view_look_at(vec3_mul(ldir, -1.0f), vec3_zero(), vec3_up());
+    const renderer_dequantize* dq = &rm->dequantize;
+    vs_dequantize_params_t params = {
+        .qpos_offset    = vec4_new(dq->position_offset.x, dq->position_offset.y, dq->position_offset.z, 0.0f),
+        .qpos_scale     = vec4_new(dq->position_scale.x, dq->position_scale.y, dq->position_scale.z, 0.0f),
+        .qtco_transform = vec4_new(dq->texcoord_offset.x, dq->texcoord_offset.y, dq->texcoord_scale.x, dq->texcoord_scale.y),
+    };
+    render_commands_uniforms(rc, GFX_SHADERSTAGE_VS, 1, &params, sizeof(params));
 }
 
-static void render_scene(renderer r, renderer_scene* rs, mat4 view, mat4 proj)
+/* Records the shaded draws of a view, the shadow map is bound at replay as the pass input */
+static void record_scene(renderer r, renderer_inputs* ri, render_view* rv, render_commands* rc, struct arena* mem)
 {
+    mat4 view = rv->view, proj = rv->proj;
+
     /* Camera params */
-    const float ev100 = 14.5;
     vec3 vpos = vpos_from_matrix(view);
-    float exposure = exposure_from_ev100(ev100);
+    float exposure = exposure_from_ev100(CAMERA_EV100);
 
     /* Light params */
-    renderer_light* rl = &rs->lights[0];  /* TODO: Support multiple lights */
+    renderer_light* rl = pick_main_light(ri); /* Drives the sun and shadow path, point lights shade through the clusters */
     float pei = rl->intensity * exposure; /* Pre-exposed intensity */
     vec3 lpos = rl->position;
     vec4 lcol = (vec4){{rl->color.r, rl->color.g, rl->color.b, pei}};
 
-    /* Shadow params */
-    mat4 lproj, lview;
-    light_space_matrices(rl, &lproj, &lview);
-    gfx_image shadow_map_img = r->shadow_img;
-    mat4 lightsp_mat = mat4_mul_mat4(lproj, lview);
-
-    /* Render all primitives for all nodes in the scene */
-    gfx_apply_pipeline(r->default_pip);
-    for (size_t i = 0; i < rs->num_nodes; ++i) {
-        renderer_node* rn = &rs->nodes[i];
-        renderer_mesh* rm = &rs->meshes[rn->mesh];
-        for (size_t j = 0; j < rm->num_primitives; ++j) {
-            /* Fetch geometry bindings */
-            renderer_primitive* rp = &rs->primitives[rm->first_primitive + j];
-            gfx_buffer vbuf = rs->buffers[rp->vertex_buffer];
-            gfx_buffer ibuf = rs->buffers[rp->index_buffer];
-            /* Default values */
-            vec4 bcolor_val = vec4_one();
-            vec2 mtlrgn_val = vec2_zero();
-            gfx_image bcolor_map_img = r->fallback_tex;
-            gfx_image normal_map_img = r->fallback_tex;
-            gfx_image mtlrgn_map_img = r->fallback_tex;
-            int has_bcolor_map = 0, has_normal_map = 0, has_mtlrgn_map = 0;
-            /* Fetch material bindings */
-            if (rp->material != RENDERER_SCENE_INVALID_INDEX) {
-                renderer_material* rm = &rs->materials[rp->material];
-                bcolor_val = rm->data.metallic.params.base_color_factor;
-                mtlrgn_val.x = rm->data.metallic.params.metallic_factor;
-                mtlrgn_val.y = rm->data.metallic.params.roughness_factor;
-                size_t color_tex_idx = rm->data.metallic.images.base_color;
-                if (color_tex_idx != RENDERER_SCENE_INVALID_INDEX) {
-                    bcolor_map_img = rs->images[color_tex_idx];
-                    has_bcolor_map = 1;
-                }
-                size_t normal_tex_idx = rm->data.metallic.images.normal;
-                if (normal_tex_idx != RENDERER_SCENE_INVALID_INDEX) {
-                    normal_map_img = rs->images[normal_tex_idx];
-                    has_normal_map = 1;
-                }
-                size_t metal_roughness_tex_idx = rm->data.metallic.images.metallic_roughness;
-                if (metal_roughness_tex_idx != RENDERER_SCENE_INVALID_INDEX) {
-                    mtlrgn_map_img = rs->images[metal_roughness_tex_idx];
-                    has_mtlrgn_map = 1;
-                }
-            }
-            /* Apply the fetched bindings */
-            gfx_apply_bindings(&(gfx_bindings){
-                .vertex_buffers[0] = vbuf,
-                .index_buffer      = ibuf,
-                .fs_images = {
-                    [0] = bcolor_map_img,
-                    [1] = normal_map_img,
-                    [2] = mtlrgn_map_img,
-                    [3] = shadow_map_img,
-                }
-            });
-            /* Apply vertex and fragment shader uniforms */
-            vs_params_t vs_params = {
-                .modl = rn->transform,
-                .view = view,
-                .proj = proj,
-            };
-            fs_params_t fs_params = {
-                .view_pos       = vpos,
-                .light_pos      = lpos,
-                .light_col      = lcol,
-                .bcolor_val     = bcolor_val,
-                .mtlrgn_val     = mtlrgn_val,
-                .has_bcolor_map = has_bcolor_map,
-                .has_normal_map = has_normal_map,
-                .has_mtlrgn_map = has_mtlrgn_map,
-                .lightsp_mat    = lightsp_mat,
+    /* Build sorted draw list */
+    draw_list dl;
+    build_draw_list(&dl, mem, rv, DRAW_PASS_MAIN, &r->default_perms, 1);
+
+    /* View constant uniforms, applied along with each pipeline */
+    vs_params_t vs_params = {
+        .view = view,
+        .proj = proj,
+    };
+    /* Cluster lookup params */
+    cluster_params cp = light_cluster_params(rv);
+    float depth_scale, depth_bias;
+    cluster_depth_scale_bias(&cp, &depth_scale, &depth_bias);
+
+    fs_frame_params_t fs_frame_params = {
+        .view_pos      = vpos,
+        .light_pos     = lpos,
+        .light_col     = lcol,
+        .cascade_atlas = vec4_new(
+            LIGHT_SHDWMAP_RESOLUTION, SHADOW_CASCADE_MARGIN,
+            SHADOW_ATLAS_RESOLUTION, SHADOW_ATLAS_TILES),
+        .cluster_view  = view,
+        .cluster_dims  = vec4_new(CLUSTER_GRID_X, CLUSTER_GRID_Y, CLUSTER_GRID_Z, rv->clustered_lights),
+        .cluster_scale = vec4_new(
+            (float)r->params.width / CLUSTER_GRID_X,
+            (float)r->params.height / CLUSTER_GRID_Y,
+            depth_scale, depth_bias),
+    };
+    for (int c = 0; c < SHADOW_NUM_CASCADES; ++c)
+        fs_frame_params.cascade_mats[c] = r->cascades[c].sample_mat;
+
+    /* Record all primitives of every batch, instanced over the batch nodes, skipping redundant state changes.
+     * Per object data is fetched from the instance stream, so only material uniforms are applied per draw */
+    gfx_bindings last_binds;
+    memset(&last_binds, 0, sizeof(last_binds));
+    renderer_scene* last_scene = 0;
+    size_t last_material = RENDERER_SCENE_INVALID_INDEX;
+    gfx_pipeline last_pip = {0};
+    renderer_mesh* last_mesh = 0;
+    for (size_t k = 0; k < dl.count; ++k) {
+        draw_item* di = &dl.items[dl.order[k]];
+        draw_batch* db = di->batch;
+        renderer_scene* rs = db->scene;
+        renderer_primitive* rp = di->prim;
+        renderer_mesh* rm = &rs->meshes[db->mesh];
+        /* Draws are grouped by permutation pipeline. Uniforms and bindings do not carry over a switch */
+        gfx_pipeline pip = di->pip;
+        int pip_changed = pip.id != last_pip.id;
+        if (pip_changed) {
+            render_commands_pipeline(rc, pip);
+            render_commands_uniforms(rc, GFX_SHADERSTAGE_VS, 0, &vs_params, sizeof(vs_params));
+            render_commands_uniforms(rc, GFX_SHADERSTAGE_FS, 0, &fs_frame_params, sizeof(fs_frame_params));
+            last_pip = pip;
+            last_mesh = 0;
+        }
+        if (rm->vertex_format == RENDERER_VERTEX_FORMAT_QUANTIZED && rm != last_mesh)
+            record_dequantize_uniforms(rc, rm);
+        last_mesh = rm;
+        /* Fetch geometry bindings */
+        gfx_buffer pbuf = rs->buffers[rp->position_buffer];
+        gfx_buffer vbuf = rs->buffers[rp->vertex_buffer];
+        gfx_buffer ibuf = rs->buffers[rp->index_buffer];
+        /* Default values, maps missing from the material are not sampled by its permutation */
+        vec4 bcolor_val = vec4_one();
+        vec2 mtlrgn_val = vec2_zero();
+        gfx_image bcolor_map_img = r->fallback_tex;
+        gfx_image normal_map_img = r->fallback_tex;
+        gfx_image mtlrgn_map_img = r->fallback_tex;
+        /* Fetch material bindings */
+        if (rp->material != RENDERER_SCENE_INVALID_INDEX) {
+            renderer_material* rm = &rs->materials[rp->material];
+            bcolor_val = rm->data.metallic.params.base_color_factor;
+            mtlrgn_val.x = rm->data.metallic.params.metallic_factor;
+            mtlrgn_val.y = rm->data.metallic.params.roughness_factor;
+            size_t color_tex_idx = rm->data.metallic.images.base_color;
+            if (color_tex_idx != RENDERER_SCENE_INVALID_INDEX)
+                bcolor_map_img = rs->images[color_tex_idx];
+            size_t normal_tex_idx = rm->data.metallic.images.normal;
+            if (normal_tex_idx != RENDERER_SCENE_INVALID_INDEX)
+                normal_map_img = rs->images[normal_tex_idx];
+            size_t metal_roughness_tex_idx = rm->data.metallic.images.metallic_roughness;
+            if (metal_roughness_tex_idx != RENDERER_SCENE_INVALID_INDEX)
+                mtlrgn_map_img = rs->images[metal_roughness_tex_idx];
+        }
+        /* Record the fetched bindings if changed, the shadow map slot is left to the replay input */
+        gfx_bindings binds;
+        memset(&binds, 0, sizeof(binds));
+        binds.vertex_buffers[0] = pbuf;
+        binds.vertex_buffers[1] = vbuf;
+        binds.vertex_buffers[2] = r->instance_buf;
+        binds.vertex_buffer_offsets[2] = db->first_instance * sizeof(mat4);
+        binds.index_buffer = ibuf;
+        binds.fs_images[0] = bcolor_map_img;
+        binds.fs_images[1] = normal_map_img;
+        binds.fs_images[2] = mtlrgn_map_img;
+        binds.fs_images[4] = r->light_data_img;
+        binds.fs_images[5] = r->cluster_grid_img;
+        binds.fs_images[6] = r->light_index_img;
+        if (pip_changed || memcmp(&binds, &last_binds, sizeof(binds)) != 0) {
+            render_commands_bindings(rc, &binds, 1u << 3);
+            last_binds = binds;
+        }
+        /* Record material uniforms on material change */
+        if (pip_changed || rs != last_scene || rp->material != last_material) {
+            fs_material_params_t fs_material_params = {
+                .bcolor_val = bcolor_val,
+                .mtlrgn_val = mtlrgn_val,
             };
-            gfx_apply_uniforms(GFX_SHADERSTAGE_VS, 0, &(gfx_range){&vs_params, sizeof(vs_params)});
-            gfx_apply_uniforms(GFX_SHADERSTAGE_FS, 0, &(gfx_range){&fs_params, sizeof(fs_params)});
-            /* Perform the draw call */
-            gfx_draw(rp->base_element, rp->num_elements, 1);
+            render_commands_uniforms(rc, GFX_SHADERSTAGE_FS, 1, &fs_material_params, sizeof(fs_material_params));
+            last_scene = rs;
+            last_material = rp->material;
         }
+        /* Record the instanced draw call */
+        render_commands_draw(rc, rp->lods[db->lod].base_element, rp->lods[db->lod].num_elements, db->num_instances);
     }
 }
 
-static void render_shadow_map(renderer r, renderer_scene* rs)
+/* Records the depth only draws of a cascade into its own atlas tile */
+static void record_shadow_cascade(renderer r, render_view* rv, render_commands* rc, struct arena* mem)
 {
-    /* Pick directional light */
-    renderer_light* rl = &rs->lights[0]; /* TODO */
+    const int tile_res = LIGHT_SHDWMAP_RESOLUTION - 2 * SHADOW_CASCADE_MARGIN;
+    int x, y;
+    shadow_cascade_tile(rv->shadow_cascade, &x, &y);
+    render_commands_viewport(rc, x, y, tile_res, tile_res, 0);
+    render_commands_scissor(rc, x, y, tile_res, tile_res, 0);
+    vs_params_t vs_params = {
+        .view = rv->view,
+        .proj = rv->proj,
+    };
 
-    /* Construct light view and projection matrices */
-    mat4 proj, view;
-    light_space_matrices(rl, &proj, &view);
+    /* Depth only, so draws are ordered by pipeline and geometry alone */
+    draw_list dl;
+    build_draw_list(&dl, mem, rv, DRAW_PASS_SHADOW, &r->shadow_perms, 0);
+    gfx_bindings last_binds;
+    memset(&last_binds, 0, sizeof(last_binds));
+    gfx_pipeline last_pip = {0};
+    renderer_mesh* last_mesh = 0;
+    for (size_t k = 0; k < dl.count; ++k) {
+        draw_item* di = &dl.items[dl.order[k]];
+        draw_batch* db = di->batch;
+        renderer_scene* rs = db->scene;
+        renderer_primitive* rp = di->prim;
+        renderer_mesh* rm = &rs->meshes[db->mesh];
+        /* Switch pipeline along with the vertex format and index type */
+        gfx_pipeline pip = di->pip;
+        int pip_changed = pip.id != last_pip.id;
+        if (pip_changed) {
+            render_commands_pipeline(rc, pip);
+            render_commands_uniforms(rc, GFX_SHADERSTAGE_VS, 0, &vs_params, sizeof(vs_params));
+            last_pip = pip;
+            last_mesh = 0;
+        }
+        if (rm->vertex_format == RENDERER_VERTEX_FORMAT_QUANTIZED && rm != last_mesh)
+            record_dequantize_uniforms(rc, rm);
+        last_mesh = rm;
+        /* Record geometry bindings if changed */
+        gfx_bindings binds;
+        memset(&binds, 0, sizeof(binds));
+        binds.vertex_buffers[0] = rs->buffers[rp->position_buffer];
+        binds.vertex_buffers[1] = r->instance_buf;
+        binds.vertex_buffer_offsets[1] = db->first_instance * sizeof(mat4);
+        binds.index_buffer = rs->buffers[rp->index_buffer];
+        if (pip_changed || memcmp(&binds, &last_binds, sizeof(binds)) != 0) {
+            render_commands_bindings(rc, &binds, 0);
+            last_binds = binds;
+        }
+        /* Record the instanced draw call */
+        render_commands_draw(rc, rp->lods[db->lod].base_element, rp->lods[db->lod].num_elements, db->num_instances);
+    }
+}
 
-    /* Render all primitives for all nodes in the scene */
-    gfx_begin_pass(r->shadow_pass, &(gfx_pass_action){
-        .colors[0] = {
-            .action = GFX_ACTION_CLEAR,
-            .value = { 0.0f, 0.0f, 0.0f, 1.0f }
+/* Data shared by the recording workers */
+typedef struct record_job {
+    renderer r;
+    renderer_inputs* ri;
+    render_view* views;
+} record_job;
+
+static void record_views(void* arg, size_t first, size_t last)
+{
+    record_job* job = arg;
+    for (size_t v = first; v < last; ++v) {
+        render_view* rv = &job->views[v];
+        view_commands* vc = &job->r->view_cmds[v];
+        render_commands_reset(&vc->commands);
+        arena_reset(&vc->mem);
+        if (rv->shadow_cascade >= 0)
+            record_shadow_cascade(job->r, rv, &vc->commands, &vc->mem);
+        else
+            record_scene(job->r, job->ri, rv, &vc->commands, &vc->mem);
+        rv->commands = &vc->commands;
+    }
+}
+
+/* Compiles the permutations drawn by every view, so that recording on the workers makes no gfx calls */
+static void prepare_view_pipelines(renderer r, render_view* views, size_t num_views)
+{
+    for (size_t v = 0; v < num_views; ++v) {
+        render_view* rv = &views[v];
+        int with_material = rv->shadow_cascade < 0;
+        shader_permutations* perms = with_material ? &r->default_perms : &r->shadow_perms;
+        for (size_t k = 0; k < rv->num_batches; ++k) {
+            draw_batch* db = &rv->batches[k];
+            renderer_scene* rs = db->scene;
+            renderer_mesh* rm = &rs->meshes[db->mesh];
+            for (size_t j = 0; j < rm->num_primitives; ++j) {
+                renderer_primitive* rp = &rs->primitives[rm->first_primitive + j];
+                permutation_pipeline(perms, primitive_features(rs, rm, rp, with_material), rm->index_type);
+            }
+        }
+    }
+}
+
+/* Records the commands of every view, one buffer per view filled in parallel on the workers */
+static void record_view_commands(renderer r, renderer_inputs* ri, render_view* views, size_t num_views)
+{
+    prepare_view_pipelines(r, views, num_views);
+
+    /* Buffers are kept across frames, only added when more views than ever are rendered */
+    if (num_views > r->num_view_cmds) {
+        r->view_cmds = realloc(r->view_cmds, num_views * sizeof(*r->view_cmds));
+        for (size_t v = r->num_view_cmds; v < num_views; ++v) {
+            render_commands_init(&r->view_cmds[v].commands);
+            arena_init(&r->view_cmds[v].mem, VIEW_COMMANDS_ARENA_SIZE);
         }
+        r->num_view_cmds = num_views;
+    }
+
+    record_job job = { .r = r, .ri = ri, .views = views };
+    threadpool_parallel_for(r->params.workers, num_views, 1, record_views, &job);
+}
+
+static void render_scene_pass(void* data)
+{
+    render_pass_data* d = data;
+    render_commands_replay(d->views->commands, frame_graph_image(d->r->graph, d->input));
+}
+
+static void render_shadow_casters_pass(void* data)
+{
+    render_pass_data* d = data;
+    for (int c = 0; c < SHADOW_NUM_CASCADES; ++c)
+        render_commands_replay(d->views[c].commands, (gfx_image){0});
+}
+
+static void render_shadow_blur_pass(void* data)
+{
+    /* One direction of the shadowmap prefilter */
+    render_pass_data* d = data;
+    renderer r = d->r;
+    const float dir = d->blur_dir;
+    gfx_apply_pipeline(r->tex_blur_pip);
+    gfx_apply_uniforms(GFX_SHADERSTAGE_FS, 0, &(gfx_range){&dir, sizeof(dir)});
+    gfx_apply_bindings(&(gfx_bindings){
+        .vertex_buffers[0] = r->quad_vbuf,
+        .fs_images = { [0] = frame_graph_image(r->graph, d->input) }
     });
-    gfx_apply_pipeline(r->shadow_pip);
-    for (size_t i = 0; i < rs->num_nodes; ++i) {
-        renderer_node* rn = &rs->nodes[i];
-        renderer_mesh* rm = &rs->meshes[rn->mesh];
-        for (size_t j = 0; j < rm->num_primitives; ++j) {
-            /* Fetch geometry bindings */
-            renderer_primitive* rp = &rs->primitives[rm->first_primitive + j];
-            gfx_buffer vbuf = rs->buffers[rp->vertex_buffer];
-            gfx_buffer ibuf = rs->buffers[rp->index_buffer];
-            /* Apply the fetched bindings */
-            gfx_apply_bindings(&(gfx_bindings){
-                .vertex_buffers[0] = vbuf,
-                .index_buffer      = ibuf,
-            });
-            /* Apply vertex and fragment shader uniforms */
-            vs_params_t vs_params = {
-                .modl = rn->transform,
-                .view = view,
-                .proj = proj,
+    gfx_draw(0, 3, 1);
+}
+
+static void probe_face_matrices(vec3 probe_pos, int face, mat4* view, mat4* proj)
+{
+    vec3 center_and_up[GFX_CUBEFACE_NUM][2] = {
+        /*        Center         -          Up         */
+        {{{+1.0f,  0.0f,  0.0f}}, {{0.0f, -1.0f,  0.0f}}}, /* +X */
+        {{{-1.0f,  0.0f,  0.0f}}, {{0.0f, -1.0f,  0.0f}}}, /* -X */
+        {{{ 0.0f, +1.0f,  0.0f}}, {{0.0f,  0.0f, +1.0f}}}, /* +Y */
+        {{{ 0.0f, -1.0f,  0.0f}}, {{0.0f,  0.0f, -1.0f}}}, /* -Y */
+        {{{ 0.0f,  0.0f, +1.0f}}, {{0.0f, -1.0f,  0.0f}}}, /* +Z */
+        {{{ 0.0f,  0.0f, -1.0f}}, {{0.0f, -1.0f,  0.0f}}}, /* -Z */
+    };
+    vec3 probe_tgt = vec3_add(probe_pos, center_and_up[face][0]);
+    *view = mat4_view_look_at(probe_pos, probe_tgt, center_and_up[face][1]);
+    *proj = mat4_perspective(radians(90.0f), 0.01f, 1000.0f, 1.0f);
+}
+
+static void probe_tile_rect(size_t slot, int* x, int* y)
+{
+    *x = (int)(slot % PROBE_ATLAS_TILES) * PROBE_CUBEMAP_RESOLUTION;
+    *y = (int)(slot / PROBE_ATLAS_TILES) * PROBE_CUBEMAP_RESOLUTION;
+}
+
+static vec4 probe_tile_uv_rect(size_t slot)
+{
+    int x, y;
+    probe_tile_rect(slot, &x, &y);
+    const float inv = 1.0f / PROBE_ATLAS_RESOLUTION;
+    return vec4_new(x * inv, y * inv, PROBE_CUBEMAP_RESOLUTION * inv, PROBE_CUBEMAP_RESOLUTION * inv);
+}
+
+static probe_cache_entry* probe_cache_lookup(renderer r, uint64_t id, size_t* slot)
+{
+    for (size_t i = 0; i < PROBE_ATLAS_CAPACITY; ++i) {
+        if (r->probes.entries[i].id == id) {
+            *slot = i;
+            return &r->probes.entries[i];
+        }
+    }
+    return 0;
+}
+
+static probe_cache_entry* probe_cache_acquire(renderer r, uint64_t id, size_t* slot)
+{
+    /* Existing tile */
+    probe_cache_entry* pce = probe_cache_lookup(r, id, slot);
+    if (pce)
+        return pce;
+
+    /* Free tile, or the one of the probe missing from the inputs for the longest time */
+    probe_cache_entry* victim = 0;
+    for (size_t i = 0; i < PROBE_ATLAS_CAPACITY; ++i) {
+        probe_cache_entry* e = &r->probes.entries[i];
+        if (e->last_seen == r->probes.frame)
+            continue;
+        if (!victim || e->id == 0 || (victim->id != 0 && e->last_seen < victim->last_seen)) {
+            victim = e;
+            *slot = i;
+            if (e->id == 0)
+                break;
+        }
+    }
+    if (victim) {
+        if (r->probes.capturing && r->probes.capture_slot == *slot)
+            r->probes.capturing = 0;
+        *victim = (probe_cache_entry){ .id = id };
+    }
+    return victim;
+}
+
+static int probe_baked_tile(renderer r, renderer_probe* rp)
+{
+    probe_bake* pb = &r->probes.baked;
+    for (uint32_t i = 0; i < pb->num_probes; ++i) {
+        vec3 d = vec3_sub(pb->probes[i].position, rp->position);
+        if (vec3_dot(d, d) <= PROBE_BAKE_MATCH_DIST * PROBE_BAKE_MATCH_DIST)
+            return (int)i;
+    }
+    return -1;
+}
+
+static int probe_is_stale(renderer r, renderer_probe* rp)
+{
+    size_t slot;
+    probe_cache_entry* pce = probe_cache_lookup(r, rp->id, &slot);
+    return pce && (!pce->valid || pce->version != rp->version);
+}
+
+static size_t probe_schedule_faces(renderer r, renderer_inputs* ri, probe_face_job* jobs)
+{
+    /* Assign atlas tiles to the current probes */
+    ++r->probes.frame;
+    for (size_t i = 0; i < ri->num_probes; ++i) {
+        size_t slot;
+        renderer_probe* rp = &ri->probes[i];
+        probe_cache_entry* pce = probe_cache_acquire(r, rp->id, &slot);
+        if (!pce)
+            continue;
+        pce->last_seen = r->probes.frame;
+        /* Probes still at their baked position never need a capture, scene changes are ignored for them */
+        int bt = probe_baked_tile(r, rp);
+        if (bt >= 0) {
+            *pce = (probe_cache_entry){
+                .id = rp->id, .version = rp->version, .valid = 1, .last_seen = r->probes.frame,
+                .baked = 1, .baked_tile = (uint32_t)bt
             };
-            gfx_apply_uniforms(GFX_SHADERSTAGE_VS, 0, &(gfx_range){&vs_params, sizeof(vs_params)});
-            /* Perform the draw call */
-            gfx_draw(rp->base_element, rp->num_elements, 1);
+            if (r->probes.capturing && r->probes.capture_slot == slot)
+                r->probes.capturing = 0;
+        } else if (pce->baked) {
+            pce->baked = 0;
+            pce->valid = 0;
         }
     }
-    gfx_end_pass();
 
-    /* Prefilter shadowmap */
-    gfx_image blur_inputs[] = {r->shadow_img, r->shadow_blur_img};
-    for (size_t i = 0; i < 2; ++i) {
-        const float dir = i;
-        gfx_image input = blur_inputs[i];
-        gfx_pass pass = r->shadow_blur_pass[i];
-        gfx_begin_pass(pass, &(gfx_pass_action){
-            .colors[0] = {
-                .action = GFX_ACTION_CLEAR,
-                .value = { 0.0f, 0.0f, 0.0f, 0.0f }
+    size_t num_jobs = 0;
+    while (num_jobs < PROBE_FACE_BUDGET) {
+        /* Keep capturing the current probe, restarting it if it changed meanwhile */
+        if (r->probes.capturing) {
+            renderer_probe* rp = 0;
+            for (size_t i = 0; i < ri->num_probes && !rp; ++i)
+                if (ri->probes[i].id == r->probes.capture_id)
+                    rp = &ri->probes[i];
+            if (!rp) {
+                r->probes.capturing = 0;
+                continue;
             }
-        });
-        gfx_apply_pipeline(r->tex_blur_pip);
-        gfx_apply_uniforms(GFX_SHADERSTAGE_FS, 0, &(gfx_range){&dir, sizeof(dir)});
-        gfx_apply_bindings(&(gfx_bindings){
-            .vertex_buffers[0] = r->quad_vbuf,
-            .fs_images = { [0] = input }
-        });
-        gfx_draw(0, 3, 1);
-        gfx_end_pass();
+            if (rp->version != r->probes.capture_version) {
+                r->probes.capture_version = rp->version;
+                r->probes.capture_pos     = rp->position;
+                r->probes.capture_faces   = 0;
+            }
+        } else {
+            /* Pick the next stale probe in round robin order */
+            renderer_probe* next = 0;
+            for (size_t k = 0; k < ri->num_probes && !next; ++k) {
+                renderer_probe* rp = &ri->probes[(r->probes.cursor + k) % ri->num_probes];
+                if (probe_is_stale(r, rp)) {
+                    next = rp;
+                    r->probes.cursor = (r->probes.cursor + k + 1) % ri->num_probes;
+                }
+            }
+            if (!next)
+                break;
+            probe_cache_lookup(r, next->id, &r->probes.capture_slot);
+            r->probes.capturing       = 1;
+            r->probes.capture_id      = next->id;
+            r->probes.capture_version = next->version;
+            r->probes.capture_pos     = next->position;
+            r->probes.capture_faces   = 0;
+        }
+
+        /* Schedule the next face, the tile is refreshed once all faces are in */
+        int face = r->probes.capture_faces++;
+        int completes = r->probes.capture_faces == GFX_CUBEFACE_NUM;
+        jobs[num_jobs++] = (probe_face_job){
+            .slot       = r->probes.capture_slot,
+            .face       = face,
+            .position   = r->probes.capture_pos,
+            .completes  = completes,
+            .bake_index = -1,
+        };
+        if (completes) {
+            probe_cache_entry* pce = &r->probes.entries[r->probes.capture_slot];
+            pce->version = r->probes.capture_version;
+            pce->valid = 1;
+            r->probes.capturing = 0;
+        }
     }
+    return num_jobs;
 }
 
-static void render_probe_cubemap(renderer r, renderer_scene* rs, vec3 probe_pos)
+static size_t probe_schedule_bake(renderer r, renderer_inputs* ri, probe_face_job* jobs)
 {
-    /* Render probe to temporary cubemap target */
-    for (int face = 0; face < GFX_CUBEFACE_NUM; ++face) {
-        gfx_begin_pass(r->probe_cubemap_pass[face], &(gfx_pass_action){
-            .colors[0] = {
-                .action = GFX_ACTION_CLEAR,
-                .value = { 0.0f, 0.0f, 0.0f, 1.0f }
-            },
-        });
-        vec3 center_and_up[GFX_CUBEFACE_NUM][2] = {
-            /*        Center         -          Up         */
-            {{{+1.0f,  0.0f,  0.0f}}, {{0.0f, -1.0f,  0.0f}}}, /* +X */
-            {{{-1.0f,  0.0f,  0.0f}}, {{0.0f, -1.0f,  0.0f}}}, /* -X */
-            {{{ 0.0f, +1.0f,  0.0f}}, {{0.0f,  0.0f, +1.0f}}}, /* +Y */
-            {{{ 0.0f, -1.0f,  0.0f}}, {{0.0f,  0.0f, -1.0f}}}, /* -Y */
-            {{{ 0.0f,  0.0f, +1.0f}}, {{0.0f, -1.0f,  0.0f}}}, /* +Z */
-            {{{ 0.0f,  0.0f, -1.0f}}, {{0.0f, -1.0f,  0.0f}}}, /* -Z */
+    /* Capture every probe in full, tiles are read back right after being written so any slot will do */
+    probe_bake_init(&r->probes.bake, ri->num_probes, PROBE_CUBEMAP_RESOLUTION);
+    size_t num_jobs = 0;
+    for (size_t i = 0; i < ri->num_probes; ++i) {
+        r->probes.bake.probes[i] = (probe_bake_record){
+            .position = ri->probes[i].position,
+            .radius   = ri->probes[i].radius,
         };
-        vec3 probe_tgt  = vec3_add(probe_pos, center_and_up[face][0]);
-        mat4 probe_view = mat4_view_look_at(probe_pos, probe_tgt, center_and_up[face][1]);
-        mat4 probe_proj = mat4_perspective(radians(90.0f), 0.01f, 1000.0f, 1.0f);
-        render_scene(r, rs, probe_view, probe_proj);
-        gfx_end_pass();
+        for (int face = 0; face < GFX_CUBEFACE_NUM; ++face) {
+            jobs[num_jobs++] = (probe_face_job){
+                .slot       = 0,
+                .face       = face,
+                .position   = ri->probes[i].position,
+                .completes  = face == GFX_CUBEFACE_NUM - 1,
+                .bake_index = (int)i,
+            };
+        }
     }
+    r->probes.capturing = 0;
+    return num_jobs;
 }
 
-static void render_probe_visualization(renderer r, vec3 probe_pos, mat4 view, mat4 proj)
+static void probe_bake_upload(renderer r)
 {
-    /* Render debug view to default framebuffer */
-    gfx_begin_default_pass(&(gfx_pass_action){
-        .colors[0].action = GFX_ACTION_LOAD,
-        .depth.action = GFX_ACTION_LOAD
-    }, r->params.width, r->params.height);
-    gfx_apply_pipeline(r->probe_debug_pip);
-    gfx_apply_bindings(&(gfx_bindings){
-        .vertex_buffers[0] = r->sphere_vbuf,
-        .index_buffer      = r->sphere_ibuf,
-        .fs_images = { [0] = r->probe_color_img, }
+    probe_bake* pb = &r->probes.baked;
+    if (gfx_query_image_state(r->probes.baked_img) == GFX_RESOURCESTATE_VALID)
+        gfx_destroy_image(r->probes.baked_img);
+    gfx_image_data content = {0};
+    for (uint32_t m = 0; m < pb->num_mips; ++m)
+        content.subimage[0][m] = (gfx_range){ pb->levels[m], pb->level_sizes[m] };
+    r->probes.baked_img = gfx_make_image(&(gfx_image_desc){
+        .width        = (int)pb->width,
+        .height       = (int)pb->height,
+        .num_mipmaps  = (int)pb->num_mips,
+        .pixel_format = GFX_PIXELFORMAT_RGBA8,
+        .min_filter   = GFX_FILTER_LINEAR_MIPMAP_LINEAR,
+        .mag_filter   = GFX_FILTER_LINEAR,
+        .wrap_u       = GFX_WRAP_CLAMP_TO_EDGE,
+        .wrap_v       = GFX_WRAP_CLAMP_TO_EDGE,
+        .max_lod      = (float)(pb->num_mips - 1),
+        .data         = content,
     });
-    mat4 mdl = mat4_translation(probe_pos);
-    mat4 mvp = mat4_mul_mat4(mat4_mul_mat4(proj, view), mdl);
-    gfx_apply_uniforms(GFX_SHADERSTAGE_VS, 0, &(gfx_range){&mvp, sizeof(mat4)});
-    gfx_draw(0, r->sphere_num_elem, 1);
-    gfx_end_pass();
 }
 
-static void render_probe_octa_visualization(renderer r, int probe_idx)
+static void probe_bake_finish(renderer r)
 {
-    /* Render debug view to default framebuffer */
-    const int x = PROBE_CUBEMAP_RESOLUTION * probe_idx;
-    const int y = 0;
-    gfx_begin_default_pass(&(gfx_pass_action){
-        .colors[0].action = GFX_ACTION_LOAD,
-        .depth.action = GFX_ACTION_LOAD
-    }, r->params.width, r->params.height);
+    /* Filter mips, store the bake and serve probes from it from now on */
+    probe_bake* pb = &r->probes.bake;
+    probe_bake_build_mips(pb);
+    probe_bake_save(pb, r->probes.bake_path);
+    probe_bake_free(&r->probes.baked);
+    r->probes.baked = *pb;
+    *pb = (probe_bake){0};
+    probe_bake_upload(r);
+    free(r->probes.bake_path);
+    r->probes.bake_path = 0;
+}
+
+int renderer_load_probes(renderer r, const char* fpath)
+{
+    probe_bake pb;
+    if (probe_bake_load(&pb, fpath) != 0)
+        return -1;
+    probe_bake_free(&r->probes.baked);
+    r->probes.baked = pb;
+    probe_bake_upload(r);
+    return 0;
+}
+
+void renderer_bake_probes(renderer r, const char* fpath)
+{
+    free(r->probes.bake_path);
+    r->probes.bake_path = strdup(fpath);
+}
+
+/* Manifest lines list a program name, a hexadecimal feature bitmask and an index type */
+int renderer_load_pipeline_manifest(renderer r, const char* fpath)
+{
+    FILE* f = fopen(fpath, "r");
+    if (!f)
+        return -1;
+    shader_permutations* programs[] = { &r->default_perms, &r->shadow_perms };
+    char name[32];
+    unsigned int features, index_type;
+    while (fscanf(f, "%31s %x %u", name, &features, &index_type) == 3) {
+        if (features >= SHADER_MAX_PERMUTATIONS || index_type >= RENDERER_INDEX_TYPE_COUNT)
+            continue;
+        for (size_t i = 0; i < sizeof(programs) / sizeof(programs[0]); ++i)
+            if (strcmp(programs[i]->name, name) == 0)
+                permutation_pipeline(programs[i], features, index_type);
+    }
+    fclose(f);
+    return 0;
+}
+
+int renderer_save_pipeline_manifest(renderer r, const char* fpath)
+{
+    FILE* f = fopen(fpath, "w");
+    if (!f)
+        return -1;
+    shader_permutations* programs[] = { &r->default_perms, &r->shadow_perms };
+    for (size_t i = 0; i < sizeof(programs) / sizeof(programs[0]); ++i)
+        for (unsigned int features = 0; features < SHADER_MAX_PERMUTATIONS; ++features)
+            for (unsigned int index_type = 0; index_type < RENDERER_INDEX_TYPE_COUNT; ++index_type)
+                if (programs[i]->pipelines[features][index_type].id != GFX_INVALID_ID)
+                    fprintf(f, "%s %x %u\n", programs[i]->name, features, index_type);
+    fclose(f);
+    return 0;
+}
+
+static void render_probe_octa_pass(void* data)
+{
+    /* Capture is complete, store its octahedral projection in the probe atlas tile */
+    render_pass_data* d = data;
+    renderer r = d->r;
+    probe_face_job* job = d->job;
+    int x, y;
+    probe_tile_rect(job->slot, &x, &y);
     gfx_apply_pipeline(r->probe_trans_pip);
     gfx_apply_bindings(&(gfx_bindings){
         .vertex_buffers[0] = r->quad_vbuf,
-        .fs_images = { [0] = r->probe_color_img }
+        .fs_images = { [0] = frame_graph_image(r->graph, d->input) }
     });
     gfx_apply_viewport(x, y, PROBE_CUBEMAP_RESOLUTION, PROBE_CUBEMAP_RESOLUTION, 0);
     gfx_apply_scissor_rect(x, y, PROBE_CUBEMAP_RESOLUTION, PROBE_CUBEMAP_RESOLUTION, 0);
     gfx_draw(0, 3, 1);
-    gfx_end_pass();
+
+    /* Read tile back while the atlas framebuffer is still bound */
+    if (job->bake_index >= 0) {
+        size_t pitch;
+        unsigned char* dst = probe_bake_tile(&r->probes.bake, (uint32_t)job->bake_index, &pitch);
+        gfx_read_pixels(x, y, PROBE_CUBEMAP_RESOLUTION, PROBE_CUBEMAP_RESOLUTION, dst, pitch);
+    }
+}
+
+static void render_probe_visualization_pass(void* data)
+{
+    /* Render debug view of the cached probes to default framebuffer */
+    render_pass_data* d = data;
+    renderer r = d->r;
+    renderer_inputs* ri = d->ri;
+    mat4 view = d->views->view, proj = d->views->proj;
+    gfx_image atlas_img = frame_graph_image(r->graph, d->input);
+    size_t num_shown = 0;
+    for (size_t i = 0; i < ri->num_probes; ++i) {
+        size_t slot;
+        probe_cache_entry* pce = probe_cache_lookup(r, ri->probes[i].id, &slot);
+        if (!pce || !pce->valid)
+            continue;
+        gfx_image atlas = atlas_img;
+        vec4 rect = probe_tile_uv_rect(slot);
+        if (pce->baked) {
+            probe_bake* pb = &r->probes.baked;
+            atlas = r->probes.baked_img;
+            rect = vec4_new(
+                (float)((pce->baked_tile % PROBE_BAKE_TILES_PER_ROW) * pb->tile_res) / pb->width,
+                (float)((pce->baked_tile / PROBE_BAKE_TILES_PER_ROW) * pb->tile_res) / pb->height,
+                (float)pb->tile_res / pb->width,
+                (float)pb->tile_res / pb->height);
+        }
+        /* Probe sphere */
+        gfx_apply_pipeline(r->probe_debug_pip);
+        gfx_apply_bindings(&(gfx_bindings){
+            .vertex_buffers[0] = r->sphere_vbuf,
+            .index_buffer      = r->sphere_ibuf,
+            .fs_images = { [0] = atlas, }
+        });
+        mat4 mdl = mat4_translation(ri->probes[i].position);
+        mat4 mvp = mat4_mul_mat4(mat4_mul_mat4(proj, view), mdl);
+        gfx_apply_uniforms(GFX_SHADERSTAGE_VS, 0, &(gfx_range){&mvp, sizeof(mat4)});
+        gfx_apply_uniforms(GFX_SHADERSTAGE_FS, 0, &(gfx_range){&rect, sizeof(rect)});
+        gfx_draw(0, r->sphere_num_elem, 1);
+        /* Octahedral tile along the bottom edge */
+        const int x = PROBE_CUBEMAP_RESOLUTION * (int)num_shown++;
+        gfx_apply_pipeline(r->probe_blit_pip);
+        gfx_apply_bindings(&(gfx_bindings){
+            .vertex_buffers[0] = r->quad_vbuf,
+            .fs_images = { [0] = atlas }
+        });
+        gfx_apply_uniforms(GFX_SHADERSTAGE_FS, 0, &(gfx_range){&rect, sizeof(rect)});
+        gfx_apply_viewport(x, 0, PROBE_CUBEMAP_RESOLUTION, PROBE_CUBEMAP_RESOLUTION, 0);
+        gfx_apply_scissor_rect(x, 0, PROBE_CUBEMAP_RESOLUTION, PROBE_CUBEMAP_RESOLUTION, 0);
+        gfx_draw(0, 3, 1);
+        gfx_apply_viewport(0, 0, r->params.width, r->params.height, 0);
+        gfx_apply_scissor_rect(0, 0, r->params.width, r->params.height, 0);
+    }
+}
+
+static void render_overlay_pass(void* data)
+{
+    render_pass_data* d = data;
+    d->ri->overlay(d->ri->overlay_data);
+}
+
+typedef struct node_ref {
+    renderer_scene* scene;
+    size_t mesh;
+    size_t lod;
+    uint8_t* lod_state; /* Level kept across frames by the instance, if any */
+    mat4 transform;
+    aabb bounds;
+} node_ref;
+
+static int node_ref_cmp(const void* a, const void* b)
+{
+    const node_ref* na = a;
+    const node_ref* nb = b;
+    if (na->scene != nb->scene)
+        return na->scene < nb->scene ? -1 : 1;
+    if (na->mesh != nb->mesh)
+        return na->mesh < nb->mesh ? -1 : 1;
+    if (na->lod != nb->lod)
+        return na->lod < nb->lod ? -1 : 1;
+    return 0;
+}
+
+/* Coarsest level whose error projects under the pixel threshold. A level is only left once its
+ * error moves past the threshold by the hysteresis margin, so nodes near it do not flicker */
+static size_t select_lod(const renderer_mesh* mesh, aabb bounds, mat4 transform, vec3 eye, float pixels_per_unit, size_t prev)
+{
+    if (mesh->num_lods <= 1)
+        return 0;
+    float scale = fmaxf(vec3_length(vec3_new(transform.xx, transform.yx, transform.zx)),
+                  fmaxf(vec3_length(vec3_new(transform.xy, transform.yy, transform.zy)),
+                        vec3_length(vec3_new(transform.xz, transform.yz, transform.zz))));
+    float radius = 0.5f * vec3_length(vec3_sub(bounds.hi, bounds.lo));
+    float dist = fmaxf(vec3_dist(aabb_center(bounds), eye) - radius, CAMERA_NEAR);
+    float error_to_pixels = scale * pixels_per_unit / dist;
+    size_t lod = prev < mesh->num_lods ? prev : mesh->num_lods - 1;
+    while (lod > 0 && mesh->lod_errors[lod] * error_to_pixels > LOD_ERROR_PIXELS * (1.0f + LOD_HYSTERESIS))
+        --lod;
+    while (lod + 1 < mesh->num_lods && mesh->lod_errors[lod + 1] * error_to_pixels < LOD_ERROR_PIXELS * (1.0f - LOD_HYSTERESIS))
+        ++lod;
+    return lod;
+}
+
+static void upload_instance_transforms(renderer r, mat4* transforms, size_t count)
+{
+    /* Advance to the next ring slot, the previous ones may still be read by in flight frames */
+    size_t slot = r->instance_ring_head = (r->instance_ring_head + 1) % INSTANCE_BUFFER_RING_SIZE;
+    if (count == 0) {
+        r->instance_buf = r->instance_ring[slot];
+        return;
+    }
+
+    /* Grow slot buffer if needed */
+    if (count > r->instance_ring_cap[slot]) {
+        size_t ncap = r->instance_ring_cap[slot];
+        while (ncap < count)
+            ncap *= 2;
+        gfx_destroy_buffer(r->instance_ring[slot]);
+        r->instance_ring[slot] = gfx_make_buffer(&(gfx_buffer_desc){
+            .size  = ncap * sizeof(mat4),
+            .usage = GFX_USAGE_STREAM,
+        });
+        r->instance_ring_cap[slot] = ncap;
+    }
+
+    r->instance_buf = r->instance_ring[slot];
+    gfx_update_buffer(r->instance_buf, &(gfx_range){transforms, count * sizeof(mat4)});
+}
+
+static void rasterize_occluder(occlusion_buffer* ob, const cull_volume* cv, renderer_scene* rs, renderer_node* node, mat4 instance_transform)
+{
+    renderer_mesh* mesh = &rs->meshes[node->mesh];
+    if (mesh->occluder == RENDERER_SCENE_INVALID_INDEX)
+        return;
+    mat4 transform = mat4_mul_mat4(instance_transform, node->transform);
+    aabb bounds = aabb_transform(mesh->bounds, transform);
+    uint8_t visible;
+    if (!cull_boxes(cv, &bounds, 1, &visible))
+        return;
+    renderer_occluder* occ = &rs->occluders[mesh->occluder];
+    occlusion_rasterize(ob, occ->positions, occ->indices, occ->num_indices, transform);
+}
+
+static void prepare_occlusion(renderer r, renderer_inputs* ri, render_view* rv)
+{
+    /* Rasterize the occluders in view, then reduce their depth for the box tests */
+    occlusion_buffer* ob = &r->occlusion;
+    occlusion_buffer_clear(ob, mat4_mul_mat4(rv->proj, rv->view));
+    for (size_t k = 0; k < ri->num_instances; ++k) {
+        renderer_instance* inst = &ri->instances[k];
+        renderer_scene* rs = inst->scene;
+        if (!rs)
+            continue;
+        for (size_t i = 0; i < rs->num_nodes; ++i)
+            rasterize_occluder(ob, &rv->cull, rs, &rs->nodes[i], inst->transform);
+        for (size_t i = 0; i < rs->num_occluder_nodes; ++i)
+            rasterize_occluder(ob, &rv->cull, rs, &rs->occluder_nodes[i], inst->transform);
+    }
+    occlusion_build_hierarchy(ob);
+    rv->occlusion = ob;
+}
+
+static void prepare_frame_data(renderer r, renderer_inputs* ri, render_view* views, size_t num_views)
+{
+    /* Gather all instance nodes along with their world transforms */
+    size_t num_nodes = 0;
+    for (size_t k = 0; k < ri->num_instances; ++k)
+        if (ri->instances[k].scene)
+            num_nodes += ri->instances[k].scene->num_nodes;
+    node_ref* refs = arena_alloc(ri->frame_mem, num_nodes * sizeof(*refs));
+    mat4* node_transforms = arena_alloc(ri->frame_mem, num_nodes * sizeof(*node_transforms));
+    aabb* mesh_bounds = arena_alloc(ri->frame_mem, num_nodes * sizeof(*mesh_bounds));
+    aabb* node_bounds = arena_alloc(ri->frame_mem, num_nodes * sizeof(*node_bounds));
+    size_t n = 0;
+    for (size_t k = 0; k < ri->num_instances; ++k) {
+        renderer_instance* inst = &ri->instances[k];
+        renderer_scene* rs = inst->scene;
+        if (!rs)
+            continue;
+        for (size_t i = 0; i < rs->num_nodes; ++i) {
+            node_transforms[n] = mat4_mul_mat4(inst->transform, rs->nodes[i].transform);
+            mesh_bounds[n] = rs->meshes[rs->nodes[i].mesh].bounds;
+            refs[n++] = (node_ref){
+                .scene     = rs,
+                .mesh      = rs->nodes[i].mesh,
+                .lod_state = inst->lods ? &inst->lods[i] : 0,
+            };
+        }
+    }
+
+    /* Compute world space bounds */
+    aabb_transform_batch(node_bounds, mesh_bounds, node_transforms, num_nodes);
+
+    /* Levels of detail follow the main view in every view, so that shadows match the visible surfaces */
+    const render_view* main_view = &views[0];
+    vec3 eye = vpos_from_matrix(main_view->view);
+    float pixels_per_unit = 0.5f * (float)r->params.height * main_view->proj.yy;
+    for (size_t i = 0; i < num_nodes; ++i) {
+        node_ref* nr = &refs[i];
+        nr->transform = node_transforms[i];
+        nr->bounds = node_bounds[i];
+        nr->lod = select_lod(&nr->scene->meshes[nr->mesh], nr->bounds, nr->transform, eye, pixels_per_unit, nr->lod_state ? *nr->lod_state : 0);
+        if (nr->lod_state)
+            *nr->lod_state = (uint8_t)nr->lod;
+    }
+
+    /* Group nodes sharing the same mesh and level of detail */
+    qsort(refs, num_nodes, sizeof(*refs), node_ref_cmp);
+    for (size_t i = 0; i < num_nodes; ++i) {
+        node_transforms[i] = refs[i].transform;
+        node_bounds[i] = refs[i].bounds;
+    }
+
+    /* Cull nodes for each view, visible instances of all views share a single transform stream */
+    mat4* transforms = arena_alloc(ri->frame_mem, num_views * num_nodes * sizeof(*transforms));
+    uint8_t* visible = arena_alloc(ri->frame_mem, num_nodes * sizeof(*visible));
+    size_t num_transforms = 0;
+    for (size_t v = 0; v < num_views; ++v) {
+        render_view* rv = &views[v];
+        vec3 vpos = vpos_from_matrix(rv->view);
+        cull_boxes(&rv->cull, node_bounds, num_nodes, visible);
+        if (rv->occlusion)
+            occlusion_cull_boxes(rv->occlusion, node_bounds, num_nodes, visible);
+
+        /* Build batches out of the visible nodes */
+        draw_batch* batches = arena_alloc(ri->frame_mem, num_nodes * sizeof(*batches));
+        size_t num_batches = 0;
+        for (size_t i = 0; i < num_nodes; ++i) {
+            if (!visible[i])
+                continue;
+            draw_batch* last = num_batches ? &batches[num_batches - 1] : 0;
+            if (!last || last->scene != refs[i].scene || last->mesh != refs[i].mesh || last->lod != refs[i].lod) {
+                batches[num_batches++] = (draw_batch){
+                    .scene          = refs[i].scene,
+                    .mesh           = refs[i].mesh,
+                    .lod            = refs[i].lod,
+                    .first_instance = num_transforms,
+                    .depth          = FLT_MAX,
+                };
+            }
+            draw_batch* db = &batches[num_batches - 1];
+            ++db->num_instances;
+            db->depth = fminf(db->depth, vec3_dist(aabb_center(node_bounds[i]), vpos));
+            transforms[num_transforms++] = node_transforms[i];
+        }
+        rv->batches = batches;
+        rv->num_batches = num_batches;
+    }
+    upload_instance_transforms(r, transforms, num_transforms);
+}
+
+static void prepare_light_clusters(renderer r, renderer_inputs* ri, render_view* rv)
+{
+    /* Gather point lights, two rows of light data per light */
+    float exposure = exposure_from_ev100(CAMERA_EV100);
+    vec4* spheres = arena_alloc(ri->frame_mem, CLUSTER_MAX_LIGHTS * sizeof(*spheres));
+    vec4* light_data = arena_calloc(ri->frame_mem, 2 * CLUSTER_MAX_LIGHTS, sizeof(*light_data));
+    size_t num_lights = 0;
+    for (size_t i = 0; i < ri->num_lights && num_lights < CLUSTER_MAX_LIGHTS; ++i) {
+        renderer_light* rl = &ri->lights[i];
+        if (rl->type != RENDERER_LIGHT_TYPE_POINT)
+            continue;
+        spheres[num_lights] = vec4_new(rl->position.x, rl->position.y, rl->position.z, rl->radius);
+        light_data[2 * num_lights + 0] = spheres[num_lights];
+        light_data[2 * num_lights + 1] = vec4_new(rl->color.r, rl->color.g, rl->color.b, rl->intensity * exposure);
+        ++num_lights;
+    }
+
+    /* Bin lights into the view clusters */
+    cluster_params cp = light_cluster_params(rv);
+    cluster_bins cb;
+    cluster_bin_lights(&cb, &cp, spheres, num_lights, r->params.workers, ri->frame_mem);
+
+    /* Pack cluster lists and light indices */
+    float* grid = arena_alloc(ri->frame_mem, 2 * CLUSTER_COUNT * sizeof(*grid));
+    for (size_t c = 0; c < CLUSTER_COUNT; ++c) {
+        grid[2 * c + 0] = (float)cb.offsets[c];
+        grid[2 * c + 1] = (float)cb.counts[c];
+    }
+    float* indices = arena_calloc(ri->frame_mem, CLUSTER_MAX_INDICES, sizeof(*indices));
+    for (size_t i = 0; i < cb.num_indices; ++i)
+        indices[i] = (float)cb.indices[i];
+
+    gfx_update_image(r->light_data_img, &(gfx_image_data){
+        .subimage[0][0] = {light_data, 2 * CLUSTER_MAX_LIGHTS * sizeof(*light_data)}
+    });
+    gfx_update_image(r->cluster_grid_img, &(gfx_image_data){
+        .subimage[0][0] = {grid, 2 * CLUSTER_COUNT * sizeof(*grid)}
+    });
+    gfx_update_image(r->light_index_img, &(gfx_image_data){
+        .subimage[0][0] = {indices, CLUSTER_MAX_INDICES * sizeof(*indices)}
+    });
+    rv->clustered_lights = 1;
 }
 
-void renderer_frame(renderer r, renderer_inputs ri)
+void renderer_frame(renderer r, renderer_inputs* ri)
 {
+    uint64_t prepare_start = time_now();
+    gpu_timer_begin_frame(r->timer);
+
+    /* Probe faces captured this frame, a bake captures every probe at once */
+    int baking = r->probes.bake_path != 0;
+    size_t max_probe_jobs = baking ? ri->num_probes * GFX_CUBEFACE_NUM : PROBE_FACE_BUDGET;
+    probe_face_job* probe_jobs = arena_calloc(ri->frame_mem, max_probe_jobs ? max_probe_jobs : 1, sizeof(*probe_jobs));
+    size_t num_probe_jobs = baking
+        ? probe_schedule_bake(r, ri, probe_jobs)
+        : probe_schedule_faces(r, ri, probe_jobs);
+
+    /* Setup views: main camera, shadow caster and each probe face */
+    enum { VIEW_MAIN = 0, VIEW_SHADOW_CASCADES, VIEW_PROBE_FACES = VIEW_SHADOW_CASCADES + SHADOW_NUM_CASCADES };
+    size_t num_views = VIEW_PROBE_FACES + num_probe_jobs;
+    render_view* views = arena_calloc(ri->frame_mem, num_views, sizeof(*views));
+    for (size_t v = 0; v < num_views; ++v)
+        views[v].shadow_cascade = -1;
+    views[VIEW_MAIN].view = ri->view;
+    views[VIEW_MAIN].proj = camera_projection(r, CAMERA_NEAR, CAMERA_FAR);
+    shadow_cascades_fit(r, pick_main_light(ri), ri->view, r->cascades);
+    for (int c = 0; c < SHADOW_NUM_CASCADES; ++c) {
+        views[VIEW_SHADOW_CASCADES + c].view = r->cascades[c].view;
+        views[VIEW_SHADOW_CASCADES + c].proj = r->cascades[c].proj;
+        views[VIEW_SHADOW_CASCADES + c].shadow_cascade = c;
+    }
+    for (size_t i = 0; i < num_probe_jobs; ++i) {
+        render_view* rv = &views[VIEW_PROBE_FACES + i];
+        probe_face_matrices(probe_jobs[i].position, probe_jobs[i].face, &rv->view, &rv->proj);
+    }
+
+    /* Setup cull volumes, each cascade only needs the casters shadowing its own slice of the camera view */
+    for (size_t v = 0; v < num_views; ++v)
+        cull_volume_from_matrix(&views[v].cull, mat4_mul_mat4(views[v].proj, views[v].view));
+    for (int c = 0; c < SHADOW_NUM_CASCADES; ++c) {
+        shadow_cascade* sc = &r->cascades[c];
+        mat4 slice_proj = camera_projection(r, sc->split_near, sc->split_far);
+        cull_volume_shadow_casters(
+            &views[VIEW_SHADOW_CASCADES + c].cull,
+            mat4_mul_mat4(slice_proj, ri->view),
+            mat4_mul_mat4(sc->proj, sc->view),
+            light_direction(pick_main_light(ri)));
+    }
+
+    /* Occlusion culling for the main view, the other views see the scene from elsewhere */
+    prepare_occlusion(r, ri, &views[VIEW_MAIN]);
+
+    /* Cull and batch visible nodes for every view */
+    prepare_frame_data(r, ri, views, num_views);
+
+    /* Bin point lights for the main view, other views are lit by the main light only */
+    prepare_light_clusters(r, ri, &views[VIEW_MAIN]);
+
+    /* Record the draws of every view in parallel, passes only replay them */
+    record_view_commands(r, ri, views, num_views);
+
     /*
-     * Default pass
+     * Frame graph, passes are ordered by the textures they exchange rather than by declaration
      */
-    renderer_scene* rs = &ri.scene;
+    frame_graph fg = r->graph;
+    frame_graph_begin(fg);
+    frame_graph_resource backbuffer = frame_graph_import_backbuffer(fg, r->params.width, r->params.height);
+    frame_graph_resource probe_atlas = frame_graph_import_texture(fg, "probe_atlas", r->probe_atlas_img);
+    frame_graph_resource probe_cube = frame_graph_import_texture(fg, "probe_cube", r->probe_color_img);
 
-    /* View-projection matrix */
-    mat4 view = ri.view;
-    mat4 proj = mat4_perspective(radians(60.0f), 0.01f, 1000.0f, (float)r->params.width/(float)r->params.height);
+    /* Main view, lit by the filtered shadowmap declared further down */
+    render_pass_data* main_data = arena_alloc(ri->frame_mem, sizeof(*main_data));
+    *main_data = (render_pass_data){ .r = r, .ri = ri, .views = &views[VIEW_MAIN] };
+    size_t main_pass = frame_graph_add_pass(fg, "main", &(gfx_pass_action){
+        .colors[0] = {
+            .action = GFX_ACTION_CLEAR,
+            .value = { 0.0f, 0.0f, 0.0f, 1.0f }
+        }
+    }, render_scene_pass, main_data);
+    backbuffer = frame_graph_write_color(fg, main_pass, backbuffer, 0);
 
-    /* Pass action for default pass, clearing to black */
-    gfx_begin_default_pass(&(gfx_pass_action){
+    /* Shadow casters, every cascade into its tile of the atlas */
+    frame_graph_resource shadow_depth = frame_graph_create_texture(fg, "shadow_depth", &(gfx_image_desc){
+        .width        = SHADOW_ATLAS_RESOLUTION,
+        .height       = SHADOW_ATLAS_RESOLUTION,
+        .pixel_format = GFX_PIXELFORMAT_DEPTH_STENCIL,
+        .sample_count = 1,
+    });
+    frame_graph_resource shadow_raw = frame_graph_create_texture(fg, "shadow_raw", &r->shadow_img_desc);
+    render_pass_data* shadow_data = arena_alloc(ri->frame_mem, sizeof(*shadow_data));
+    *shadow_data = (render_pass_data){ .r = r, .ri = ri, .views = &views[VIEW_SHADOW_CASCADES] };
+    size_t shadow_pass = frame_graph_add_pass(fg, "shadow_casters", &(gfx_pass_action){
         .colors[0] = {
             .action = GFX_ACTION_CLEAR,
             .value = { 0.0f, 0.0f, 0.0f, 1.0f }
         }
-    }, r->params.width, r->params.height);
-    render_scene(r, rs, view, proj);
-    gfx_end_pass();
+    }, render_shadow_casters_pass, shadow_data);
+    shadow_raw = frame_graph_write_color(fg, shadow_pass, shadow_raw, 0);
+    frame_graph_write_depth(fg, shadow_pass, shadow_depth, 0);
 
-    /*
-     * Shadow pass
-     */
-    render_shadow_map(r, rs);
+    /* Separable prefilter, the filtered result can reuse the memory of the raw shadowmap */
+    frame_graph_resource shadow_map = shadow_raw;
+    const char* blur_names[] = {"shadow_blur_x", "shadow_blur_y"};
+    const char* blur_targets[] = {"shadow_blur", "shadow_map"};
+    for (int i = 0; i < 2; ++i) {
+        render_pass_data* blur_data = arena_alloc(ri->frame_mem, sizeof(*blur_data));
+        *blur_data = (render_pass_data){ .r = r, .ri = ri, .input = shadow_map, .blur_dir = (float)i };
+        size_t blur_pass = frame_graph_add_pass(fg, blur_names[i], &(gfx_pass_action){
+            .colors[0] = {
+                .action = GFX_ACTION_CLEAR,
+                .value = { 0.0f, 0.0f, 0.0f, 0.0f }
+            }
+        }, render_shadow_blur_pass, blur_data);
+        frame_graph_read(fg, blur_pass, shadow_map);
+        frame_graph_resource target = frame_graph_create_texture(fg, blur_targets[i], &r->shadow_img_desc);
+        shadow_map = frame_graph_write_color(fg, blur_pass, target, 0);
+    }
+    main_data->input = shadow_map;
+    frame_graph_read(fg, main_pass, shadow_map);
 
-    /*
-     * Probes pass
-     */
-    vec3 probe_positions[] = {
-        {{-4.0, 2.0, 0.0 }},
-        {{ 0.0, 2.0, 0.0 }},
-        {{ 4.0, 2.0, 0.0 }},
-    };
-    size_t num_probes = sizeof(probe_positions) / sizeof(probe_positions[0]);
-    for (size_t i = 0; i < num_probes; ++i) {
-        vec3 probe_pos = probe_positions[i];
-        render_probe_cubemap(r, rs, probe_pos);
-        render_probe_visualization(r, probe_pos, view, proj);
-        render_probe_octa_visualization(r, i);
+    /* Probe faces into the shared capture cubemap, completed captures into the probe atlas */
+    frame_graph_resource probe_depth = frame_graph_create_texture(fg, "probe_depth", &r->probe_depth_desc);
+    for (size_t i = 0; i < num_probe_jobs; ++i) {
+        probe_face_job* job = &probe_jobs[i];
+        render_pass_data* face_data = arena_alloc(ri->frame_mem, sizeof(*face_data));
+        *face_data = (render_pass_data){ .r = r, .ri = ri, .views = &views[VIEW_PROBE_FACES + i], .input = shadow_map };
+        size_t face_pass = frame_graph_add_pass(fg, "probe_face", &(gfx_pass_action){
+            .colors[0] = {
+                .action = GFX_ACTION_CLEAR,
+                .value = { 0.0f, 0.0f, 0.0f, 1.0f }
+            },
+        }, render_scene_pass, face_data);
+        frame_graph_read(fg, face_pass, shadow_map);
+        probe_cube = frame_graph_write_color(fg, face_pass, probe_cube, job->face);
+        probe_depth = frame_graph_write_depth(fg, face_pass, probe_depth, 0);
+        if (!job->completes)
+            continue;
+        render_pass_data* octa_data = arena_alloc(ri->frame_mem, sizeof(*octa_data));
+        *octa_data = (render_pass_data){ .r = r, .ri = ri, .input = probe_cube, .job = job };
+        size_t octa_pass = frame_graph_add_pass(fg, "probe_octahedral", &(gfx_pass_action){
+            .colors[0].action = GFX_ACTION_LOAD,
+        }, render_probe_octa_pass, octa_data);
+        frame_graph_read(fg, octa_pass, probe_cube);
+        probe_atlas = frame_graph_write_color(fg, octa_pass, probe_atlas, 0);
     }
 
+    /* Probe debug view on top of the main view */
+    render_pass_data* probe_dbg_data = arena_alloc(ri->frame_mem, sizeof(*probe_dbg_data));
+    *probe_dbg_data = (render_pass_data){ .r = r, .ri = ri, .views = &views[VIEW_MAIN], .input = probe_atlas };
+    size_t probe_dbg_pass = frame_graph_add_pass(fg, "probe_debug", &(gfx_pass_action){
+        .colors[0].action = GFX_ACTION_LOAD,
+        .depth.action = GFX_ACTION_LOAD,
+        .stencil.action = GFX_ACTION_LOAD,
+    }, render_probe_visualization_pass, probe_dbg_data);
+    frame_graph_read(fg, probe_dbg_pass, probe_atlas);
+    backbuffer = frame_graph_write_color(fg, probe_dbg_pass, backbuffer, 0);
+
+    /* Caller overlay, last on top */
+    if (ri->overlay) {
+        render_pass_data* overlay_data = arena_alloc(ri->frame_mem, sizeof(*overlay_data));
+        *overlay_data = (render_pass_data){ .r = r, .ri = ri };
+        size_t overlay_pass = frame_graph_add_pass(fg, "overlay", &(gfx_pass_action){
+            .colors[0].action = GFX_ACTION_LOAD,
+            .depth.action = GFX_ACTION_DONTCARE,
+            .stencil.action = GFX_ACTION_DONTCARE,
+        }, render_overlay_pass, overlay_data);
+        backbuffer = frame_graph_write_color(fg, overlay_pass, backbuffer, 0);
+    }
+
+    uint64_t submit_start = time_now();
+    r->prepare_msec = (float)time_msec(time_diff(submit_start, prepare_start));
+    frame_graph_execute(fg);
+    if (baking)
+        probe_bake_finish(r);
+
     /* Commit everything */
+    gpu_timer_end_frame(r->timer);
     gfx_commit();
+    r->submit_msec = (float)time_msec(time_since(submit_start));
+}
+
+void renderer_timings(renderer r, renderer_frame_timings* t)
+{
+    t->prepare_msec = r->prepare_msec;
+    t->submit_msec  = r->submit_msec;
+    t->gpu_msec     = gpu_timer_frame_msec(r->timer);
+    t->num_passes   = gpu_timer_results(r->timer, &t->passes);
 }
 
 void renderer_destroy(renderer r)
 {
+    for (size_t i = 0; i < INSTANCE_BUFFER_RING_SIZE; ++i)
+        gfx_destroy_buffer(r->instance_ring[i]);
+    probe_bake_free(&r->probes.baked);
+    probe_bake_free(&r->probes.bake);
+    free(r->probes.bake_path);
+    frame_graph_destroy(r->graph);
+    gpu_timer_destroy(r->timer);
+    occlusion_buffer_destroy(&r->occlusion);
+    for (size_t v = 0; v < r->num_view_cmds; ++v) {
+        render_commands_destroy(&r->view_cmds[v].commands);
+        arena_destroy(&r->view_cmds[v].mem);
+    }
+    free(r->view_cmds);
+    pipeline_cache_shutdown();
     gfx_shutdown();
     free(r);
 }
+
+void renderer_scene_alloc(renderer_scene* rs, renderer_scene_sizes* sz)
+{
+    arena_init(&rs->mem, 4096);
+    rs->buffers    = arena_calloc(&rs->mem, sz->buffers,    sizeof(*rs->buffers));
+    rs->images     = arena_calloc(&rs->mem, sz->images,     sizeof(*rs->images));
+    rs->pipelines  = arena_calloc(&rs->mem, sz->pipelines,  sizeof(*rs->pipelines));
+    rs->materials  = arena_calloc(&rs->mem, sz->materials,  sizeof(*rs->materials));
+    rs->primitives = arena_calloc(&rs->mem, sz->primitives, sizeof(*rs->primitives));
+    rs->meshes     = arena_calloc(&rs->mem, sz->meshes,     sizeof(*rs->meshes));
+    rs->nodes      = arena_calloc(&rs->mem, sz->nodes,      sizeof(*rs->nodes));
+    rs->occluders  = arena_calloc(&rs->mem, sz->occluders,  sizeof(*rs->occluders));
+    rs->occluder_nodes = arena_calloc(&rs->mem, sz->occluder_nodes, sizeof(*rs->occluder_nodes));
+}
+
+void renderer_scene_free(renderer_scene* rs)
+{
+    arena_destroy(&rs->mem);
+}
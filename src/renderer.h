@@ -32,18 +32,15 @@
 #define _RENDERER_H_
 
 #include <stdlib.h>
+#include <stdint.h>
 #include <linmath.h>
 #include <gfx.h>
+#include <resmngr.h>
+#include "arena.h"
+#include "thread_pool.h"
+#include "gpu_timer.h"
 
 #define RENDERER_SCENE_INVALID_INDEX (~0lu)
-#define RENDERER_SCENE_MAX_BUFFERS (16)
-#define RENDERER_SCENE_MAX_IMAGES (128)
-#define RENDERER_SCENE_MAX_MATERIALS (32)
-#define RENDERER_SCENE_MAX_PIPELINES (16)
-#define RENDERER_SCENE_MAX_PRIMITIVES (128)
-#define RENDERER_SCENE_MAX_MESHES (16)
-#define RENDERER_SCENE_MAX_NODES (16)
-#define RENDERER_SCENE_MAX_LIGHTS (16)
 
 /* Renderer type */
 typedef struct renderer* renderer;
@@ -52,6 +49,7 @@ typedef struct renderer* renderer;
 typedef struct renderer_params {
     int width;
     int height;
+    threadpool_t* workers; /* Optional, used for parallel frame preparation */
 } renderer_params;
 
 /* All materials grouped */
@@ -100,22 +98,80 @@ typedef struct renderer_material {
     } type;
 } renderer_material;
 
+/* Levels of detail a mesh can have, level 0 being the full resolution one */
+#define RENDERER_MAX_LODS (4)
+
+/* Range drawn for a single level of detail */
+typedef struct renderer_lod {
+    size_t base_element;  /* Index of first index or vertex to draw */
+    size_t num_elements;  /* Number of vertices or indices to draw */
+} renderer_lod;
+
 /* A 'primitive' (aka submesh) contains everything needed to issue a draw call */
 typedef struct renderer_primitive {
     size_t pipeline;      /* Index into scene.pipelines array */
     size_t material;      /* Index into scene.materials array */
-    size_t vertex_buffer; /* Index into scene.buffers array for vertex buffer */
+    size_t position_buffer; /* Index into scene.buffers array for the position only vertex stream */
+    size_t vertex_buffer; /* Index into scene.buffers array for the stream of remaining vertex attributes */
     size_t index_buffer;  /* Index into scene.buffers array for index buffer, or RENDERER_SCENE_INVALID_INDEX */
-    size_t base_element;  /* Index of first index or vertex to draw */
-    size_t num_elements;  /* Number of vertices or indices to draw */
+    renderer_lod lods[RENDERER_MAX_LODS]; /* Coarser levels index the same vertices from further in the index buffer */
+    aabb bounds;          /* Object space bounds of the referenced vertices */
 } renderer_primitive;
 
+/* Vertex layouts of mesh vertex buffers */
+typedef enum renderer_vertex_format {
+    RENDERER_VERTEX_FORMAT_FLOAT,     /* Float position, then float normal, texcoord and tangent */
+    RENDERER_VERTEX_FORMAT_QUANTIZED, /* renderer_quantized_position, then renderer_quantized_vertex, decoded with the mesh dequantization transform */
+    RENDERER_VERTEX_FORMAT_COUNT,
+} renderer_vertex_format;
+
+/* Widths of mesh index buffers */
+typedef enum renderer_index_type {
+    RENDERER_INDEX_TYPE_UINT32,
+    RENDERER_INDEX_TYPE_UINT16, /* Meshes with no more vertices than 16 bits can address */
+    RENDERER_INDEX_TYPE_COUNT,
+} renderer_index_type;
+
+/* Compact vertex position stream, normalized 16 bit integers */
+typedef struct renderer_quantized_position {
+    int16_t position[4]; /* Position within the mesh bounds, tangent handedness in w */
+} renderer_quantized_position;
+
+/* Compact vertex attribute stream, all components are normalized 16 bit integers */
+typedef struct renderer_quantized_vertex {
+    int16_t normal[4];   /* Octahedral normal in xy, octahedral tangent in zw */
+    int16_t texcoord[2]; /* Texture coordinates within their bounds */
+} renderer_quantized_vertex;
+
+/* Maps normalized quantized components back to their original range */
+typedef struct renderer_dequantize {
+    vec3 position_offset;
+    vec3 position_scale;
+    vec2 texcoord_offset;
+    vec2 texcoord_scale;
+} renderer_dequantize;
+
 /* A mesh is just a group of primitives (aka submeshes) */
 typedef struct renderer_mesh {
     size_t first_primitive; /* Index into scene.primitives */
     size_t num_primitives;
+    aabb bounds;            /* Union of primitive bounds */
+    size_t num_lods;        /* Levels of detail of every primitive, at least 1 */
+    float lod_errors[RENDERER_MAX_LODS]; /* Object space distance each level strays from the full resolution surface */
+    renderer_vertex_format vertex_format; /* Layout of the vertex streams shared by all primitives */
+    renderer_dequantize dequantize;       /* Only used by quantized vertex formats */
+    renderer_index_type index_type;       /* Width of the index buffer shared by all primitives */
+    size_t occluder;        /* Index into scene.occluders, or RENDERER_SCENE_INVALID_INDEX if the mesh does not occlude */
 } renderer_mesh;
 
+/* Low poly triangles kept on the CPU and rasterized for occlusion culling */
+typedef struct renderer_occluder {
+    vec3* positions;
+    uint32_t* indices;
+    size_t num_positions;
+    size_t num_indices;
+} renderer_occluder;
+
 /* A node associates a transform with an mesh */
 typedef struct renderer_node {
     size_t mesh; /* Index into scene.meshes */
@@ -127,22 +183,32 @@ typedef struct renderer_light {
     vec3 color;      /* Color of the light source */
     vec3 position;   /* Position of the light source */
     float intensity; /* Intensity of the light source */
+    float radius;    /* Range of influence of point lights */
     enum {
         RENDERER_LIGHT_TYPE_DIRECTIONAL,
         RENDERER_LIGHT_TYPE_POINT,
     } type;
 } renderer_light;
 
-/* The complete scene */
+/* A reflection probe, captured again whenever its version changes */
+typedef struct renderer_probe {
+    vec3 position;    /* Capture position */
+    float radius;     /* Range of content affecting the capture */
+    uint64_t id;      /* Stable identifier across frames */
+    uint32_t version; /* Bumped when the probe or content around it changes */
+} renderer_probe;
+
+/* The complete scene, with its arrays allocated from the scene's own arena */
 typedef struct renderer_scene {
-    gfx_buffer         buffers[RENDERER_SCENE_MAX_BUFFERS];
-    gfx_image          images[RENDERER_SCENE_MAX_IMAGES];
-    gfx_pipeline       pipelines[RENDERER_SCENE_MAX_PIPELINES];
-    renderer_material  materials[RENDERER_SCENE_MAX_MATERIALS];
-    renderer_primitive primitives[RENDERER_SCENE_MAX_PRIMITIVES];
-    renderer_mesh      meshes[RENDERER_SCENE_MAX_MESHES];
-    renderer_node      nodes[RENDERER_SCENE_MAX_NODES];
-    renderer_light     lights[RENDERER_SCENE_MAX_LIGHTS];
+    gfx_buffer*         buffers;
+    gfx_image*          images;
+    gfx_pipeline*       pipelines;
+    renderer_material*  materials;
+    renderer_primitive* primitives;
+    renderer_mesh*      meshes;
+    renderer_node*      nodes;
+    renderer_occluder*  occluders;
+    renderer_node*      occluder_nodes; /* Occlude without being drawn */
     size_t num_buffers;
     size_t num_images;
     size_t num_pipelines;
@@ -150,16 +216,71 @@ typedef struct renderer_scene {
     size_t num_primitives;
     size_t num_meshes;
     size_t num_nodes;
-    size_t num_lights;
+    size_t num_occluders;
+    size_t num_occluder_nodes;
+    struct arena mem;
 } renderer_scene;
 
+/* Number of array elements to reserve when allocating a scene */
+typedef struct renderer_scene_sizes {
+    size_t buffers;
+    size_t images;
+    size_t pipelines;
+    size_t materials;
+    size_t primitives;
+    size_t meshes;
+    size_t nodes;
+    size_t occluders;
+    size_t occluder_nodes;
+} renderer_scene_sizes;
+
+/* An instance places a model scene in the world, acting as its render proxy */
+typedef struct renderer_instance {
+    rid model;             /* Model resource handle */
+    renderer_scene* scene; /* Scene of the model resolved when the frame is built, null once the model is deleted */
+    mat4 transform;        /* World transform of the owning entity */
+    uint8_t* lods;         /* Level of detail each scene node was last drawn with, kept by the renderer. Optional */
+} renderer_instance;
+
+/* Per frame renderer inputs, referencing the retained render proxies */
 typedef struct renderer_inputs {
-    renderer_scene scene;
+    renderer_instance* instances;
+    size_t num_instances;
+    renderer_light* lights;
+    size_t num_lights;
+    renderer_probe* probes;
+    size_t num_probes;
     mat4 view;
+    struct arena* frame_mem; /* Transient allocations, reset every frame */
+    void (*overlay)(void* userdata); /* Optional, draws on top of the frame inside the default pass */
+    void* overlay_data;
 } renderer_inputs;
 
+/* Timings of the last frame, GPU ones belong to an earlier frame, as they are read back without stalling */
+typedef struct renderer_frame_timings {
+    float prepare_msec;              /* CPU time spent culling, batching and uploading */
+    float submit_msec;               /* CPU time spent issuing GPU commands */
+    float gpu_msec;                  /* GPU time of the whole frame */
+    const gpu_timer_result* passes;  /* GPU time of each pass */
+    size_t num_passes;
+} renderer_frame_timings;
+
 renderer renderer_create(renderer_params* params);
-void renderer_frame(renderer r, renderer_inputs ri);
+void renderer_frame(renderer r, renderer_inputs* ri);
+void renderer_timings(renderer r, renderer_frame_timings* t);
+/* Loads baked probes from given file, probes at a baked position are served from it, returns 0 on success */
+int renderer_load_probes(renderer r, const char* fpath);
+/* Requests a bake of all probes during the next frame, which are then written to given file and served from it */
+void renderer_bake_probes(renderer r, const char* fpath);
+/* Compiles the shader permutations listed in given manifest ahead of their first use, returns 0 on success */
+int renderer_load_pipeline_manifest(renderer r, const char* fpath);
+/* Lists the shader permutations compiled so far in given manifest, returns 0 on success */
+int renderer_save_pipeline_manifest(renderer r, const char* fpath);
 void renderer_destroy(renderer r);
 
+/* Allocates zeroed scene arrays with given sizes, counts are left to the caller */
+void renderer_scene_alloc(renderer_scene* rs, renderer_scene_sizes* sz);
+/* Releases the scene arrays */
+void renderer_scene_free(renderer_scene* rs);
+
 #endif /* ! _RENDERER_H_ */
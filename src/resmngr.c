@@ -1,11 +1,17 @@
 #include "resmngr.h"
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <ctype.h>
+#include <math.h>
+#include <float.h>
 #include "renderer.h"
 #include "cgltf.h"
 #include "stb_image.h"
 #include "mikktspace.h"
+#include "simplify.h"
+#include "optimize.h"
 #include "text.h"
 #include "list.h"
 #include "threads.h"
@@ -13,12 +19,28 @@
 
 #define RES_TYPE_TEXTURE 1
 
+/* Triangle budget of authored occluders, larger ones still occlude but cost more to rasterize than they should */
+#define OCCLUDER_MAX_TRIANGLES 256
+/* Primitives below this many triangles are not simplified any further */
+#define LOD_MIN_TRIANGLES 64
+/* A level has to get rid of a fifth of the triangles of the previous one to be kept */
+#define LOD_MIN_REDUCTION 0.8
+/* Clusters may split where their cache miss ratio is within this factor of the whole cluster */
+#define OVERDRAW_THRESHOLD 1.05f
+/* Largest position step of quantized meshes, bigger meshes keep float vertices */
+#define QUANTIZE_MAX_POSITION_STEP 1e-3f
+
 typedef struct resmngr {
     struct slot_map scene_map;
     struct slot_map font_map;
     struct list_head loaded_queue;
     mtx_t loaded_queue_mtx;
     threadpool_t* worker_pool;
+    int quantize_vertices;
+    /* Scenes of deleted models, released once no frame in flight references them */
+    void** deleted_models;
+    size_t num_deleted_models;
+    size_t cap_deleted_models;
 }* resmngr;
 
 typedef struct load_params {
@@ -49,7 +71,7 @@ typedef struct loaded_data_texture {
 resmngr resmngr_create()
 {
     resmngr rm = calloc(1, sizeof(*rm));
-    slot_map_init(&rm->scene_map, sizeof(renderer_scene));
+    slot_map_init(&rm->scene_map, sizeof(renderer_scene*));
     slot_map_init(&rm->font_map, sizeof(font));
     mtx_init(&rm->loaded_queue_mtx, mtx_plain);
     rm->worker_pool = threadpool_create(8, THREAD_POOL_MAX_QUEUE);
@@ -57,6 +79,11 @@ resmngr resmngr_create()
     return rm;
 }
 
+void resmngr_set_vertex_quantization(resmngr rm, int enabled)
+{
+    rm->quantize_vertices = enabled;
+}
+
 int resmngr_handle_valid(rid r)
 {
     return slot_map_key_valid(r);
@@ -109,6 +136,9 @@ void resmngr_destroy(resmngr rm)
         rid r = slot_map_data_to_key(&rm->scene_map, i);
         resmngr_model_delete(rm, r);
     }
+    for (size_t i = 0; i < rm->num_deleted_models; ++i)
+        resmngr_model_release(rm->deleted_models[i]);
+    free(rm->deleted_models);
     for (size_t i = 0; i < rm->font_map.size; ++i) {
         rid r = slot_map_data_to_key(&rm->font_map, i);
         resmngr_font_delete(rm, r);
@@ -118,11 +148,20 @@ void resmngr_destroy(resmngr rm)
     free(rm);
 }
 
+/* Splits interleaved float vertices into a stream of positions and a stream of the attributes after them */
+static void split_vertex_streams(void* pdata, void* adata, const void* vdata, size_t vsize, size_t vcount)
+{
+    const size_t psize = 3 * sizeof(float), asize = vsize - psize;
+    for (size_t i = 0; i < vcount; ++i) {
+        memcpy((char*)pdata + i * psize, (const char*)vdata + i * vsize, psize);
+        memcpy((char*)adata + i * asize, (const char*)vdata + i * vsize + psize, asize);
+    }
+}
+
 rid resmngr_model_sample(resmngr rm)
 {
-    rid r = slot_map_insert(&rm->scene_map, 0);
-    renderer_scene* rs = slot_map_lookup(&rm->scene_map, r);
-    memset(rs, 0, sizeof(*rs));
+    renderer_scene* rs = calloc(1, sizeof(*rs));
+    rid r = slot_map_insert(&rm->scene_map, &rs);
 
     float vertices[] = {
         /* pos               nrm                 uvs    */
@@ -151,14 +190,23 @@ rid resmngr_model_sample(resmngr rm)
          0.5, -0.5, -0.5,    0.0,  0.0, -1.0,    1.0, 0.0,    0.0, 0.0, 0.0, 0.0,
          0.5,  0.5, -0.5,    0.0,  0.0, -1.0,    1.0, 1.0,    0.0, 0.0, 0.0, 0.0,
     };
+    float positions[sizeof(vertices) / sizeof(float) / 12 * 3];
+    float attributes[sizeof(vertices) / sizeof(float) / 12 * 9];
+    split_vertex_streams(positions, attributes, vertices, 12 * sizeof(float), sizeof(vertices) / sizeof(float) / 12);
+    gfx_buffer pbuf = gfx_make_buffer(&(gfx_buffer_desc){
+        .data = {
+            .ptr = positions,
+            .size = sizeof(positions),
+        },
+    });
     gfx_buffer vbuf = gfx_make_buffer(&(gfx_buffer_desc){
         .data = {
-            .ptr = vertices,
-            .size = sizeof(vertices),
+            .ptr = attributes,
+            .size = sizeof(attributes),
         },
     });
 
-    uint32_t indices[] = {
+    uint16_t indices[] = {
          0,  1,  2,
          3,  2,  1,
          4,  5,  6,
@@ -180,37 +228,42 @@ rid resmngr_model_sample(resmngr rm)
         }
     });
 
-    *rs = (renderer_scene){
-        .buffers = {
-            vbuf,
-            ibuf
-        },
-        .primitives = {
-            [0] = {
-                .vertex_buffer = 0,
-                .index_buffer = 1,
-                .base_element = 0,
-                .num_elements = sizeof(indices) / sizeof(indices[0]),
-                .material = RENDERER_SCENE_INVALID_INDEX,
-            }
-        },
-        .meshes = {
-            [0] = {
-                .first_primitive = 0,
-                .num_primitives = 1
-            }
-        },
-        .nodes = {
-            [0] = {
-                .mesh = 0,
-                .transform = mat4_id()
-            }
+    renderer_scene_alloc(rs, &(renderer_scene_sizes){
+        .buffers    = 3,
+        .primitives = 1,
+        .meshes     = 1,
+        .nodes      = 1,
+    });
+    rs->buffers[0] = pbuf;
+    rs->buffers[1] = vbuf;
+    rs->buffers[2] = ibuf;
+    rs->primitives[0] = (renderer_primitive){
+        .position_buffer = 0,
+        .vertex_buffer = 1,
+        .index_buffer = 2,
+        .lods[0] = {
+            .base_element = 0,
+            .num_elements = sizeof(indices) / sizeof(indices[0]),
         },
-        .num_buffers    = 2,
+        .material = RENDERER_SCENE_INVALID_INDEX,
+        .bounds = aabb_new(vec3_new(-0.5, -0.5, -0.5), vec3_new(0.5, 0.5, 0.5)),
+    };
+    rs->meshes[0] = (renderer_mesh){
+        .first_primitive = 0,
         .num_primitives = 1,
-        .num_meshes     = 1,
-        .num_nodes      = 1,
+        .bounds = rs->primitives[0].bounds,
+        .num_lods = 1,
+        .index_type = RENDERER_INDEX_TYPE_UINT16,
+        .occluder = RENDERER_SCENE_INVALID_INDEX,
+    };
+    rs->nodes[0] = (renderer_node){
+        .mesh = 0,
+        .transform = mat4_id()
     };
+    rs->num_buffers    = 3;
+    rs->num_primitives = 1;
+    rs->num_meshes     = 1;
+    rs->num_nodes      = 1;
 
     return r;
 }
@@ -284,17 +337,191 @@ static void gltf_generate_tangents(void* vdata, size_t vsize, uint32_t* idata, s
     });
 }
 
-static void gltf_parse_meshes(renderer_scene* rs, const cgltf_data* gltf)
+/* Occluders are opted in by name, matched case insensitively */
+static int gltf_name_is_occluder(const char* name)
 {
-    assert(gltf->meshes_count < RENDERER_SCENE_MAX_MESHES);
+    if (!name)
+        return 0;
+    char lower[256] = {0};
+    for (size_t i = 0; name[i] && i + 1 < sizeof(lower); ++i)
+        lower[i] = tolower((unsigned char)name[i]);
+    return strstr(lower, "occluder") != 0;
+}
 
+/* Nodes named as occluders only feed occlusion culling and are never drawn */
+static int gltf_node_is_occluder(const cgltf_node* node)
+{
+    return node->mesh && gltf_name_is_occluder(node->name);
+}
+
+/* Only explicitly authored meshes occlude, either named as occluders or referenced by occluder nodes.
+ * Arbitrary low poly meshes do not, as alpha tested cards, glass or thin props would hide what is behind them */
+static int gltf_mesh_is_occluder(const cgltf_data* gltf, const cgltf_mesh* mesh)
+{
+    if (gltf_name_is_occluder(mesh->name))
+        return 1;
+    for (size_t i = 0; i < gltf->nodes_count; ++i)
+        if (gltf->nodes[i].mesh == mesh && gltf_node_is_occluder(&gltf->nodes[i]))
+            return 1;
+    return 0;
+}
+
+static void gltf_scene_alloc(renderer_scene* rs, const cgltf_data* gltf)
+{
+    /* Reserve exactly what the gltf file describes */
+    size_t num_primitives = 0, num_occluders = 0;
+    for (size_t i = 0; i < gltf->meshes_count; ++i) {
+        num_primitives += gltf->meshes[i].primitives_count;
+        num_occluders += gltf_mesh_is_occluder(gltf, &gltf->meshes[i]);
+    }
+    size_t num_nodes = 0, num_occluder_nodes = 0;
+    for (size_t i = 0; i < gltf->nodes_count; ++i) {
+        int occluder = gltf_node_is_occluder(&gltf->nodes[i]);
+        num_nodes += gltf->nodes[i].mesh != 0 && !occluder;
+        num_occluder_nodes += occluder;
+    }
+
+    renderer_scene_alloc(rs, &(renderer_scene_sizes){
+        .buffers    = 3 * gltf->meshes_count,
+        .images     = gltf->textures_count,
+        .materials  = gltf->materials_count,
+        .primitives = num_primitives,
+        .meshes     = gltf->meshes_count,
+        .nodes      = num_nodes,
+        .occluders  = num_occluders,
+        .occluder_nodes = num_occluder_nodes,
+    });
+}
+
+/* Orders triangles for the post transform cache first, then moves outer clusters ahead against overdraw */
+static void gltf_optimize_triangles(uint32_t* idata, size_t icount, const void* vdata, size_t vsize, size_t vcount)
+{
+    uint32_t* tmp = malloc(icount * sizeof(*tmp));
+    optimize_vertex_cache(tmp, idata, icount, vcount);
+    optimize_overdraw(idata, tmp, icount, vdata, vsize, vcount, OVERDRAW_THRESHOLD);
+    free(tmp);
+}
+
+/* Simplifies each primitive of the mesh level by level, halving its triangles every time.
+ * Levels share the vertex buffer and go after the full resolution indices in the index buffer */
+static uint32_t* gltf_generate_lods(renderer_scene* rs, renderer_mesh* mesh, void* vdata, size_t vsize, size_t vcount, uint32_t* idata, size_t* icount)
+{
+    for (size_t j = 0; j < mesh->num_primitives; ++j) {
+        renderer_primitive* prim = &rs->primitives[mesh->first_primitive + j];
+        size_t level = 1;
+        for (; level < RENDERER_MAX_LODS; ++level) {
+            renderer_lod* prev = &prim->lods[level - 1];
+            if (prev->num_elements / 3 < LOD_MIN_TRIANGLES)
+                break;
+            uint32_t* lod = malloc(prev->num_elements * sizeof(*lod));
+            float error = 0.0f;
+            size_t count = simplify_mesh(
+                lod, idata + prev->base_element, prev->num_elements,
+                vdata, vsize, vcount, prev->num_elements / 2, &error);
+            /* Not worth another level when simplification gets stuck */
+            if (count > prev->num_elements * LOD_MIN_REDUCTION) {
+                free(lod);
+                break;
+            }
+            gltf_optimize_triangles(lod, count, vdata, vsize, vcount);
+            idata = realloc(idata, (*icount + count) * sizeof(*idata));
+            memcpy(idata + *icount, lod, count * sizeof(*idata));
+            free(lod);
+            prim->lods[level] = (renderer_lod){ .base_element = *icount, .num_elements = count };
+            *icount += count;
+            /* Every level builds on the previous one, so their errors add up */
+            error += mesh->lod_errors[level - 1];
+            mesh->lod_errors[level] = fmaxf(mesh->lod_errors[level], error);
+        }
+        /* Primitives that stop early keep drawing their coarsest level */
+        for (size_t l = level; l < RENDERER_MAX_LODS; ++l)
+            prim->lods[l] = prim->lods[level - 1];
+        mesh->num_lods = level > mesh->num_lods ? level : mesh->num_lods;
+    }
+    return idata;
+}
+
+static int16_t quantize_snorm16(float v)
+{
+    v = v < -1.0f ? -1.0f : (v > 1.0f ? 1.0f : v);
+    return (int16_t)lroundf(v * 32767.0f);
+}
+
+/* Octahedral mapping of a unit vector onto the [-1, 1] square, matching oct_decode in the shaders */
+static void oct_encode(const float* v, int16_t* out)
+{
+    float l1 = fabsf(v[0]) + fabsf(v[1]) + fabsf(v[2]);
+    float x = l1 > 0.0f ? v[0] / l1 : 0.0f;
+    float y = l1 > 0.0f ? v[1] / l1 : 0.0f;
+    if (v[2] < 0.0f) {
+        float ox = (1.0f - fabsf(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+        float oy = (1.0f - fabsf(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+        x = ox; y = oy;
+    }
+    out[0] = quantize_snorm16(x);
+    out[1] = quantize_snorm16(y);
+}
+
+/* Packs float vertices into quantized position and attribute streams relative to the mesh bounds.
+ * Returns 0 for meshes too large to keep positions within the allowed step */
+static int gltf_quantize_vertices(renderer_mesh* mesh, renderer_quantized_position* qpos, renderer_quantized_vertex* qdata, const void* vdata, size_t vsize, size_t vcount)
+{
+    vec3 center = aabb_center(mesh->bounds);
+    vec3 extent = vec3_mul(vec3_sub(mesh->bounds.hi, mesh->bounds.lo), 0.5f);
+    if (fmaxf(extent.x, fmaxf(extent.y, extent.z)) / 32767.0f > QUANTIZE_MAX_POSITION_STEP)
+        return 0;
+
+    /* Texture coordinate bounds */
+    vec2 tlo = vec2_new(FLT_MAX, FLT_MAX), thi = vec2_new(-FLT_MAX, -FLT_MAX);
+    for (size_t i = 0; i < vcount; ++i) {
+        const float* uv = (const float*)((const char*)vdata + i * vsize) + 3 + 3;
+        tlo = vec2_new(fminf(tlo.x, uv[0]), fminf(tlo.y, uv[1]));
+        thi = vec2_new(fmaxf(thi.x, uv[0]), fmaxf(thi.y, uv[1]));
+    }
+    vec2 tcenter = vec2_mul(vec2_add(tlo, thi), 0.5f);
+    vec2 textent = vec2_mul(vec2_sub(thi, tlo), 0.5f);
+
+    /* Degenerate axes would divide by zero */
+    for (int k = 0; k < 3; ++k)
+        extent.xyz[k] = fmaxf(extent.xyz[k], 1e-6f);
+    for (int k = 0; k < 2; ++k)
+        textent.xy[k] = fmaxf(textent.xy[k], 1e-6f);
+
+    for (size_t i = 0; i < vcount; ++i) {
+        const float* v = (const float*)((const char*)vdata + i * vsize);
+        const float* pos = v, *nrm = v + 3, *uv = v + 3 + 3, *tng = v + 3 + 3 + 2;
+        renderer_quantized_vertex* q = &qdata[i];
+        for (int k = 0; k < 3; ++k)
+            qpos[i].position[k] = quantize_snorm16((pos[k] - center.xyz[k]) / extent.xyz[k]);
+        qpos[i].position[3] = tng[3] < 0.0f ? -32767 : 32767;
+        oct_encode(nrm, &q->normal[0]);
+        oct_encode(tng, &q->normal[2]);
+        for (int k = 0; k < 2; ++k)
+            q->texcoord[k] = quantize_snorm16((uv[k] - tcenter.xy[k]) / textent.xy[k]);
+    }
+
+    mesh->vertex_format = RENDERER_VERTEX_FORMAT_QUANTIZED;
+    mesh->dequantize = (renderer_dequantize){
+        .position_offset = center,
+        .position_scale  = extent,
+        .texcoord_offset = tcenter,
+        .texcoord_scale  = textent,
+    };
+    return 1;
+}
+
+static void gltf_parse_meshes(renderer_scene* rs, const cgltf_data* gltf, int quantize)
+{
     for (size_t i = 0; i < gltf->meshes_count; ++i) {
         cgltf_mesh* gltf_mesh = &gltf->meshes[i];
-        rs->meshes[rs->num_meshes++] = (renderer_mesh) {
+        renderer_mesh* mesh = &rs->meshes[rs->num_meshes++];
+        *mesh = (renderer_mesh) {
             .first_primitive = rs->num_primitives,
             .num_primitives  = gltf_mesh->primitives_count,
+            .bounds          = aabb_empty(),
+            .num_lods        = 1,
+            .occluder        = RENDERER_SCENE_INVALID_INDEX,
         };
-        assert(rs->num_primitives + gltf_mesh->primitives_count < RENDERER_SCENE_MAX_PRIMITIVES);
 
         /* Count vertices and indices for current mesh */
         size_t vcount = 0, icount = 0;
@@ -312,12 +539,12 @@ static void gltf_parse_meshes(renderer_scene* rs, const cgltf_data* gltf)
         }
 
         /* Allocate buffers */
-        assert(rs->num_buffers + 2 < RENDERER_SCENE_MAX_BUFFERS);
         size_t vsize = (3 /* pos */ + 3 /* nrm */ + 2 /* uv */ + 4 /* tng */) * sizeof(float);
         float* vdata = calloc(vcount, vsize);
         uint32_t* idata = calloc(icount, sizeof(*idata));
-        size_t nvert_buf = rs->num_buffers + 0;
-        size_t nindc_buf = rs->num_buffers + 1;
+        size_t npos_buf  = rs->num_buffers + 0;
+        size_t nvert_buf = rs->num_buffers + 1;
+        size_t nindc_buf = rs->num_buffers + 2;
 
         /* Populate buffers */
         size_t voffs = 0; size_t ioffs = 0;
@@ -325,6 +552,7 @@ static void gltf_parse_meshes(renderer_scene* rs, const cgltf_data* gltf)
             /* Current primitive */
             cgltf_primitive* gltf_prim = &gltf_mesh->primitives[j];
             renderer_primitive* prim = &rs->primitives[rs->num_primitives++];
+            prim->position_buffer = npos_buf;
             prim->vertex_buffer = nvert_buf;
             prim->index_buffer  = nindc_buf;
             prim->material      = gltf_prim->material - gltf->materials;
@@ -381,13 +609,21 @@ static void gltf_parse_meshes(renderer_scene* rs, const cgltf_data* gltf)
                 }
             }
 
+            /* Compute primitive bounds from copied positions */
+            prim->bounds = aabb_empty();
+            for (size_t l = 0; l < nverts; ++l) {
+                float* pos = (void*)vdata + (voffs + l) * vsize;
+                prim->bounds = aabb_merge_point(prim->bounds, vec3_new(pos[0], pos[1], pos[2]));
+            }
+            mesh->bounds = aabb_merge(mesh->bounds, prim->bounds);
+
             /* Only indexed meshes supported for now */
             assert(gltf_prim->indices != 0);
             assert(gltf_prim->indices->type == cgltf_type_scalar);
 
             /* Copy index data for current primitive */
-            prim->base_element = ioffs;
-            prim->num_elements = gltf_prim->indices->count;
+            prim->lods[0].base_element = ioffs;
+            prim->lods[0].num_elements = gltf_prim->indices->count;
             for (size_t k = 0; k < gltf_prim->indices->count; ++k) {
                 void* isrc = gltf_prim->indices->buffer_view->buffer->data
                            + gltf_prim->indices->buffer_view->offset;
@@ -416,27 +652,88 @@ static void gltf_parse_meshes(renderer_scene* rs, const cgltf_data* gltf)
             if (!has_tangents)
                 gltf_generate_tangents(vdata, vsize, idata + ioffs, gltf_prim->indices->count);
 
+            /* Source triangle order is arbitrary */
+            gltf_optimize_triangles(idata + ioffs, gltf_prim->indices->count, vdata, vsize, vcount);
+
             /* Increase offsets by number of vertices/indices */
             voffs += nverts;
             ioffs += gltf_prim->indices->count;
         }
 
+        /* Append coarser levels of detail after the full resolution indices */
+        size_t num_full_indices = icount;
+        idata = gltf_generate_lods(rs, mesh, vdata, vsize, vcount, idata, &icount);
+
+        /* Lay vertices out in the order the triangles fetch them, dropping unreferenced ones */
+        float* odata = malloc(vcount * vsize);
+        vcount = optimize_vertex_fetch(odata, idata, icount, vdata, vcount, vsize);
+        free(vdata);
+        vdata = odata;
+
+        /* Keep positions and indices of occluders around for the software rasterizer */
+        if (gltf_mesh_is_occluder(gltf, gltf_mesh)) {
+            if (num_full_indices / 3 > OCCLUDER_MAX_TRIANGLES)
+                fprintf(stderr, "Occluder mesh '%s' has %zu triangles, over the budget of %d\n",
+                        gltf_mesh->name ? gltf_mesh->name : "", num_full_indices / 3, OCCLUDER_MAX_TRIANGLES);
+            mesh->occluder = rs->num_occluders;
+            renderer_occluder* occ = &rs->occluders[rs->num_occluders++];
+            *occ = (renderer_occluder) {
+                .positions     = arena_alloc(&rs->mem, vcount * sizeof(*occ->positions)),
+                .indices       = arena_alloc(&rs->mem, num_full_indices * sizeof(*occ->indices)),
+                .num_positions = vcount,
+                .num_indices   = num_full_indices,
+            };
+            for (size_t l = 0; l < vcount; ++l)
+                memcpy(&occ->positions[l], (void*)vdata + l * vsize, sizeof(*occ->positions));
+            memcpy(occ->indices, idata, num_full_indices * sizeof(*idata));
+        }
+
+        /* Positions get a stream of their own for the passes that need nothing else,
+         * both streams are packed into the compact layout when requested */
+        size_t psize = 3 * sizeof(float), asize = vsize - psize;
+        void* pdata = malloc(vcount * psize);
+        void* adata = malloc(vcount * asize);
+        if (quantize && gltf_quantize_vertices(mesh, pdata, adata, vdata, vsize, vcount)) {
+            psize = sizeof(renderer_quantized_position);
+            asize = sizeof(renderer_quantized_vertex);
+        } else {
+            split_vertex_streams(pdata, adata, vdata, vsize, vcount);
+        }
+
+        /* Narrow indices when every vertex fits in 16 bits */
+        uint16_t* sdata = 0;
+        if (vcount <= UINT16_MAX + 1) {
+            sdata = malloc(icount * sizeof(*sdata));
+            for (size_t l = 0; l < icount; ++l)
+                sdata[l] = (uint16_t)idata[l];
+            mesh->index_type = RENDERER_INDEX_TYPE_UINT16;
+        }
+
         /* Upload and store buffer handles */
         rs->buffers[rs->num_buffers++] = gfx_make_buffer(&(gfx_buffer_desc){
             .data = {
-                .ptr = vdata,
-                .size = vcount * vsize,
+                .ptr = pdata,
+                .size = vcount * psize,
+            }
+        });
+        rs->buffers[rs->num_buffers++] = gfx_make_buffer(&(gfx_buffer_desc){
+            .data = {
+                .ptr = adata,
+                .size = vcount * asize,
             }
         });
         rs->buffers[rs->num_buffers++] = gfx_make_buffer(&(gfx_buffer_desc){
             .type = GFX_BUFFERTYPE_INDEXBUFFER,
             .data = {
-                .ptr = idata,
-                .size = icount * sizeof(*idata),
+                .ptr = sdata ? (void*)sdata : idata,
+                .size = icount * (sdata ? sizeof(*sdata) : sizeof(*idata)),
             }
         });
 
         /* Free intermediate buffers */
+        free(sdata);
+        free(adata);
+        free(pdata);
         free(idata);
         free(vdata);
     }
@@ -490,14 +787,15 @@ static mat4 build_transform_for_gltf_node(const cgltf_data* gltf, const cgltf_no
 
 static void gltf_parse_nodes(renderer_scene* rs, const cgltf_data* gltf)
 {
-    assert(gltf->nodes_count < RENDERER_SCENE_MAX_NODES);
-
     for (size_t i = 0; i < gltf->nodes_count; ++i) {
         cgltf_node* gltf_node = &gltf->nodes[i];
         /* Ignore nodes without mesh, those are not relevant since we
            bake the transform hierarchy into per-node world space transforms */
         if (gltf_node->mesh) {
-            rs->nodes[rs->num_nodes++] = (renderer_node) {
+            renderer_node* node = gltf_node_is_occluder(gltf_node)
+                ? &rs->occluder_nodes[rs->num_occluder_nodes++]
+                : &rs->nodes[rs->num_nodes++];
+            *node = (renderer_node) {
                 .mesh = gltf_node->mesh - gltf->meshes,
                 .transform = build_transform_for_gltf_node(gltf, gltf_node),
             };
@@ -514,8 +812,6 @@ static size_t gltf_texture_index(const cgltf_data* gltf, cgltf_texture* texture)
 
 static void gltf_parse_materials(renderer_scene* rs, const cgltf_data* gltf)
 {
-    assert(gltf->materials_count < RENDERER_SCENE_MAX_MATERIALS);
-
     for (size_t i = 0; i < gltf->materials_count; ++i) {
         cgltf_material* gltf_mat = &gltf->materials[i];
         renderer_material* rmat = &rs->materials[rs->num_materials++];
@@ -695,7 +991,6 @@ static void upload_image_resource(gfx_image im, gfx_image_desc* desc)
 
 static int gltf_load_textures(renderer_scene* rs, const char* gltf_path, const cgltf_data* gltf, resmngr rm)
 {
-    assert(gltf->textures_count < RENDERER_SCENE_MAX_IMAGES);
     for (size_t i = 0; i < gltf->textures_count; ++i) {
         /* Get texture location */
         cgltf_texture* gltf_tex = &gltf->textures[i];
@@ -724,9 +1019,8 @@ static int gltf_load_textures(renderer_scene* rs, const char* gltf_path, const c
 
 rid resmngr_model_from_gltf(resmngr rm, const char* fpath)
 {
-    rid r = slot_map_insert(&rm->scene_map, 0);
-    renderer_scene* rs = slot_map_lookup(&rm->scene_map, r);
-    memset(rs, 0, sizeof(*rs));
+    renderer_scene* rs = calloc(1, sizeof(*rs));
+    rid r = slot_map_insert(&rm->scene_map, &rs);
 
     cgltf_data* data = 0;
     cgltf_options options = {};
@@ -740,7 +1034,8 @@ rid resmngr_model_from_gltf(resmngr rm, const char* fpath)
     if (result != cgltf_result_success)
         return RID_INVALID;
 
-    gltf_parse_meshes(rs, data);
+    gltf_scene_alloc(rs, data);
+    gltf_parse_meshes(rs, data, rm->quantize_vertices);
     gltf_parse_nodes(rs, data);
     gltf_parse_materials(rs, data);
 
@@ -753,14 +1048,38 @@ rid resmngr_model_from_gltf(resmngr rm, const char* fpath)
 
 void* resmngr_model_lookup(resmngr rm, rid r)
 {
-    return slot_map_lookup(&rm->scene_map, r);
+    /* Scenes are stored by reference so that their address stays
+       stable for render proxies when the slot map storage grows */
+    renderer_scene** prs = slot_map_lookup(&rm->scene_map, r);
+    return prs ? *prs : 0;
 }
 
 void resmngr_model_delete(resmngr rm, rid r)
 {
-    struct slot_map* sm = &rm->scene_map;
-    renderer_scene* rs = slot_map_lookup(sm, r);
+    /* Lookups fail from now on, the scene itself is released after the frames in flight */
+    renderer_scene* rs = resmngr_model_lookup(rm, r);
+    if (!rs)
+        return;
+    if (rm->num_deleted_models == rm->cap_deleted_models) {
+        rm->cap_deleted_models = rm->cap_deleted_models ? 2 * rm->cap_deleted_models : 16;
+        rm->deleted_models = realloc(rm->deleted_models, rm->cap_deleted_models * sizeof(*rm->deleted_models));
+    }
+    rm->deleted_models[rm->num_deleted_models++] = rs;
+    slot_map_remove(&rm->scene_map, r);
+}
 
+void resmngr_take_deleted_models(resmngr rm, void*** scenes, size_t* count)
+{
+    *scenes = rm->deleted_models;
+    *count = rm->num_deleted_models;
+    rm->deleted_models = 0;
+    rm->num_deleted_models = 0;
+    rm->cap_deleted_models = 0;
+}
+
+void resmngr_model_release(void* scene)
+{
+    renderer_scene* rs = scene;
     for (size_t i = 0; i < rs->num_buffers; ++i) {
         gfx_buffer buf = rs->buffers[i];
         gfx_destroy_buffer(buf);
@@ -771,7 +1090,8 @@ void resmngr_model_delete(resmngr rm, rid r)
         gfx_destroy_image(img);
     }
 
-    slot_map_remove(sm, r);
+    renderer_scene_free(rs);
+    free(rs);
 }
 
 static rid resmngr_font_from_ttf(resmngr rm, load_params lparams)
@@ -7,6 +7,7 @@
 #define SHADERS_EXTN ".glsl"
 #define SHADERS_PATH "shaders/"
 #define SHADERS_INCD "#include"
+#define SHADERS_VERD "#version"
 
 static void path_join(char* path, const char* base, const char* uri)
 {
@@ -142,6 +143,34 @@ shader_desc shader_fetch(const char* name)
     return desc;
 }
 
+shader_desc shader_fetch_defines(const char* name, const char* defines)
+{
+    shader_desc desc = shader_fetch(name);
+    if (!desc->source)
+        return desc;
+
+    /* Version directive has to stay the first line */
+    const char* src = desc->source;
+    size_t head_sz = 0;
+    if (strncmp(SHADERS_VERD, src, strlen(SHADERS_VERD)) == 0) {
+        const char* eol = strchr(src, '\n');
+        head_sz = eol ? (size_t)(eol - src) + 1 : strlen(src);
+    }
+
+    /* Splice definitions between version directive and shader body */
+    size_t src_sz = strlen(src), defines_sz = strlen(defines);
+    char* nsrc = calloc(1, src_sz + defines_sz + 2);
+    memcpy(nsrc, src, head_sz);
+    memcpy(nsrc + head_sz, defines, defines_sz);
+    size_t offs = head_sz + defines_sz;
+    if (defines_sz && defines[defines_sz - 1] != '\n')
+        nsrc[offs++] = '\n';
+    memcpy(nsrc + offs, src + head_sz, src_sz - head_sz);
+    free((void*)desc->source);
+    desc->source = nsrc;
+    return desc;
+}
+
 void shader_free(shader_desc desc)
 {
     free((void*)desc->source);
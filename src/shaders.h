@@ -37,6 +37,8 @@ typedef struct shader_desc {
 }* shader_desc;
 
 shader_desc shader_fetch(const char* name);
+/* Fetches a shader with the given preprocessor lines inserted after its version directive */
+shader_desc shader_fetch_defines(const char* name, const char* defines);
 void shader_free(shader_desc desc);
 
 #endif /* ! _SHADERS_H_ */
@@ -0,0 +1,132 @@
+/*********************************************************************************************************************/
+/*                                                  /===-_---~~~~~~~~~------____                                     */
+/*                                                 |===-~___                _,-'                                     */
+/*                  -==\\                         `//~\\   ~~~~`---.___.-~~                                          */
+/*              ______-==|                         | |  \\           _-~`                                            */
+/*        __--~~~  ,-/-==\\                        | |   `\        ,'                                                */
+/*     _-~       /'    |  \\                      / /      \      /                                                  */
+/*   .'        /       |   \\                   /' /        \   /'                                                   */
+/*  /  ____  /         |    \`\.__/-~~ ~ \ _ _/'  /          \/'                                                     */
+/* /-'~    ~~~~~---__  |     ~-/~         ( )   /'        _--~`                                                      */
+/*                   \_|      /        _)   ;  ),   __--~~                                                           */
+/*                     '~~--_/      _-~/-  / \   '-~ \                                                               */
+/*                    {\__--_/}    / \\_>- )<__\      \                                                              */
+/*                    /'   (_/  _-~  | |__>--<__|      |                                                             */
+/*                   |0  0 _/) )-~     | |__>--<__|     |                                                            */
+/*                   / /~ ,_/       / /__>---<__/      |                                                             */
+/*                  o o _//        /-~_>---<__-~      /                                                              */
+/*                  (^(~          /~_>---<__-      _-~                                                               */
+/*                 ,/|           /__>--<__/     _-~                                                                  */
+/*              ,//('(          |__>--<__|     /                  .----_                                             */
+/*             ( ( '))          |__>--<__|    |                 /' _---_~\                                           */
+/*          `-)) )) (           |__>--<__|    |               /'  /     ~\`\                                         */
+/*         ,/,'//( (             \__>--<__\    \            /'  //        ||                                         */
+/*       ,( ( ((, ))              ~-__>--<_~-_  ~--____---~' _/'/        /'                                          */
+/*     `~/  )` ) ,/|                 ~-_~>--<_/-__       __-~ _/                                                     */
+/*   ._-~//( )/ )) `                    ~~-'_/_/ /~~~~~~~__--~                                                       */
+/*    ;'( ')/ ,)(                              ~~~~~~~~~~                                                            */
+/*   ' ') '( (/                                                                                                      */
+/*     '   '  `                                                                                                      */
+/*********************************************************************************************************************/
+#ifndef _SIMD_H_
+#define _SIMD_H_
+
+/*
+ * Thin 4-wide float vector abstraction used by the batch math kernels.
+ * Maps to SSE on x86, NEON on ARM and to plain arrays elsewhere.
+ */
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define SIMD_SSE
+#include <xmmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define SIMD_NEON
+#include <arm_neon.h>
+#else
+#define SIMD_SCALAR
+#endif
+
+#if defined(SIMD_SSE)
+typedef __m128 simd4f;
+
+static inline simd4f simd4f_load(const float* p) { return _mm_loadu_ps(p); }
+static inline void simd4f_store(float* p, simd4f v) { _mm_storeu_ps(p, v); }
+static inline simd4f simd4f_splat(float x) { return _mm_set1_ps(x); }
+static inline simd4f simd4f_set(float x, float y, float z, float w) { return _mm_setr_ps(x, y, z, w); }
+static inline simd4f simd4f_add(simd4f a, simd4f b) { return _mm_add_ps(a, b); }
+static inline simd4f simd4f_sub(simd4f a, simd4f b) { return _mm_sub_ps(a, b); }
+static inline simd4f simd4f_mul(simd4f a, simd4f b) { return _mm_mul_ps(a, b); }
+static inline simd4f simd4f_madd(simd4f a, simd4f b, simd4f c) { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+static inline simd4f simd4f_min(simd4f a, simd4f b) { return _mm_min_ps(a, b); }
+static inline simd4f simd4f_max(simd4f a, simd4f b) { return _mm_max_ps(a, b); }
+static inline simd4f simd4f_abs(simd4f a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+static inline int simd4f_movemask_gt(simd4f a, simd4f b) { return _mm_movemask_ps(_mm_cmpgt_ps(a, b)); }
+static inline void simd4f_transpose(simd4f* r0, simd4f* r1, simd4f* r2, simd4f* r3) { _MM_TRANSPOSE4_PS(*r0, *r1, *r2, *r3); }
+
+#elif defined(SIMD_NEON)
+typedef float32x4_t simd4f;
+
+static inline simd4f simd4f_load(const float* p) { return vld1q_f32(p); }
+static inline void simd4f_store(float* p, simd4f v) { vst1q_f32(p, v); }
+static inline simd4f simd4f_splat(float x) { return vdupq_n_f32(x); }
+static inline simd4f simd4f_set(float x, float y, float z, float w) { float v[4] = {x, y, z, w}; return vld1q_f32(v); }
+static inline simd4f simd4f_add(simd4f a, simd4f b) { return vaddq_f32(a, b); }
+static inline simd4f simd4f_sub(simd4f a, simd4f b) { return vsubq_f32(a, b); }
+static inline simd4f simd4f_mul(simd4f a, simd4f b) { return vmulq_f32(a, b); }
+static inline simd4f simd4f_madd(simd4f a, simd4f b, simd4f c) { return vmlaq_f32(c, a, b); }
+static inline simd4f simd4f_min(simd4f a, simd4f b) { return vminq_f32(a, b); }
+static inline simd4f simd4f_max(simd4f a, simd4f b) { return vmaxq_f32(a, b); }
+static inline simd4f simd4f_abs(simd4f a) { return vabsq_f32(a); }
+static inline int simd4f_movemask_gt(simd4f a, simd4f b)
+{
+    uint32x4_t m = vcgtq_f32(a, b);
+    return (vgetq_lane_u32(m, 0) & 1) | (vgetq_lane_u32(m, 1) & 2)
+         | (vgetq_lane_u32(m, 2) & 4) | (vgetq_lane_u32(m, 3) & 8);
+}
+static inline void simd4f_transpose(simd4f* r0, simd4f* r1, simd4f* r2, simd4f* r3)
+{
+    float32x4x2_t t01 = vtrnq_f32(*r0, *r1);
+    float32x4x2_t t23 = vtrnq_f32(*r2, *r3);
+    *r0 = vcombine_f32(vget_low_f32(t01.val[0]), vget_low_f32(t23.val[0]));
+    *r1 = vcombine_f32(vget_low_f32(t01.val[1]), vget_low_f32(t23.val[1]));
+    *r2 = vcombine_f32(vget_high_f32(t01.val[0]), vget_high_f32(t23.val[0]));
+    *r3 = vcombine_f32(vget_high_f32(t01.val[1]), vget_high_f32(t23.val[1]));
+}
+
+#else
+typedef struct { float v[4]; } simd4f;
+
+static inline simd4f simd4f_load(const float* p) { return (simd4f){{p[0], p[1], p[2], p[3]}}; }
+static inline void simd4f_store(float* p, simd4f v) { p[0] = v.v[0]; p[1] = v.v[1]; p[2] = v.v[2]; p[3] = v.v[3]; }
+static inline simd4f simd4f_splat(float x) { return (simd4f){{x, x, x, x}}; }
+static inline simd4f simd4f_set(float x, float y, float z, float w) { return (simd4f){{x, y, z, w}}; }
+#define SIMD4F_BINOP(name, expr) \
+    static inline simd4f name(simd4f a, simd4f b) { simd4f r; for (int i = 0; i < 4; ++i) { float x = a.v[i], y = b.v[i]; r.v[i] = (expr); } return r; }
+SIMD4F_BINOP(simd4f_add, x + y)
+SIMD4F_BINOP(simd4f_sub, x - y)
+SIMD4F_BINOP(simd4f_mul, x * y)
+SIMD4F_BINOP(simd4f_min, x < y ? x : y)
+SIMD4F_BINOP(simd4f_max, x > y ? x : y)
+#undef SIMD4F_BINOP
+static inline simd4f simd4f_madd(simd4f a, simd4f b, simd4f c) { return simd4f_add(simd4f_mul(a, b), c); }
+static inline simd4f simd4f_abs(simd4f a) { for (int i = 0; i < 4; ++i) a.v[i] = a.v[i] < 0.0f ? -a.v[i] : a.v[i]; return a; }
+static inline int simd4f_movemask_gt(simd4f a, simd4f b)
+{
+    int m = 0;
+    for (int i = 0; i < 4; ++i)
+        m |= (a.v[i] > b.v[i]) << i;
+    return m;
+}
+static inline void simd4f_transpose(simd4f* r0, simd4f* r1, simd4f* r2, simd4f* r3)
+{
+    simd4f* r[4] = {r0, r1, r2, r3};
+    for (int i = 0; i < 4; ++i) {
+        for (int j = i + 1; j < 4; ++j) {
+            float t = r[i]->v[j];
+            r[i]->v[j] = r[j]->v[i];
+            r[j]->v[i] = t;
+        }
+    }
+}
+#endif
+
+#endif /* ! _SIMD_H_ */
@@ -0,0 +1,226 @@
+#include "simplify.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+/* Symmetric 4x4 matrix summing squared distances to a set of planes, weighted by triangle area */
+typedef struct quadric {
+    double xx, xy, xz, xw, yy, yz, yw, zz, zw, ww;
+    double w;
+} quadric;
+
+typedef struct collapse {
+    uint32_t from;
+    uint32_t to;
+    double cost;
+} collapse;
+
+static const float* vertex_position(const void* positions, size_t stride, uint32_t v)
+{
+    return (const float*)((const char*)positions + v * stride);
+}
+
+static void quadric_add_plane(quadric* q, double a, double b, double c, double d, double w)
+{
+    q->xx += w * a * a; q->xy += w * a * b; q->xz += w * a * c; q->xw += w * a * d;
+    q->yy += w * b * b; q->yz += w * b * c; q->yw += w * b * d;
+    q->zz += w * c * c; q->zw += w * c * d;
+    q->ww += w * d * d;
+    q->w  += w;
+}
+
+static void quadric_add(quadric* q, const quadric* o)
+{
+    q->xx += o->xx; q->xy += o->xy; q->xz += o->xz; q->xw += o->xw;
+    q->yy += o->yy; q->yz += o->yz; q->yw += o->yw;
+    q->zz += o->zz; q->zw += o->zw;
+    q->ww += o->ww;
+    q->w  += o->w;
+}
+
+/* Mean squared distance from p to the planes of both quadrics */
+static double quadric_error(const quadric* q, const quadric* o, const float* p)
+{
+    double x = p[0], y = p[1], z = p[2];
+    double e = (q->xx + o->xx) * x * x + 2.0 * (q->xy + o->xy) * x * y + 2.0 * (q->xz + o->xz) * x * z + 2.0 * (q->xw + o->xw) * x
+             + (q->yy + o->yy) * y * y + 2.0 * (q->yz + o->yz) * y * z + 2.0 * (q->yw + o->yw) * y
+             + (q->zz + o->zz) * z * z + 2.0 * (q->zw + o->zw) * z
+             + (q->ww + o->ww);
+    double w = q->w + o->w;
+    return e > 0.0 && w > 0.0 ? e / w : 0.0;
+}
+
+static void triangle_normal(const float* p0, const float* p1, const float* p2, double n[3])
+{
+    double e1[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+    double e2[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+    n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+    n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+    n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+}
+
+static int edge_key_cmp(const void* a, const void* b)
+{
+    uint64_t ka = *(const uint64_t*)a, kb = *(const uint64_t*)b;
+    return ka < kb ? -1 : ka > kb;
+}
+
+static int collapse_cmp(const void* a, const void* b)
+{
+    const collapse* ca = a;
+    const collapse* cb = b;
+    return ca->cost < cb->cost ? -1 : ca->cost > cb->cost;
+}
+
+/* Locks vertices of edges not shared by exactly two triangles */
+static void lock_open_edges(uint8_t* locked, const uint32_t* indices, size_t num_indices)
+{
+    uint64_t* keys = malloc(num_indices * sizeof(*keys));
+    for (size_t i = 0; i < num_indices; ++i) {
+        uint32_t a = indices[i], b = indices[i - i % 3 + (i + 1) % 3];
+        keys[i] = a < b ? (uint64_t)a << 32 | b : (uint64_t)b << 32 | a;
+    }
+    qsort(keys, num_indices, sizeof(*keys), edge_key_cmp);
+    for (size_t i = 0; i < num_indices;) {
+        size_t j = i;
+        while (j < num_indices && keys[j] == keys[i])
+            ++j;
+        if (j - i != 2) {
+            locked[keys[i] >> 32] = 1;
+            locked[keys[i] & 0xFFFFFFFFu] = 1;
+        }
+        i = j;
+    }
+    free(keys);
+}
+
+/* Moving from onto to must not turn any remaining triangle around from over */
+static int collapse_flips(const uint32_t* indices, const uint32_t* adj, size_t adj_count, uint32_t from, uint32_t to, const void* positions, size_t stride)
+{
+    for (size_t k = 0; k < adj_count; ++k) {
+        const uint32_t* tri = &indices[3 * adj[k]];
+        if (tri[0] == to || tri[1] == to || tri[2] == to)
+            continue;
+        const float* p[3];
+        const float* q[3];
+        for (int c = 0; c < 3; ++c) {
+            p[c] = vertex_position(positions, stride, tri[c]);
+            q[c] = vertex_position(positions, stride, tri[c] == from ? to : tri[c]);
+        }
+        double n0[3], n1[3];
+        triangle_normal(p[0], p[1], p[2], n0);
+        triangle_normal(q[0], q[1], q[2], n1);
+        if (n0[0] * n1[0] + n0[1] * n1[1] + n0[2] * n1[2] <= 0.0)
+            return 1;
+    }
+    return 0;
+}
+
+size_t simplify_mesh(
+    uint32_t* dst, const uint32_t* indices, size_t num_indices,
+    const void* positions, size_t stride, size_t num_vertices,
+    size_t target_indices, float* error)
+{
+    memcpy(dst, indices, num_indices * sizeof(*dst));
+    size_t count = num_indices - num_indices % 3;
+    double max_error = 0.0;
+
+    /* Each vertex sums the planes of the triangles around it */
+    quadric* quadrics = calloc(num_vertices, sizeof(*quadrics));
+    for (size_t t = 0; t < count; t += 3) {
+        const float* p0 = vertex_position(positions, stride, dst[t + 0]);
+        const float* p1 = vertex_position(positions, stride, dst[t + 1]);
+        const float* p2 = vertex_position(positions, stride, dst[t + 2]);
+        double n[3];
+        triangle_normal(p0, p1, p2, n);
+        double len = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        if (len == 0.0)
+            continue;
+        n[0] /= len; n[1] /= len; n[2] /= len;
+        double d = -(n[0] * p0[0] + n[1] * p0[1] + n[2] * p0[2]);
+        for (int c = 0; c < 3; ++c)
+            quadric_add_plane(&quadrics[dst[t + c]], n[0], n[1], n[2], d, 0.5 * len);
+    }
+
+    uint8_t* locked = calloc(num_vertices, sizeof(*locked));
+    lock_open_edges(locked, dst, count);
+
+    uint32_t* remap = malloc(num_vertices * sizeof(*remap));
+    uint8_t* dirty = malloc(num_vertices * sizeof(*dirty));
+    uint32_t* adj_offsets = malloc((num_vertices + 1) * sizeof(*adj_offsets));
+    uint32_t* adj = malloc(count * sizeof(*adj));
+    collapse* collapses = malloc(2 * count * sizeof(*collapses));
+
+    /* Every pass collapses the cheapest edges that do not touch each other */
+    while (count > target_indices) {
+        /* Triangles around each vertex */
+        memset(adj_offsets, 0, (num_vertices + 1) * sizeof(*adj_offsets));
+        for (size_t i = 0; i < count; ++i)
+            ++adj_offsets[dst[i] + 1];
+        for (size_t v = 0; v < num_vertices; ++v)
+            adj_offsets[v + 1] += adj_offsets[v];
+        for (size_t i = 0; i < count; ++i)
+            adj[adj_offsets[dst[i]]++] = (uint32_t)(i / 3);
+        for (size_t v = num_vertices; v > 0; --v)
+            adj_offsets[v] = adj_offsets[v - 1];
+        adj_offsets[0] = 0;
+
+        /* Both directions of every edge, cheapest first */
+        size_t num_collapses = 0;
+        for (size_t i = 0; i < count; ++i) {
+            uint32_t a = dst[i], b = dst[i - i % 3 + (i + 1) % 3];
+            if (!locked[a])
+                collapses[num_collapses++] = (collapse){a, b, quadric_error(&quadrics[a], &quadrics[b], vertex_position(positions, stride, b))};
+            if (!locked[b])
+                collapses[num_collapses++] = (collapse){b, a, quadric_error(&quadrics[a], &quadrics[b], vertex_position(positions, stride, a))};
+        }
+        qsort(collapses, num_collapses, sizeof(*collapses), collapse_cmp);
+
+        for (size_t v = 0; v < num_vertices; ++v)
+            remap[v] = (uint32_t)v;
+        memset(dirty, 0, num_vertices * sizeof(*dirty));
+        size_t remaining = count, num_collapsed = 0;
+        for (size_t i = 0; i < num_collapses && remaining > target_indices; ++i) {
+            collapse* c = &collapses[i];
+            if (dirty[c->from] || dirty[c->to])
+                continue;
+            const uint32_t* from_adj = &adj[adj_offsets[c->from]];
+            size_t from_adj_count = adj_offsets[c->from + 1] - adj_offsets[c->from];
+            if (collapse_flips(dst, from_adj, from_adj_count, c->from, c->to, positions, stride))
+                continue;
+            remap[c->from] = c->to;
+            quadric_add(&quadrics[c->to], &quadrics[c->from]);
+            /* Neighbourhood changed, leave it to the next pass */
+            for (size_t k = 0; k < from_adj_count; ++k) {
+                const uint32_t* tri = &dst[3 * from_adj[k]];
+                dirty[tri[0]] = dirty[tri[1]] = dirty[tri[2]] = 1;
+                if (tri[0] == c->to || tri[1] == c->to || tri[2] == c->to)
+                    remaining -= 3;
+            }
+            max_error = c->cost > max_error ? c->cost : max_error;
+            ++num_collapsed;
+        }
+        if (num_collapsed == 0)
+            break;
+
+        /* Apply the collapses and drop the triangles that degenerated */
+        size_t n = 0;
+        for (size_t t = 0; t < count; t += 3) {
+            uint32_t a = remap[dst[t + 0]], b = remap[dst[t + 1]], c = remap[dst[t + 2]];
+            if (a == b || b == c || c == a)
+                continue;
+            dst[n++] = a; dst[n++] = b; dst[n++] = c;
+        }
+        count = n;
+    }
+
+    free(collapses);
+    free(adj);
+    free(adj_offsets);
+    free(dirty);
+    free(remap);
+    free(locked);
+    free(quadrics);
+    *error = (float)sqrt(max_error);
+    return count;
+}
@@ -1,10 +1,12 @@
 #include "text.h"
+#include <assert.h>
 #include <stdlib.h>
 #include <string.h>
 #include <linmath.h>
 #include <math.h>
 #include <gfx.h>
 #include "texture_font.h"
+#include "pipeline_cache.h"
 
 #define GLSRC(src) "#version 330 core\n" #src
 
@@ -98,7 +100,7 @@ typedef struct text_renderer {
 
 text_renderer text_renderer_create()
 {
-    gfx_shader shd = gfx_make_shader(&(gfx_shader_desc){
+    gfx_shader shd = pipeline_cache_shader(&(gfx_shader_desc){
         .attrs = {
             [0].name = "vpos",
             [1].name = "vtco",
@@ -143,7 +145,7 @@ text_renderer text_renderer_create()
         .fs.source = TEXT_FSH,
     });
 
-    gfx_pipeline pip = gfx_make_pipeline(&(gfx_pipeline_desc){
+    gfx_pipeline pip = pipeline_cache_pipeline(&(gfx_pipeline_desc){
         .layout = {
             .attrs = {
                 [0] = { .format = GFX_VERTEXFORMAT_FLOAT2 }, /* position */
@@ -172,12 +174,12 @@ text_renderer text_renderer_create()
     gfx_buffer vbuf = gfx_make_buffer(&(gfx_buffer_desc){
         .type = GFX_BUFFERTYPE_VERTEXBUFFER,
         .usage = GFX_USAGE_DYNAMIC,
-        .size = 8192,
+        .size = TEXT_MAX_CHARS * 4 * sizeof(tvertex),
     });
     gfx_buffer ibuf = gfx_make_buffer(&(gfx_buffer_desc){
         .type = GFX_BUFFERTYPE_INDEXBUFFER,
         .usage = GFX_USAGE_DYNAMIC,
-        .size = 8192,
+        .size = TEXT_MAX_CHARS * 6 * sizeof(uint16_t),
     });
 
     text_renderer tr = calloc(1, sizeof(*tr));
@@ -192,8 +194,6 @@ void text_renderer_destroy(text_renderer tr)
 {
     gfx_destroy_buffer(tr->ibuf);
     gfx_destroy_buffer(tr->vbuf);
-    gfx_destroy_pipeline(tr->pip);
-    gfx_destroy_shader(tr->shd);
     free(tr);
 }
 
@@ -202,17 +202,17 @@ static vec4 add_text(tvertex* verts, uint16_t* indcs, texture_font* font, const
     vec4 bbox = {{0, 0, 0, 0}};
     /* Iterate through each character */
     for (size_t i = 0; i < strlen(text); ++i) {
-        /* Retrieve glyph from the given font corresponding to the current char */
-        texture_glyph* glyph = texture_font_get_glyph(font, text + i);
-        /* Skip non existing glyphs */
-        if (!glyph)
-            continue;
-        /* Newlines are special case */
+        /* Newlines are special case, fonts carry no glyph for them */
         if (text[i] == '\n') {
             pen->x = 0;
             pen->y -= font->height;
             continue;
         }
+        /* Retrieve glyph from the given font corresponding to the current char */
+        texture_glyph* glyph = texture_font_get_glyph(font, text + i);
+        /* Skip non existing glyphs */
+        if (!glyph)
+            continue;
         /* Calculate glyph render triangles */
         float kerning = i > 0 ? texture_glyph_get_kerning(glyph, text + i - 1) : 0.0f;
         pen->x += kerning;
@@ -256,6 +256,7 @@ void text_draw(text_renderer tr, text_draw_desc* desc)
 
     /* Allocate vertex and indice data buffers */
     size_t num_chars = strlen(desc->text);
+    assert(num_chars <= TEXT_MAX_CHARS);
     size_t num_verts = 4 * num_chars;
     size_t num_indcs = 6 * num_chars;
     tvertex* verts   = calloc(num_verts, sizeof(*verts));
@@ -329,12 +330,7 @@ void text_draw(text_renderer tr, text_draw_desc* desc)
         .dfd = 0,
     };
 
-    /* Render text */
-    gfx_begin_default_pass(&(gfx_pass_action){
-        .colors[0] = {
-            .action = GFX_ACTION_DONTCARE
-        }
-    }, desc->scr_width, desc->scr_height);
+    /* Render text into the currently open pass */
     gfx_apply_pipeline(tr->pip);
     gfx_apply_bindings(&(gfx_bindings){
         .vertex_buffers[0] = tr->vbuf,
@@ -344,6 +340,4 @@ void text_draw(text_renderer tr, text_draw_desc* desc)
     gfx_apply_uniforms(GFX_SHADERSTAGE_VS, 0, &(gfx_range){&vparams, sizeof(vparams)});
     gfx_apply_uniforms(GFX_SHADERSTAGE_FS, 0, &(gfx_range){&fparams, sizeof(fparams)});
     gfx_draw(0, num_indcs, 1);
-    gfx_end_pass();
-    gfx_commit();
 }
@@ -41,6 +41,8 @@ typedef struct font {
     gfx_image atlas_img;
 } font;
 
+#define TEXT_MAX_CHARS (512) /* Max characters drawn per frame */
+
 typedef struct text_renderer* text_renderer;
 
 typedef enum text_halignment {
@@ -68,6 +70,7 @@ typedef struct text_draw_desc {
 } text_draw_desc;
 
 text_renderer text_renderer_create();
+/* Draws text into the currently open default pass, at most once per frame */
 void text_draw(text_renderer tr, text_draw_desc* desc);
 void text_renderer_destroy(text_renderer tr);
 
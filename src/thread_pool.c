@@ -39,6 +39,17 @@ struct threadpool_t {
     int started;
 };
 
+typedef struct {
+    mtx_t lock;
+    cnd_t done;
+    threadpool_range_fn routine;
+    void* argument;
+    size_t count;
+    size_t grain;
+    size_t next;
+    int active;
+} threadpool_range_t;
+
 static int threadpool_thread(void* arg);
 static int threadpool_free(threadpool_t* pool);
 
@@ -183,6 +194,84 @@ int threadpool_destroy(threadpool_t* pool, int flags)
     return err;
 }
 
+static void threadpool_range_work(threadpool_range_t* range)
+{
+    for (;;) {
+        /* Grab next chunk */
+        mtx_lock(&(range->lock));
+        size_t first = range->next;
+        size_t last = range->count - first > range->grain ? first + range->grain : range->count;
+        range->next = last;
+        mtx_unlock(&(range->lock));
+
+        if (first == last)
+            break;
+        range->routine(range->argument, first, last);
+    }
+}
+
+static void threadpool_range_helper(void* arg)
+{
+    threadpool_range_t* range = arg;
+    threadpool_range_work(range);
+
+    /* Notify the dispatching thread */
+    mtx_lock(&(range->lock));
+    if (--range->active == 0)
+        cnd_signal(&(range->done));
+    mtx_unlock(&(range->lock));
+}
+
+int threadpool_parallel_for(threadpool_t* pool, size_t count, size_t grain, threadpool_range_fn routine, void* arg)
+{
+    if (routine == NULL || grain == 0)
+        return THREADPOOL_INVALID;
+
+    /* Not worth dispatching */
+    size_t num_chunks = (count + grain - 1) / grain;
+    if (pool == NULL || num_chunks <= 1) {
+        if (count)
+            routine(arg, 0, count);
+        return 0;
+    }
+
+    threadpool_range_t range = {
+        .routine  = routine,
+        .argument = arg,
+        .count    = count,
+        .grain    = grain,
+        .next     = 0,
+        .active   = 0,
+    };
+    mtx_init(&(range.lock), mtx_plain);
+    cnd_init(&(range.done));
+
+    /* Wake up helpers, the calling thread takes a share of the chunks too */
+    int num_helpers = num_chunks - 1 < (size_t)pool->thread_count ? (int)num_chunks - 1 : pool->thread_count;
+    for (int i = 0; i < num_helpers; i++) {
+        mtx_lock(&(range.lock));
+        ++range.active;
+        mtx_unlock(&(range.lock));
+        if (threadpool_add(pool, threadpool_range_helper, &range) != 0) {
+            mtx_lock(&(range.lock));
+            --range.active;
+            mtx_unlock(&(range.lock));
+            break;
+        }
+    }
+    threadpool_range_work(&range);
+
+    /* Wait for helpers to finish */
+    mtx_lock(&(range.lock));
+    while (range.active > 0)
+        cnd_wait(&(range.done), &(range.lock));
+    mtx_unlock(&(range.lock));
+
+    mtx_destroy(&(range.lock));
+    cnd_destroy(&(range.done));
+    return 0;
+}
+
 static int threadpool_free(threadpool_t* pool)
 {
     if (pool == NULL || pool->started > 0)
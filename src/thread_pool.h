@@ -31,11 +31,16 @@
 #ifndef _THREAD_POOL_H_
 #define _THREAD_POOL_H_
 
+#include <stddef.h>
+
 #define THREAD_POOL_MAX_THREADS 64
 #define THREAD_POOL_MAX_QUEUE 65536
 
 typedef struct threadpool_t threadpool_t;
 
+/* Processes the elements in range [first, last) */
+typedef void(*threadpool_range_fn)(void* arg, size_t first, size_t last);
+
 typedef enum {
     THREADPOOL_INVALID        = -1,
     THREADPOOL_LOCK_FAILURE   = -2,
@@ -52,4 +57,8 @@ threadpool_t* threadpool_create(int thread_count, int queue_size);
 int threadpool_add(threadpool_t* pool, void(*routine)(void*), void* arg);
 int threadpool_destroy(threadpool_t* pool, int flags);
 
+/* Splits [0, count) into chunks of grain elements and processes them on the pool
+ * workers and the calling thread, returns after all chunks have been processed */
+int threadpool_parallel_for(threadpool_t* pool, size_t count, size_t grain, threadpool_range_fn routine, void* arg);
+
 #endif /* ! _THREAD_POOL_H_ */
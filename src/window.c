@@ -223,6 +223,11 @@ void window_swap_buffers(window wnd)
     glfwSwapBuffers(wnd->wnd_handle);
 }
 
+void window_make_context_current(window wnd)
+{
+    glfwMakeContextCurrent(wnd ? wnd->wnd_handle : 0);
+}
+
 void window_set_userdata(window wnd, void* userdata)
 {
     wnd->userdata = userdata;
@@ -0,0 +1,4 @@
+PRJTYPE  = Executable
+LIBS     = carbon
+MOREDEPS = ..
+ADDINCS  = ../src
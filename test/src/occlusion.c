@@ -0,0 +1,72 @@
+#include <stdio.h>
+#include <occlusion.h>
+
+/* Headless checks of the software occlusion culler, no graphics context is needed.
+ * The identity view projection maps world coordinates straight to clip space,
+ * so window depth is z * 0.5 + 0.5 and pixel centers follow from x and y. */
+
+static int failures = 0;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+        ++failures; \
+    } \
+} while (0)
+
+static float depth_at(const occlusion_level* lvl, int x, int y)
+{
+    return lvl->min[y * lvl->width + x];
+}
+
+int main()
+{
+    occlusion_buffer ob;
+    occlusion_buffer_init(&ob, OCCLUSION_WIDTH, OCCLUSION_HEIGHT);
+    occlusion_buffer_clear(&ob, mat4_id());
+
+    /* Quad covering the central half of the screen at window depth 0.5 */
+    const vec3 positions[4] = {
+        {{-0.5f, -0.5f, 0.0f}},
+        {{ 0.5f, -0.5f, 0.0f}},
+        {{ 0.5f,  0.5f, 0.0f}},
+        {{-0.5f,  0.5f, 0.0f}},
+    };
+    const uint32_t indices[6] = { 0, 1, 2, 0, 2, 3 };
+    occlusion_rasterize(&ob, positions, indices, 6, mat4_id());
+
+    /* Covered pixels hold the quad depth, the rest stays empty */
+    const occlusion_level* base = &ob.levels[0];
+    CHECK(depth_at(base, base->width / 2, base->height / 2) == 0.5f);
+    CHECK(depth_at(base, base->width / 4 + 1, base->height / 4 + 1) == 0.5f);
+    CHECK(depth_at(base, 0, 0) == 1.0f);
+    CHECK(depth_at(base, base->width - 1, base->height - 1) == 1.0f);
+
+    /* Pyramid keeps the nearest and farthest depth of the covered pixels */
+    occlusion_build_hierarchy(&ob);
+    const occlusion_level* mid = &ob.levels[1];
+    CHECK(mid->min[(mid->height / 2) * mid->width + mid->width / 2] == 0.5f);
+    CHECK(mid->max[(mid->height / 2) * mid->width + mid->width / 2] == 0.5f);
+    const occlusion_level* top = &ob.levels[ob.num_levels - 1];
+    CHECK(top->width == 1 && top->height == 1);
+    CHECK(top->min[0] == 0.5f);
+    CHECK(top->max[0] == 1.0f);
+
+    /* One box hidden behind the quad, one beside it */
+    const aabb boxes[2] = {
+        { .lo = {{-0.2f, -0.2f, 0.4f}}, .hi = {{0.2f, 0.2f, 0.6f}} },
+        { .lo = {{ 0.6f, -0.2f, 0.4f}}, .hi = {{0.8f, 0.2f, 0.6f}} },
+    };
+    uint8_t visible[2] = { 1, 1 };
+    size_t num_occluded = occlusion_cull_boxes(&ob, boxes, 2, visible);
+    CHECK(num_occluded == 1);
+    CHECK(visible[0] == 0);
+    CHECK(visible[1] == 1);
+
+    occlusion_buffer_destroy(&ob);
+    if (failures)
+        fprintf(stderr, "%d occlusion checks failed\n", failures);
+    else
+        printf("occlusion checks passed\n");
+    return failures != 0;
+}